@@ -12,6 +12,7 @@
 #ifndef LISILISK_H__
 #define LISILISK_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 // -----------------------------------------------------------------------------
@@ -43,6 +44,31 @@ enum lisk_geometry_conf {
     LISK_GEOMETRY_IN_BACK,
     LISK_GEOMETRY_IN_FRONT,
     LISK_GEOMETRY_IN_SCENE,
+    LISK_GEOMETRY_OPTIMIZE,
+    LISK_GEOMETRY_VERTICES_FULL,
+    LISK_GEOMETRY_VERTICES_COMPACT,
+    LISK_GEOMETRY_VERTICES_PACKED,
+    LISK_GEOMETRY_LODS,
+    LISK_GEOMETRY_MESHLETS,
+};
+
+enum lisk_model_conf {
+    LISK_MODEL_INSTANCES_STATIC,
+    LISK_MODEL_INSTANCES_STREAMED,
+    LISK_MODEL_INSTANCES_CULLED,
+    LISK_MODEL_INSTANCES_UNCULLED,
+};
+
+enum lisk_texture_conf {
+    LISK_TEXTURE_KEEP_CPU,
+    LISK_TEXTURE_GPU_ONLY,
+};
+
+enum lisk_texture_compression {
+    LISK_TEXTURE_UNCOMPRESSED,
+    LISK_TEXTURE_COMPRESSED_FAST,
+    LISK_TEXTURE_COMPRESSED,
+    LISK_TEXTURE_COMPRESSED_BEST,
 };
 
 // -----------------------------------------------------------------------------
@@ -72,7 +98,8 @@ void lisk_get_size(
 
 // -----------------------------------------------------------------------------
 
-// Loads a texture from a file in the resources directory.
+// Loads a texture from a file in the resources directory, decoding it in the
+// background.
 lisk_res_t lisk_texture(
         const char *file);
 
@@ -124,6 +151,11 @@ void lisk_model_shader(
         const char *name,
         lisk_res_t shader);
 
+// Changes how a model is handled.
+void lisk_model_configure(
+        const char *name,
+        enum lisk_model_conf conf);
+
 // -----------------------------------------------------------------------------
 
 void lisk_geometry_configure(
@@ -132,6 +164,23 @@ void lisk_geometry_configure(
 
 // -----------------------------------------------------------------------------
 
+// Changes where the pixels of a texture are kept once sent to the GPU.
+void lisk_texture_configure(
+        lisk_res_t texture,
+        enum lisk_texture_conf conf);
+
+// Sets how the textures loaded afterwards are compressed on the GPU.
+void lisk_texture_compression(
+        enum lisk_texture_compression compression);
+
+// Measures the memory taken by textures, and saved by the GPU-only ones.
+void lisk_texture_memory(
+        uint64_t *cpu_bytes,
+        uint64_t *gpu_bytes,
+        uint64_t *released_bytes);
+
+// -----------------------------------------------------------------------------
+
 // Assigns a base texture to a model.
 void lisk_material_base_texture(
         lisk_res_t material,
@@ -170,6 +219,14 @@ lisk_handle_t lisk_model_instanciate(
         float (*pos)[3],
         float scale);
 
+// Instanciate a model several times at once.
+void lisk_model_instanciate_many(
+        const char *model_name,
+        float (*positions)[3],
+        float *scales,
+        size_t count,
+        lisk_handle_t *out_handles);
+
 // Creates a directional light to illuminate the scene.
 lisk_handle_t lisk_directional_light_add(
         float (*direction)[3],
@@ -193,6 +250,23 @@ lisk_handle_t lisk_camera(void);
 void lisk_instance_remove(
         lisk_handle_t instance);
 
+// Removes several model instances or lights from the world at once.
+void lisk_instances_remove(
+        const lisk_handle_t *instances,
+        size_t count);
+
+// Changes the positions of several instances or point lights at once.
+void lisk_instances_set_positions(
+        const lisk_handle_t *instances,
+        float (*positions)[3],
+        size_t count);
+
+// Changes the scales of several instances at once.
+void lisk_instances_set_scales(
+        const lisk_handle_t *instances,
+        float (*scales)[3],
+        size_t count);
+
 // TODO: change nomenclature
 // Changes the scale of an instance.
 void lisk_instance_set_scale(
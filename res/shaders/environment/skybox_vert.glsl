@@ -1,14 +1,34 @@
 #version 330 core
 
-layout (location = 0) in vec3 VertexPos;
+layout (location = 0) in vec3 VertexPosEncoded;
+layout (location = 6) in vec3 VertexPosOrigin;
+layout (location = 7) in vec3 VertexPosExtent;
 
 out vec3 FragUV;
 
-uniform mat4 PROJECTION_MATRIX;
-uniform mat4 VIEW_MATRIX;
+// Frame-global data, written once per frame by the engine. Mirrors
+// struct frame_uniforms in the codebase.
+layout(std140) uniform BLOCK_FRAME {
+    mat4 VIEW_MATRIX;
+    mat4 PROJECTION_MATRIX;
+
+    // Coordinates of the point of view in world space.
+    vec3 CAMERA_POS;
+    uint TIME;
+
+    vec4 LIGHT_AMBIENT;
+
+    vec3 FOG_COLOR;
+    float FOG_DISTANCE;
+
+    uint LIGHT_POINTS_NB;
+    uint LIGHT_DIRECTIONALS_NB;
+};
 
 void main()
 {
+    vec3 VertexPos = VertexPosOrigin + (VertexPosEncoded * VertexPosExtent);
+
     FragUV = VertexPos;
 
     vec4 normalized_dev_coords = (PROJECTION_MATRIX * mat4(mat3(VIEW_MATRIX))
@@ -4,10 +4,24 @@
 // ---------------------------------------------------------
 // ---------------------------------------------------------
 
-// Uniform containing the coordiantes of the point of view in world space.
-uniform vec3 CAMERA_POS;
+// Frame-global data, written once per frame by the engine. Mirrors
+// struct frame_uniforms in the codebase.
+layout(std140) uniform BLOCK_FRAME {
+    mat4 VIEW_MATRIX;
+    mat4 PROJECTION_MATRIX;
 
-uniform uint TIME;
+    // Coordinates of the point of view in world space.
+    vec3 CAMERA_POS;
+    uint TIME;
+
+    vec4 LIGHT_AMBIENT;
+
+    vec3 FOG_COLOR;
+    float FOG_DISTANCE;
+
+    uint LIGHT_POINTS_NB;
+    uint LIGHT_DIRECTIONALS_NB;
+};
 
 // ---------------------------------------------------------
 
@@ -25,13 +39,24 @@ layout(std140) uniform BLOCK_MATERIAL {
     float emissive_strength;
 
     float shininess;
+
+    // Where the base samplers read in their layer : offset and scale of the
+    // texture coordinates, and index of the layer.
+    vec4 sampler_rects[5];
+    vec4 sampler_layers[2];
 } MATERIAL;
 
-layout (location = 0) uniform sampler2D ambient_mask;
-layout (location = 1) uniform sampler2D specular_mask;
-layout (location = 2) uniform sampler2D diffuse_mask;
-layout (location = 3) uniform sampler2D emissive_mask;
-layout (location = 4) uniform sampler2D base_texture;
+layout (location = 0) uniform sampler2DArray ambient_mask;
+layout (location = 1) uniform sampler2DArray specular_mask;
+layout (location = 2) uniform sampler2DArray diffuse_mask;
+layout (location = 3) uniform sampler2DArray emissive_mask;
+layout (location = 4) uniform sampler2DArray base_texture;
+
+#define AMBIENT_MASK_SLOT 0
+#define SPECULAR_MASK_SLOT 1
+#define DIFFUSE_MASK_SLOT 2
+#define EMISSIVE_MASK_SLOT 3
+#define BASE_TEXTURE_SLOT 4
 
 // ---------------------------------------------------------
 // ---------------------------------------------------------
@@ -60,7 +85,6 @@ struct LightDirectional {
 // ---------------------------------------------------------
 
 #define LIGHT_POINTS_NB_MAX 32
-uniform uint LIGHT_POINTS_NB;
 
 layout(std140) uniform BLOCK_LIGHT_POINTS {
     LightPoint array[LIGHT_POINTS_NB_MAX];
@@ -69,21 +93,11 @@ layout(std140) uniform BLOCK_LIGHT_POINTS {
 // ---------------------------------------------------------
 
 #define LIGHT_DIRECTIONALS_NB_MAX 8
-uniform uint LIGHT_DIRECTIONALS_NB;
 
 layout(std140) uniform BLOCK_LIGHT_DIRECTIONALS {
     LightDirectional array[LIGHT_DIRECTIONALS_NB_MAX];
 } LIGHT_DIRECTIONALS;
 
-// ---------------------------------------------------------
-
-uniform vec4 LIGHT_AMBIENT;
-
-// ---------------------------------------------------------
-
-uniform vec3 FOG_COLOR;
-uniform float FOG_DISTANCE;
-
 // ---------------------------------------------------------
 // ---------------------------------------------------------
 
@@ -107,12 +121,27 @@ vec4 TextureContribution;
 // ---------------------------------------------------------
 // ---------------------------------------------------------
 
+// Samples a base sampler in its rectangle of its layer, the texture
+// coordinates wrapping around in it. Mip levels are picked as if the texture
+// was sampled on its own.
+vec4 sample_base(sampler2DArray s, int slot, vec2 uv)
+{
+    vec4 rect = MATERIAL.sampler_rects[slot];
+    float layer = MATERIAL.sampler_layers[slot / 4][slot % 4];
+    vec2 at = rect.xy + fract(uv) * rect.zw;
+
+    return textureGrad(s, vec3(at, layer),
+            dFdx(uv) * rect.zw, dFdy(uv) * rect.zw);
+}
+
+// ---------------------------------------------------------
+
 vec4 light_diffuse(vec3 light_dir, vec4 light_color)
 {
     float diff = max(dot(Normal, light_dir), 0.0);
     return light_color
             * vec4(diff * MATERIAL.diffuse, 1.)
-            * texture(diffuse_mask, FragUV)
+            * sample_base(diffuse_mask, DIFFUSE_MASK_SLOT, FragUV)
             * MATERIAL.diffuse_strength;
 }
 
@@ -126,7 +155,7 @@ vec4 light_specular(vec3 light_dir, vec4 light_color)
 
     return light_color
             * vec4(spec * MATERIAL.specular, 1.)
-            * texture(specular_mask, FragUV)
+            * sample_base(specular_mask, SPECULAR_MASK_SLOT, FragUV)
             * MATERIAL.specular_strength;
 }
 
@@ -136,7 +165,7 @@ vec4 light_ambient_contribution(vec4 light_color)
 {
     return light_color
             * vec4(MATERIAL.ambient, 1.)
-            * texture(ambient_mask, FragUV)
+            * sample_base(ambient_mask, AMBIENT_MASK_SLOT, FragUV)
             * MATERIAL.ambient_strength;
 }
 
@@ -187,7 +216,7 @@ vec4 fog_contribution()
 vec4 emissive_contribution()
 {
     return vec4(MATERIAL.emissive, 1.)
-            * texture(emissive_mask, FragUV)
+            * sample_base(emissive_mask, EMISSIVE_MASK_SLOT, FragUV)
             * MATERIAL.emissive_strength;
 }
 
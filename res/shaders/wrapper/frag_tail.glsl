@@ -19,7 +19,7 @@ void main()
 
     FogContribution = fog_contribution();
     EmissionContribution = emissive_contribution();
-    TextureContribution = texture(base_texture, FragUV);
+    TextureContribution = sample_base(base_texture, BASE_TEXTURE_SLOT, FragUV);
 
     fragment();
 }
@@ -3,17 +3,37 @@
 // ---------------------------------------------------------
 // ---------------------------------------------------------
 
-layout (location = 0) in vec3 VertexPos;
+layout (location = 0) in vec3 VertexPosEncoded;
 layout (location = 1) in vec3 VertexNormal;
 layout (location = 2) in vec2 VertexUV;
 layout (location = 3) in vec3 InstancePosition;
 layout (location = 4) in vec3 InstanceScale;
 layout (location = 5) in vec4 InstanceRotation;
+// Geometries can send quantized positions : they are decoded before vertex()
+// is called, into VertexPos.
+layout (location = 6) in vec3 VertexPosOrigin;
+layout (location = 7) in vec3 VertexPosExtent;
 
-uniform mat4 VIEW_MATRIX;
-uniform mat4 PROJECTION_MATRIX;
+vec3 VertexPos;
 
-uniform uint TIME;
+// Frame-global data, written once per frame by the engine. Mirrors
+// struct frame_uniforms in the codebase.
+layout(std140) uniform BLOCK_FRAME {
+    mat4 VIEW_MATRIX;
+    mat4 PROJECTION_MATRIX;
+
+    // Coordinates of the point of view in world space.
+    vec3 CAMERA_POS;
+    uint TIME;
+
+    vec4 LIGHT_AMBIENT;
+
+    vec3 FOG_COLOR;
+    float FOG_DISTANCE;
+
+    uint LIGHT_POINTS_NB;
+    uint LIGHT_DIRECTIONALS_NB;
+};
 
 out vec3 Normal;
 out vec3 FragPos;
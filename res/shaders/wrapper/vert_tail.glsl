@@ -7,5 +7,6 @@
 
 void main()
 {
+    VertexPos = VertexPosOrigin + (VertexPosEncoded * VertexPosExtent);
     vertex();
 }
@@ -86,6 +86,9 @@ void lisilisk_context_init(
     glEnable(GL_CULL_FACE);
 
     glDepthFunc(GL_LEQUAL);
+
+    // the state changed behind the back of the engine's state shadow
+    gl_state_invalidate();
 }
 
 /**
@@ -104,6 +107,8 @@ void lisilisk_context_deinit(
     context->opengl = nullptr;
     context->window = nullptr;
 
+    workers_stop();
+
     IMG_Quit();
     SDL_Quit();
 }
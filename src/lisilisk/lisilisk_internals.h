@@ -21,6 +21,21 @@
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
+#ifndef LISILISK_GEOMETRY_CACHE_FOLDER
+/** Folder receiving the binary geometries built from .obj resources. */
+#define LISILISK_GEOMETRY_CACHE_FOLDER \
+        PACKED_RESOURCE_STORAGES_FOLDER "/geometries"
+#endif
+
+#ifndef LISILISK_TEXTURE_CACHE_FOLDER
+/** Folder receiving the baked textures built from image resources. */
+#define LISILISK_TEXTURE_CACHE_FOLDER \
+        PACKED_RESOURCE_STORAGES_FOLDER "/textures"
+#endif
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
 /**
  * @brief Kinds of objects managed by handles.
  *
@@ -77,6 +92,16 @@ union lisk_res_layout {
 struct lisilisk_store_texture {
     struct texture *default_texture;
     HASHMAP(struct texture *) textures;
+
+    // textures still decoded by the worker threads
+    ARRAY(struct texture *) decoding;
+
+    // compression of the textures baked from then on
+    enum texture_compression compression;
+
+    // array textures shared by the 2D textures, so materials bind fewer
+    // texture objects
+    struct texture_pool pool;
 };
 
 /**
@@ -190,6 +215,8 @@ u32 lisilisk_store_texture_register(
 struct texture *lisilisk_store_texture_retrieve(
         struct lisilisk_store_texture *store,
         u32 hash);
+void lisilisk_store_texture_finish_decoding(
+        struct lisilisk_store_texture *store);
 
 // -----------------------------------------------------------------------------
 
@@ -25,11 +25,19 @@
 DECLARE_RES(skybox_vert, "res_shaders_environment_skybox_vert_glsl")
 DECLARE_RES(skybox_frag, "res_shaders_environment_skybox_frag_glsl")
 
+/// Number of instances handled together by the batch functions, bounding the
+/// memory they need on the stack.
+#define LISK_BATCH_RUN_MAX (256u)
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
 static struct model *static_data_model_of_instance(
         union lisk_handle_layout handle);
+static size_t static_data_instances_run(
+        const lisk_handle_t *instances,
+        size_t count,
+        handle_t *out_handles);
 
 static struct model *static_data_model_named(
         const char *name,
@@ -197,7 +205,9 @@ void lisk_rename(const char *window_name)
 
 /**
  * @brief Loads or retrieve a previously loaded texture. The texture can be
- * used with the handle that is returned.
+ * used with the handle that is returned. The image is decoded in the
+ * background : the texture stays plain white until it is ready, and is sent
+ * to the GPU by some later lisk_draw().
  *
  * @param[in] file System path to an image inside your resources folder.
  * @return lisk_res_t
@@ -437,6 +447,40 @@ void lisk_model_material(
     model_material(model, material);
 }
 
+/**
+ * @brief Configures how a model's instances are sent to the GPU. Models whose
+ * instances all move every frame should be streamed.
+ *
+ * @param name
+ * @param conf
+ */
+void lisk_model_configure(
+        const char *name,
+        enum lisk_model_conf conf)
+{
+    struct model *model = nullptr;
+
+    model = static_data_model_named(name, nullptr);
+    if (!model) {
+        return;
+    }
+
+    switch (conf) {
+        case LISK_MODEL_INSTANCES_STATIC:
+            model_instances_streaming(model, false);
+            break;
+        case LISK_MODEL_INSTANCES_STREAMED:
+            model_instances_streaming(model, true);
+            break;
+        case LISK_MODEL_INSTANCES_CULLED:
+            model_culling(model, true);
+            break;
+        case LISK_MODEL_INSTANCES_UNCULLED:
+            model_culling(model, false);
+            break;
+    }
+}
+
 /**
  * @brief
  *
@@ -449,6 +493,8 @@ void lisk_geometry_configure(
 {
 
     struct geometry *geometry = nullptr;
+    struct geometry_cache_stats stats_before = { 0 };
+    struct geometry_cache_stats stats_after = { 0 };
 
     union lisk_res_layout geometry_handle = { .full = res_geometry };
 
@@ -483,9 +529,124 @@ void lisk_geometry_configure(
         case LISK_GEOMETRY_IN_SCENE:
             geometry_set_layering(geometry, GEOMETRY_LAYER_NORMAL);
             break;
+        case LISK_GEOMETRY_OPTIMIZE:
+            geometry_optimize(geometry, &stats_before, &stats_after);
+            logger_log(static_data.log, LOGGER_SEVERITY_INFO,
+                    "Optimized geometry : ACMR %.3f -> %.3f, "
+                    "ATVR %.3f -> %.3f\n",
+                    stats_before.acmr, stats_after.acmr,
+                    stats_before.atvr, stats_after.atvr);
+            break;
+        case LISK_GEOMETRY_VERTICES_FULL:
+            geometry_set_vertex_format(geometry, GEOMETRY_VERTEX_FULL);
+            break;
+        case LISK_GEOMETRY_VERTICES_COMPACT:
+            geometry_set_vertex_format(geometry, GEOMETRY_VERTEX_COMPACT);
+            break;
+        case LISK_GEOMETRY_VERTICES_PACKED:
+            geometry_set_vertex_format(geometry, GEOMETRY_VERTEX_PACKED);
+            break;
+        case LISK_GEOMETRY_LODS:
+            geometry_build_lods(geometry, GEOMETRY_LODS_MAX - 1);
+            logger_log(static_data.log, LOGGER_SEVERITY_INFO,
+                    "Built %u levels of detail\n", geometry->lods_nb);
+            break;
+        case LISK_GEOMETRY_MESHLETS:
+            geometry_build_meshlets(geometry);
+            logger_log(static_data.log, LOGGER_SEVERITY_INFO,
+                    "Split geometry in %zu meshlets\n",
+                    array_length(geometry->meshlets));
+            break;
     }
 }
 
+/**
+ * @brief Changes where the pixels of a texture are kept once it is sent to the
+ * GPU. GPU-only textures release their pixels, and decode them again from the
+ * resources when they are sent again.
+ *
+ * @param res_texture
+ * @param conf
+ */
+void lisk_texture_configure(
+        lisk_res_t res_texture,
+        enum lisk_texture_conf conf)
+{
+    union lisk_res_layout texture_handle = { .full = res_texture };
+    struct texture *texture = nullptr;
+
+    if (texture_handle.flavor != RES_REPRESENTS_TEXTURE) {
+        return;
+    }
+
+    texture = lisilisk_store_texture_retrieve(
+            &static_data.stores.textures, texture_handle.hash);
+
+    if (!texture) {
+        return;
+    }
+
+    switch (conf) {
+        case LISK_TEXTURE_KEEP_CPU:
+            texture_set_residency(texture, TEXTURE_RESIDENCY_KEEP_CPU);
+            break;
+        case LISK_TEXTURE_GPU_ONLY:
+            texture_set_residency(texture, TEXTURE_RESIDENCY_GPU_ONLY);
+            break;
+    }
+}
+
+/**
+ * @brief Sets how the textures loaded from then on are compressed. Compressed
+ * textures are baked to ETC2 blocks, with EAC alpha if they have some, taking
+ * four to eight times less memory on the GPU. The presets trade the time
+ * taken to bake them, the first time they are loaded, for quality.
+ *
+ * @param[in] compression Compression preset.
+ */
+void lisk_texture_compression(
+        enum lisk_texture_compression compression)
+{
+    enum texture_compression *store_compression =
+            &static_data.stores.textures.compression;
+
+    switch (compression) {
+        case LISK_TEXTURE_UNCOMPRESSED:
+            *store_compression = TEXTURE_COMPRESSION_NONE;
+            break;
+        case LISK_TEXTURE_COMPRESSED_FAST:
+            *store_compression = TEXTURE_COMPRESSION_FAST;
+            break;
+        case LISK_TEXTURE_COMPRESSED:
+            *store_compression = TEXTURE_COMPRESSION_BALANCED;
+            break;
+        case LISK_TEXTURE_COMPRESSED_BEST:
+            *store_compression = TEXTURE_COMPRESSION_BEST;
+            break;
+    }
+}
+
+/**
+ * @brief Measures the memory taken by all textures : their pixels in system
+ * memory, their storage on the GPU, and the pixels released from system
+ * memory by GPU-only textures.
+ *
+ * @param[out] cpu_bytes Optional, bytes of pixels in system memory.
+ * @param[out] gpu_bytes Optional, bytes of storage on the GPU.
+ * @param[out] released_bytes Optional, bytes of pixels released.
+ */
+void lisk_texture_memory(
+        uint64_t *cpu_bytes,
+        uint64_t *gpu_bytes,
+        uint64_t *released_bytes)
+{
+    struct texture_memory_stats stats = texture_get_memory_stats();
+
+    if (cpu_bytes) *cpu_bytes = stats.cpu_bytes;
+    if (gpu_bytes) *gpu_bytes = stats.gpu_bytes;
+    if (released_bytes) *released_bytes = stats.released_bytes;
+}
+
 /**
  * @brief
  *
@@ -707,6 +868,79 @@ lisk_handle_t lisk_model_instanciate(
     return handle.full;
 }
 
+/**
+ * @brief Creates several instances of a model in one go. The model is only
+ * looked up once, and memory for the instances is reserved once.
+ * All instances start with no rotation.
+ *
+ * @param[in] name Name of the instanciated model.
+ * @param[in] positions One position for each instance.
+ * @param[in] scales One uniform scale for each instance. If NULL, all
+ * instances have a scale of 1.
+ * @param[in] count Number of instances.
+ * @param[out] out_handles Array of at least count handles, filled with the
+ * handles to the new instances.
+ */
+void lisk_model_instanciate_many(
+        const char *name,
+        float (*positions)[3],
+        float *scales,
+        size_t count,
+        lisk_handle_t *out_handles)
+{
+    struct model *model = nullptr;
+    u32 model_hash = 0;
+    size_t run = 0;
+    handle_t in_handles[LISK_BATCH_RUN_MAX] = { 0 };
+    f32 run_scales[LISK_BATCH_RUN_MAX][3] = { 0 };
+    struct quaternion run_rotations[LISK_BATCH_RUN_MAX] = { 0 };
+
+    model = static_data_model_named(name, &model_hash);
+    if (!model) {
+        for (size_t i = 0 ; i < count ; i++) {
+            out_handles[i] = LISK_HANDLE_NONE;
+        }
+        return;
+    }
+
+    for (size_t i = 0 ; i < LISK_BATCH_RUN_MAX ; i++) {
+        run_rotations[i] = quaternion_identity();
+    }
+
+    for (size_t start = 0 ; start < count ; start += run) {
+        run = count - start;
+        if (run > LISK_BATCH_RUN_MAX) {
+            run = LISK_BATCH_RUN_MAX;
+        }
+
+        for (size_t i = 0 ; i < run ; i++) {
+            run_scales[i][0] = scales ? scales[start + i] : 1.f;
+            run_scales[i][1] = run_scales[i][0];
+            run_scales[i][2] = run_scales[i][0];
+        }
+
+        model_instantiate_many(model, run, in_handles);
+        model_instances_positions(model, in_handles, run,
+                (const f32 (*)[3]) positions + start);
+        model_instances_scales(model, in_handles, run,
+                (const f32 (*)[3]) run_scales);
+        model_instances_rotations(model, in_handles, run, run_rotations);
+
+        for (size_t i = 0 ; i < run ; i++) {
+            if (in_handles[i] == 0) {
+                out_handles[start + i] = LISK_HANDLE_NONE;
+                continue;
+            }
+
+            out_handles[start + i] = (union lisk_handle_layout) {
+                    .hash = model_hash,
+                    .flavor = HANDLE_REPRESENTS_INSTANCE,
+                    .internal = in_handles[i]
+            }.full;
+        }
+    }
+}
+
 /**
  * @brief Adds a directional light to the scene, a source of light that
  * simulates a bright, but far away object. All of its rays are parallel
@@ -903,6 +1137,97 @@ void lisk_instance_set_position(
     }
 }
 
+/**
+ * @brief Deletes several instances of models or lights from the engine.
+ * Consecutive instances of the same model are removed together.
+ *
+ * @param[in] instances Handles to the deleted objects.
+ * @param[in] count Number of handles.
+ */
+void lisk_instances_remove(
+        const lisk_handle_t *instances,
+        size_t count)
+{
+    size_t run = 0;
+    handle_t in_handles[LISK_BATCH_RUN_MAX] = { 0 };
+
+    for (size_t i = 0 ; i < count ; i += run) {
+        run = static_data_instances_run(instances + i, count - i, in_handles);
+
+        if (run == 0) {
+            lisk_instance_remove(instances[i]);
+            run = 1;
+            continue;
+        }
+
+        model_instances_remove(static_data_model_of_instance(
+                (union lisk_handle_layout) { .full = instances[i] }),
+                in_handles, run);
+    }
+}
+
+/**
+ * @brief Changes the positions of several instances, point lights, or the
+ * camera. Consecutive instances of the same model are moved together.
+ *
+ * @param[in] instances Handles to the repositioned objects.
+ * @param[in] positions One new position for each handle.
+ * @param[in] count Number of handles.
+ */
+void lisk_instances_set_positions(
+        const lisk_handle_t *instances,
+        float (*positions)[3],
+        size_t count)
+{
+    size_t run = 0;
+    handle_t in_handles[LISK_BATCH_RUN_MAX] = { 0 };
+
+    for (size_t i = 0 ; i < count ; i += run) {
+        run = static_data_instances_run(instances + i, count - i, in_handles);
+
+        if (run == 0) {
+            lisk_instance_set_position(instances[i], positions + i);
+            run = 1;
+            continue;
+        }
+
+        model_instances_positions(static_data_model_of_instance(
+                (union lisk_handle_layout) { .full = instances[i] }),
+                in_handles, run, (const f32 (*)[3]) positions + i);
+    }
+}
+
+/**
+ * @brief Changes the scales of several instances. Consecutive instances of the
+ * same model are scaled together.
+ *
+ * @param[in] instances Handles to the rescaled instances.
+ * @param[in] scales One new scale for each handle.
+ * @param[in] count Number of handles.
+ */
+void lisk_instances_set_scales(
+        const lisk_handle_t *instances,
+        float (*scales)[3],
+        size_t count)
+{
+    size_t run = 0;
+    handle_t in_handles[LISK_BATCH_RUN_MAX] = { 0 };
+
+    for (size_t i = 0 ; i < count ; i += run) {
+        run = static_data_instances_run(instances + i, count - i, in_handles);
+
+        if (run == 0) {
+            lisk_instance_set_scale(instances[i], scales + i);
+            run = 1;
+            continue;
+        }
+
+        model_instances_scales(static_data_model_of_instance(
+                (union lisk_handle_layout) { .full = instances[i] }),
+                in_handles, run, (const f32 (*)[3]) scales + i);
+    }
+}
+
 /**
  * @brief Changes the rotation of an intance, a directional light, or the
  * camera.
@@ -1168,6 +1493,9 @@ void lisk_draw(void)
     seconds_elapsed = (this_call.tv_sec - last_call.tv_sec)
                         + ((this_call.tv_usec - last_call.tv_usec) / 1000000.);
 
+    // textures registered since the last frame may be decoded by now
+    lisilisk_store_texture_finish_decoding(&static_data.stores.textures);
+
     scene_draw(&static_data.world.scene, seconds_elapsed);
     SDL_GL_SwapWindow(static_data.context.window);
 
@@ -1216,6 +1544,44 @@ static struct model *static_data_model_of_instance(
     return model;
 }
 
+/**
+ * @brief Measures the run of instances of the same model at the start of an
+ * array of handles, up to LISK_BATCH_RUN_MAX, and extracts their 3dful
+ * handles. Returns 0 if the first handle is not a valid model instance.
+ *
+ * @param instances
+ * @param count
+ * @param out_handles
+ * @return size_t
+ */
+static size_t static_data_instances_run(
+        const lisk_handle_t *instances,
+        size_t count,
+        handle_t *out_handles)
+{
+    union lisk_handle_layout first = { .full = instances[0] };
+    union lisk_handle_layout handle = { 0 };
+    size_t run = 0;
+
+    if (!static_data_model_of_instance(first)) {
+        return 0;
+    }
+
+    while ((run < count) && (run < LISK_BATCH_RUN_MAX)) {
+        handle = (union lisk_handle_layout) { .full = instances[run] };
+
+        if ((handle.flavor != HANDLE_REPRESENTS_INSTANCE)
+                || (handle.hash != first.hash)) {
+            break;
+        }
+
+        out_handles[run] = handle.internal;
+        run += 1;
+    }
+
+    return run;
+}
+
 /**
  * @brief retrieves a model from the name the user supplied. If it doesn't
  * exists, an entry will be created for it.
@@ -1,11 +1,18 @@
 
 #include "lisilisk_internals.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
 #include <ustd/res.h>
 
 DECLARE_RES(sphere_object, "res_models_sphere_obj")
 DECLARE_RES(quad_object, "res_models_quad_obj")
 
+static void lisilisk_store_geometry_from_obj(struct geometry *geometry,
+        u32 hash, const byte *obj_contents, size_t obj_contents_length);
+
 /**
  * @brief
  *
@@ -96,7 +103,8 @@ u32 lisilisk_store_geometry_register(
             goto cleanup;
         }
 
-        geometry_wavobj_mem(geometry, obj_contents, obj_contents_length);
+        lisilisk_store_geometry_from_obj(geometry, hash, obj_contents,
+                obj_contents_length);
 
         // if successful, allocate a new geometry and copy the valid geometry to it
         if (array_length(geometry->faces) == 0) {
@@ -140,3 +148,39 @@ struct geometry *lisilisk_store_geometry_retrieve(
 
     return nullptr;
 }
+
+/**
+ * @brief Builds a geometry from the contents of an .obj file. The result is
+ * kept in a binary geometry file named after the hash of the file's path, and
+ * is used instead of parsing the file again for as long as its contents do not
+ * change.
+ *
+ * @param[inout] geometry Modified geometry.
+ * @param[in] hash Hash of the path of the .obj file.
+ * @param[in] obj_contents Contents of the .obj file.
+ * @param[in] obj_contents_length Length of the contents, in bytes.
+ */
+static void lisilisk_store_geometry_from_obj(struct geometry *geometry,
+        u32 hash, const byte *obj_contents, size_t obj_contents_length)
+{
+    char cache_path[256] = { 0 };
+    u64 source_hash = 0;
+
+    source_hash = hash_jenkins_one_at_a_time(obj_contents,
+            obj_contents_length, 0u);
+    snprintf(cache_path, sizeof(cache_path),
+            LISILISK_GEOMETRY_CACHE_FOLDER "/%08x.geometry", hash);
+
+    if (geometry_binary(geometry, cache_path, source_hash)) {
+        return;
+    }
+
+    geometry_wavobj_mem(geometry, obj_contents, obj_contents_length);
+
+    // the geometry is only parsed again next time if the folder is missing
+    if ((array_length(geometry->faces) > 0)
+            && ((mkdir(LISILISK_GEOMETRY_CACHE_FOLDER, 0755) == 0)
+                    || (errno == EEXIST))) {
+        geometry_binary_write(geometry, cache_path, source_hash);
+    }
+}
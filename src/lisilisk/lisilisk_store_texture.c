@@ -1,6 +1,10 @@
 
 #include "lisilisk_internals.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
 /**
  * @brief
  *
@@ -17,11 +21,17 @@ struct lisilisk_store_texture lisilisk_store_texture_create(void)
             .textures = hashmap_create(
                     make_system_allocator(),
                     sizeof(*new_store.textures), 32),
+            .decoding = array_create(
+                    make_system_allocator(),
+                    sizeof(*new_store.decoding), 32),
     };
 
     *new_store.default_texture = (struct texture) { 0 };
     texture_2D_default(new_store.default_texture);
 
+    texture_pool_create(&new_store.pool);
+    texture_pool_add(&new_store.pool, new_store.default_texture);
+
     return new_store;
 }
 
@@ -47,6 +57,9 @@ void lisilisk_store_texture_delete(
         alloc.free(alloc, store->textures[i]);
     }
     hashmap_destroy(alloc, (HASHMAP_ANY *) &store->textures);
+    array_destroy(alloc, (ARRAY_ANY *) &store->decoding);
+
+    texture_pool_delete(&store->pool);
 
     *store = (struct lisilisk_store_texture) { };
 }
@@ -124,6 +137,8 @@ u32 lisilisk_store_texture_register(
     struct texture *texture = nullptr;
     size_t size_image = 0;
     byte *image_buffer = nullptr;
+    char baked_path[256] = { 0 };
+    u64 source_hash = 0;
     u32 hash = 0;
 
     hash = hashmap_hash_of(image, 0);
@@ -133,11 +148,37 @@ u32 lisilisk_store_texture_register(
         texture = alloc.malloc(alloc, sizeof(*texture));
         *texture = (struct texture) { 0 };
 
+        // the buffer belongs to the resource storage, and outlives the
+        // decoding
         image_buffer = resource_manager_fetch(res_manager, "lisilisk", image, &size_image);
-        texture_2D_file_mem(texture, image_buffer, size_image);
+        if (image_buffer) {
+            source_hash = hash_jenkins_one_at_a_time(image_buffer,
+                    size_image, 0u);
+        }
+        snprintf(baked_path, sizeof(baked_path),
+                LISILISK_TEXTURE_CACHE_FOLDER "/%08x.texture", hash);
 
         hashmap_ensure_capacity(alloc, (HASHMAP_ANY *) &store->textures, 1);
         hashmap_set_hashed(store->textures, hash, &texture);
+
+        if (image_buffer && texture_2D_baked(texture, baked_path, source_hash,
+                    store->compression)) {
+            texture_pool_add(&store->pool, texture);
+            return hash;
+        }
+
+        // the image is baked by the worker decoding it, if it has a folder
+        // to be baked to
+        if ((mkdir(LISILISK_TEXTURE_CACHE_FOLDER, 0755) != 0)
+                && (errno != EEXIST)) {
+            baked_path[0] = '\0';
+        }
+        texture_2D_file_mem_async(texture, image_buffer, size_image,
+                (baked_path[0] != '\0') ? baked_path : nullptr, source_hash,
+                store->compression);
+
+        array_ensure_capacity(alloc, (ARRAY_ANY *) &store->decoding, 1);
+        array_push(store->decoding, &texture);
     }
 
     return hash;
@@ -170,6 +211,34 @@ struct texture *lisilisk_store_texture_retrieve(
     return nullptr;
 }
 
+/**
+ * @brief Swaps in the images of the textures decoded since the last call, and
+ * sends them to the GPU if they are in use, pooled with the other textures.
+ * Must be called from the thread owning the OpenGL context.
+ *
+ * @param store
+ */
+void lisilisk_store_texture_finish_decoding(
+        struct lisilisk_store_texture *store)
+{
+    size_t i = 0;
+
+    if (!store) {
+        return;
+    }
+
+    while (i < array_length(store->decoding)) {
+        if (texture_finish_decoding(store->decoding[i])) {
+            texture_pool_add(&store->pool, store->decoding[i]);
+            array_remove_swapback(store->decoding, i);
+        } else {
+            i += 1;
+        }
+    }
+
+    texture_pool_flush(&store->pool);
+}
+
 /**
  * @brief
  *
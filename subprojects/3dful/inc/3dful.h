@@ -17,6 +17,7 @@
 
 #include <ustd/common.h>
 #include <ustd/array.h>
+#include <ustd/hashmap.h>
 #include <ustd/logging.h>
 #include <ustd/math2d.h>
 #include <ustd/math3d.h>
@@ -69,6 +70,22 @@ enum geometry_layering {
     GEOMETRY_LAYER_BACK,
 };
 
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Layout of the vertices sent to the GPU. The vertices kept on the CPU
+ * side are always full.
+ */
+enum geometry_vertex_format {
+    /** Floats everywhere, 32 bytes per vertex. */
+    GEOMETRY_VERTEX_FULL,
+    /** Packed normals and half-float UVs, 20 bytes per vertex. */
+    GEOMETRY_VERTEX_COMPACT,
+    /** Compact, and positions quantized to 16 bits in the bounding box, 16
+        bytes per vertex. */
+    GEOMETRY_VERTEX_PACKED,
+};
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
@@ -88,6 +105,31 @@ struct loadable {
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @brief Decides when changes made to a handle_buffer_array's data are written
+ * to its buffer object.
+ */
+enum handle_buffer_array_sync {
+    /** Each change is written to the buffer object as soon as it is made. */
+    HANDLE_BUFFER_ARRAY_SYNC_IMMEDIATE,
+    /** Changes are only marked as dirty, and written when the array is
+        flushed. */
+    HANDLE_BUFFER_ARRAY_SYNC_DEFERRED,
+    /** The whole array is rewritten on flush when it changed, each time in a
+        different region of the buffer object that the GPU is done with. */
+    HANDLE_BUFFER_ARRAY_SYNC_STREAMING,
+};
+
+/// Number of regions the buffer object of a streaming handle_buffer_array is
+/// split into.
+#define HANDLE_BUFFER_ARRAY_RING_SIZE (3)
+
+/**
+ * @brief Span of bytes in some buffer, from start (included) to end
+ * (excluded).
+ */
+struct byte_range { size_t start, end; };
+
 /**
  * @brief For contiguous data that can be loaded to an OpenGL buffer object.
  *
@@ -100,13 +142,39 @@ struct handle_buffer_array {
 
     /** Foreign-owned data. MUST be an array as defined in ustd/array.h. */
     ARRAY_ANY data_array;
-    /** Owned handle array. MUST be an array as defined in ustd/array.h. */
+    /** Owned handle array, parallel to the data (dense index -> handle).
+        MUST be an array as defined in ustd/array.h. */
     ARRAY(handle_t) handles;
+    /** Owned index array, indexed by handle value (handle -> dense index).
+        MUST be an array as defined in ustd/array.h. */
+    ARRAY(u32) indices;
 
     /** OpenGL name for the buffer object. Valid when the data is loaded. */
     GLuint buffer_name;
     /** User-specified buffer object usage. */
     GLenum buffer_usage;
+    /** Size, in bytes, of the storage currently allocated for the buffer
+        object. Kept on the CPU side to never query the driver for it. */
+    size_t buffer_capacity;
+
+    /** User-specified synchronisation strategy. */
+    enum handle_buffer_array_sync sync_mode;
+    /** Owned array of bytes ranges changed since the last flush, in deferred
+        mode. MUST be an array as defined in ustd/array.h. */
+    ARRAY(struct byte_range) dirty_ranges;
+
+    /** State of the streaming mode. */
+    struct {
+        /** Size, in bytes, of one region of the ring. */
+        size_t region_size;
+        /** Index of the region last written to. */
+        u32 current;
+        /** If the data changed since the last flush. */
+        bool changed;
+        /** Fences guarding each region against being overwritten while the
+            GPU still reads it. */
+        GLsync fences[HANDLE_BUFFER_ARRAY_RING_SIZE];
+    } stream;
 };
 
 // -----------------------------------------------------------------------------
@@ -120,6 +188,11 @@ struct shader {
     GLuint frag_shader;
     GLuint vert_shader;
     GLuint program;
+
+    /** Owned map of all active uniforms of the program to their location.
+        Filled when the program is linked. MUST be a hashmap as defined in
+        ustd/hashmap.h. */
+    HASHMAP(GLint) uniforms_by_name;
 };
 
 // -----------------------------------------------------------------------------
@@ -137,6 +210,62 @@ struct vertex { struct vector3 pos, normal; struct vector2 uv; };
  */
 struct face { u32 idx_vert[3u]; };
 
+/**
+ * @brief Volumes enclosing all vertices of a mesh, in model space.
+ *
+ */
+struct geometry_bounds {
+    struct vector3 min, max;
+    struct vector3 center;
+    f32 radius;
+};
+
+/**
+ * @brief Measures how well the faces of a geometry reuse the vertices the GPU
+ * already transformed.
+ *
+ */
+struct geometry_cache_stats {
+    /** Average Cache Miss Ratio : transformed vertices per face (0.5 to 3). */
+    f32 acmr;
+    /** Average Transform to Vertex Ratio : transformed vertices per vertex
+        (1 at best). */
+    f32 atvr;
+};
+
+#define GEOMETRY_LODS_MAX (4u)  ///< Most levels of detail of a geometry.
+
+/**
+ * @brief Faces of a geometry drawn at some level of detail, as a range of its
+ * index buffer, and how far (in model space) they stray from the full
+ * geometry.
+ *
+ */
+struct geometry_lod {
+    u32 first_face;
+    u32 faces_nb;
+    f32 error;
+};
+
+#define GEOMETRY_MESHLET_VERTICES_MAX (64u)  ///< Most vertices of a meshlet.
+#define GEOMETRY_MESHLET_FACES_MAX (124u)    ///< Most faces of a meshlet.
+
+/**
+ * @brief Small cluster of neighbouring faces of a geometry, as a range of its
+ * faces, bounded so it can be culled on its own. The faces all face away from
+ * any point p where dot(center - p, cone_axis) is at least
+ * cone_cutoff * length(center - p) + radius.
+ *
+ */
+struct geometry_meshlet {
+    u32 first_face;
+    u32 faces_nb;
+    struct vector3 center;
+    f32 radius;
+    struct vector3 cone_axis;
+    f32 cone_cutoff;
+};
+
 /**
  * @brief Stores a single mesh's data.
  *
@@ -144,21 +273,59 @@ struct face { u32 idx_vert[3u]; };
 struct geometry {
     struct loadable load_state;
 
-    struct { u32 culling:2, smooth:1, layering:2, padding:27; } render_flags;
+    struct {
+        u32 culling:2, smooth:1, layering:2, vertex_format:2, padding:25;
+    } render_flags;
+    struct geometry_bounds bounds;
 
     ARRAY(struct vertex) vertices;
     ARRAY(struct face) faces;
 
+    // coarser faces over the same vertices, sent after the full faces.
+    // lods[0] is the full geometry ; no levels were built if lods_nb is 0.
+    ARRAY(struct face) lod_faces;
+    struct geometry_lod lods[GEOMETRY_LODS_MAX];
+    u32 lods_nb;
+
+    // clusters of the full faces, which are sorted by cluster ; empty if the
+    // geometry was not split.
+    ARRAY(struct geometry_meshlet) meshlets;
+
     struct {
         // TODO: update data behind this vbo when the vertices_array changes (?)
         GLuint vbo;
         // TODO: update data behind this ebo when the face changes (?)
         GLuint ebo;
+
+        // GL_UNSIGNED_SHORT when all vertices can be indexed on 16 bits
+        GLenum index_type;
+        size_t nb_indices;
+
+        // positions sent to the shaders are origin + encoded * extent
+        struct vector3 pos_origin;
+        struct vector3 pos_extent;
     } gpu_side;
 };
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @brief Function run by the pool of worker threads.
+ *
+ */
+typedef void (*worker_task_f)(void *data);
+
+/**
+ * @brief Counts the tasks pushed to the worker threads that are not done yet,
+ * so they can be awaited together. Zero-initialize before use.
+ *
+ */
+struct worker_group {
+    size_t pending;
+};
+
+// -----------------------------------------------------------------------------
+
 /**
  * @brief
  *
@@ -168,6 +335,61 @@ enum texture_flavor {
     TEXTURE_FLAVOR_CUBEMAP,
 };
 
+/**
+ * @brief Tells where the pixels of a texture live once it is sent to the GPU.
+ *
+ */
+enum texture_residency {
+    /** Pixels stay in system memory, ready to be sent again. */
+    TEXTURE_RESIDENCY_KEEP_CPU,
+    /** Pixels are released once sent, and decoded again from the buffer the
+        texture was read from when it is sent again. */
+    TEXTURE_RESIDENCY_GPU_ONLY,
+};
+
+/**
+ * @brief Tells how the pixels of a baked texture are compressed, trading the
+ * time taken to bake it for quality.
+ *
+ */
+enum texture_compression {
+    /** Pixels are kept as they are. */
+    TEXTURE_COMPRESSION_NONE,
+    /** ETC2 blocks, only tried in the ETC1 modes. */
+    TEXTURE_COMPRESSION_FAST,
+    /** ETC2 blocks, also tried in the planar mode. */
+    TEXTURE_COMPRESSION_BALANCED,
+    /** ETC2 blocks, searched around their average colors. */
+    TEXTURE_COMPRESSION_BEST,
+};
+
+/**
+ * @brief Measures the memory taken by all textures.
+ *
+ */
+struct texture_memory_stats {
+    /** Bytes of decoded pixels held in system memory. */
+    u64 cpu_bytes;
+    /** Bytes of texture storage sent to the GPU, mipmaps included. */
+    u64 gpu_bytes;
+    /** Bytes of pixels released from system memory after they were sent. */
+    u64 released_bytes;
+};
+
+/**
+ * @brief Where a texture lies in a texture pool page.
+ *
+ */
+struct texture_pool_placement {
+    struct texture_pool_page *page;
+    u32 layer, x, y;
+    u32 width, height;
+    // the pixels are in the array texture of the page
+    bool uploaded;
+    // the texture is loaded, sampling the array texture of the page
+    bool resident;
+};
+
 /**
  * @brief
  *
@@ -182,13 +404,113 @@ struct texture {
         SDL_Surface *images_for_cubemap[CUBEMAP_FACES_NUMBER];
     } specific;
 
+    // encoded image a 2D texture was read from, decoded again when its
+    // released pixels are needed
+    enum texture_residency residency;
+    struct {
+        const byte *buffer;
+        size_t length;
+    } source;
+    size_t released_bytes;
+
+    // image decoded by the worker threads, replacing the 2D image once
+    // texture_finish_decoding() sees it done, and baked if asked to ; bake
+    // stays set once done only if the baked file was written
+    struct {
+        struct worker_group group;
+        const byte *buffer;
+        size_t length;
+        SDL_Surface *image;
+        bool bake;
+    } decoding;
+
+    // pixels of a 2D texture and their mip levels, baked in the format they
+    // are sent in ; the mapped file is sent instead of the 2D image
+    struct {
+        char *path;
+        u64 source_hash;
+        enum texture_compression compression;
+        const byte *mapped;
+        size_t length;
+    } baked;
+
+    // place of a 2D texture in a page of a texture pool, whose array texture
+    // it samples once loaded
+    struct texture_pool_placement pooled;
+
+    // 2D textures are sampled from a layer of an array texture, in a
+    // rectangle given as an offset and a scale of the texture coordinates
+    struct {
+        GLuint name;
+        size_t bytes;
+        u32 layer;
+        f32 rect[4];
+    } gpu_side;
+};
+
+/** Most layers of the array texture of a texture pool page. */
+#define TEXTURE_POOL_LAYERS_MAX (64u)
+/** Side of the layers of a texture pool page packing small textures. */
+#define TEXTURE_POOL_ATLAS_SIDE (1024u)
+/** Smallest side of a texture packed with others in a layer. */
+#define TEXTURE_POOL_ATLAS_ITEM_MIN (16u)
+/** Largest side of a texture packed with others in a layer. */
+#define TEXTURE_POOL_ATLAS_ITEM_MAX (256u)
+
+/**
+ * @brief Row of a texture pool page layer, filled from left to right with
+ * textures of the same height.
+ *
+ */
+struct texture_pool_shelf {
+    u32 layer;
+    u32 y, height;
+    u32 x;
+};
+
+/**
+ * @brief Array texture shared by textures of the same format, either one
+ * per layer when they are of the same size, or packed in shelves when they
+ * are small enough.
+ *
+ */
+struct texture_pool_page {
+    GLenum internal_format;
+    GLenum format;
+    u32 width, height;
+    u32 levels_nb;
+    bool compressed;
+    bool atlas;
+
+    ARRAY(struct texture *) textures;
+    ARRAY(struct texture_pool_shelf) shelves;
+    u32 layers_nb;
+    // textures were added since the array texture was built
+    bool stale;
+
     struct {
         GLuint name;
+        u32 layers_nb;
+        // textures loaded from the array texture
+        u32 nb_users;
     } gpu_side;
 };
 
+/**
+ * @brief Groups 2D textures in array textures, so the materials using them
+ * bind the same texture objects.
+ *
+ */
+struct texture_pool {
+    ARRAY(struct texture_pool_page *) pages;
+};
+
 // -----------------------------------------------------------------------------
 
+/** Number of base samplers whose placement in their array texture is passed
+    along with the material properties, one per material_base_sampler. */
+#define MATERIAL_PLACED_SAMPLERS_NUMBER (5u)
+
 /**
  * @brief
  *
@@ -201,6 +523,11 @@ struct material_properties {
         f32 shininess;
 
         f32 PADDING[3];
+
+        // offset and scale of the texture coordinates, and layer, of the base
+        // samplers in their array texture
+        f32 sampler_rects[MATERIAL_PLACED_SAMPLERS_NUMBER][4];
+        f32 sampler_layers[8];
 };
 
 /**
@@ -226,6 +553,21 @@ struct instance {
     struct quaternion rotation;
 };
 
+/**
+ * @brief World-space bounding spheres of some instances, as a structure of
+ * arrays so they can be tested several at once.
+ *
+ */
+struct instance_spheres {
+    ARRAY(f32) x;
+    ARRAY(f32) y;
+    ARRAY(f32) z;
+    ARRAY(f32) radius;
+
+    // instances changed since the spheres were computed
+    bool dirty;
+};
+
 /**
  * @brief Stores data about a world model that can be rendered in the world.
  *
@@ -240,9 +582,28 @@ struct model {
     ARRAY(struct instance) instances_array;
     struct handle_buffer_array instances;
 
+    // instances tested against the camera's frustum before each draw
+    bool culling;
+    struct instance_spheres cull_spheres;
+    ARRAY(u32) visible_indices;
+    // level of detail of each visible instance
+    ARRAY(u8) visible_lods;
+    ARRAY(struct instance) visible_array;
+    // first face and number of faces of the meshlets drawn for an instance,
+    // by pairs
+    ARRAY(u32) visible_ranges;
+    // distance from the camera to the nearest instance gathered for the last
+    // draw, ordering the next one ; negative when it was not measured
+    f32 nearest_distance;
+
     // opengl names referencing the model's data on the gpu.
     struct {
         GLuint vao;
+        GLuint instances_source;
+        size_t instances_offset;
+
+        GLuint visible_vbo;
+        size_t visible_capacity;
     } gpu_side;
 };
 
@@ -326,6 +687,29 @@ struct environment {
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @brief Counts the OpenGL state changes requested by 3dful since the last
+ * reset.
+ *
+ */
+struct gl_state_stats {
+    /** Calls forwarded to OpenGL. */
+    u64 issued;
+    /** Calls skipped, as they would not have changed anything. */
+    u64 elided;
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Model queued to be drawn, with the key it is sorted by.
+ *
+ */
+struct scene_draw_item {
+    u64 key;
+    struct model *model;
+};
+
 /**
  * @brief Holds data about a scene. Models, lights, environment, and camera :
  * all that is needed to compose and render a scene of models to an opengl
@@ -336,6 +720,8 @@ struct scene {
     struct loadable load_state;
 
     struct model * *models_array;
+    // rebuilt and sorted each frame, kept around to avoid allocations
+    ARRAY(struct scene_draw_item) draw_queue;
 
     struct camera *camera;
 
@@ -348,6 +734,11 @@ struct scene {
     } light_sources;
 
     struct environment *env;
+
+    // opengl names referencing the scene's data on the gpu.
+    struct {
+        GLuint frame_ubo;
+    } gpu_side;
 };
 
 // -----------------------------------------------------------------------------
@@ -406,6 +797,7 @@ void shader_frag_mem(struct shader *shader, const byte *source,
 
 void shader_uniform_float(struct shader *shader, const char *name,
         float value);
+GLint shader_uniform_location(const struct shader *shader, const char *name);
 
 void shader_link(struct shader *shader);
 void shader_delete(struct shader *shader);
@@ -420,12 +812,23 @@ void geometry_delete(struct geometry *geometry);
 void geometry_wavobj(struct geometry *geometry, const char *path);
 void geometry_wavobj_mem(struct geometry *geometry, const byte *obj_buffer,
         size_t length);
+bool geometry_binary(struct geometry *geometry, const char *path,
+        u64 source_hash);
+bool geometry_binary_write(const struct geometry *geometry, const char *path,
+        u64 source_hash);
 
 void geometry_set_smoothing(struct geometry *geometry, bool smooth);
 void geometry_set_culling(struct geometry *geometry,
         enum geometry_culling cull);
 void geometry_set_layering(struct geometry *geometry,
         enum geometry_layering layering);
+void geometry_set_vertex_format(struct geometry *geometry,
+        enum geometry_vertex_format format);
+void geometry_optimize(struct geometry *geometry,
+        struct geometry_cache_stats *out_before,
+        struct geometry_cache_stats *out_after);
+void geometry_build_lods(struct geometry *geometry, size_t levels_nb);
+void geometry_build_meshlets(struct geometry *geometry);
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 // TEXTURE ---------------------------------------------------------------------
@@ -435,12 +838,26 @@ void texture_2D_file(struct texture *texture, const char *path);
 // TODO : array out !
 void texture_2D_file_mem(struct texture *texture,
         const byte *image_buffer, size_t length);
+void texture_2D_file_mem_async(struct texture *texture,
+        const byte *image_buffer, size_t length, const char *bake_path,
+        u64 source_hash, enum texture_compression compression);
+bool texture_2D_baked(struct texture *texture, const char *path,
+        u64 source_hash, enum texture_compression compression);
+bool texture_finish_decoding(struct texture *texture);
 void texture_cubemap_file(struct texture *texture, enum cubemap_face face,
         const char *path);
 // TODO : array out !
 void texture_cubemap_file_mem(struct texture *texture, enum cubemap_face face,
         const byte *image_buffer, size_t length);
 void texture_delete(struct texture *texture);
+void texture_set_residency(struct texture *texture,
+        enum texture_residency residency);
+struct texture_memory_stats texture_get_memory_stats(void);
+
+void texture_pool_create(struct texture_pool *pool);
+void texture_pool_delete(struct texture_pool *pool);
+bool texture_pool_add(struct texture_pool *pool, struct texture *texture);
+void texture_pool_flush(struct texture_pool *pool);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -482,6 +899,19 @@ void model_instance_rotation(struct model *model, handle_t handle,
         struct quaternion rotation);
 void model_instance_scale(struct model *model, handle_t handle,
         f32 scale[3]);
+void model_instances_streaming(struct model *model, bool streaming);
+void model_culling(struct model *model, bool culling);
+
+void model_instantiate_many(struct model *model, size_t count,
+        handle_t *out_handles);
+void model_instances_remove(struct model *model, const handle_t *handles,
+        size_t count);
+void model_instances_positions(struct model *model, const handle_t *handles,
+        size_t count, const f32 (*positions)[3]);
+void model_instances_rotations(struct model *model, const handle_t *handles,
+        size_t count, const struct quaternion *rotations);
+void model_instances_scales(struct model *model, const handle_t *handles,
+        size_t count, const f32 (*scales)[3]);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -508,6 +938,26 @@ void light_directional_direction(struct light_directional *light,
         struct vector3 direction);
 
 
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// GL STATE --------------------------------------------------------------------
+
+void gl_state_invalidate(void);
+struct gl_state_stats gl_state_get_stats(void);
+void gl_state_reset_stats(void);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// WORKERS ---------------------------------------------------------------------
+
+void workers_start(size_t threads_nb);
+void workers_stop(void);
+size_t workers_count(void);
+
+void workers_push(struct worker_group *group, worker_task_f task, void *data);
+bool workers_done(struct worker_group *group);
+void workers_wait(struct worker_group *group);
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 // ENVIRONMENT -----------------------------------------------------------------
@@ -11,6 +11,8 @@
 
 #include <3dful.h>
 
+#include <stdlib.h>
+
 #include <ustd/array.h>
 
 #include "elements/3dful_core.h"
@@ -19,11 +21,10 @@
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static void scene_lights_bind_uniform_blocks(struct scene *scene,
-        struct shader *shader);
-static void scene_lights_send_uniforms(struct scene *scene,
-        struct shader *shader);
-static void scene_time_send_uniforms(u32 time, struct shader *shader);
+static void scene_bind_uniform_blocks(struct scene *scene);
+static void scene_frame_send_uniforms(struct scene *scene, u32 time);
+static void scene_build_draw_queue(struct scene *scene);
+static i32 scene_draw_item_compare(const void *lhs, const void *rhs);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -40,6 +41,8 @@ void scene_create(struct scene *scene)
 
             .models_array = array_create(make_system_allocator(),
                     sizeof(*(scene->models_array)), 256),
+            .draw_queue = array_create(make_system_allocator(),
+                    sizeof(*(scene->draw_queue)), 256),
 
             .camera = nullptr,
 
@@ -51,18 +54,24 @@ void scene_create(struct scene *scene)
                 .direc_lights_array = array_create(make_system_allocator(),
                         sizeof(*scene->light_sources.direc_lights_array), 8),
                 .direc_lights = { { 0 }, 0 },
-            }
+            },
+
+            .gpu_side = { 0 },
     };
 
     handle_buffer_array_create(&scene->light_sources.point_lights);
     handle_buffer_array_bind(&scene->light_sources.point_lights,
             scene->light_sources.point_lights_array);
     scene->light_sources.point_lights.buffer_usage = GL_UNIFORM_BUFFER;
+    scene->light_sources.point_lights.sync_mode =
+            HANDLE_BUFFER_ARRAY_SYNC_DEFERRED;
 
     handle_buffer_array_create(&scene->light_sources.direc_lights);
     handle_buffer_array_bind(&scene->light_sources.direc_lights,
             scene->light_sources.direc_lights_array);
     scene->light_sources.direc_lights.buffer_usage = GL_UNIFORM_BUFFER;
+    scene->light_sources.direc_lights.sync_mode =
+            HANDLE_BUFFER_ARRAY_SYNC_DEFERRED;
 }
 
 /**
@@ -77,6 +86,8 @@ void scene_delete(struct scene *scene)
 
     array_destroy(make_system_allocator(),
             (void **) &scene->models_array);
+    array_destroy(make_system_allocator(),
+            (void **) &scene->draw_queue);
     array_destroy(make_system_allocator(),
             (void **) &scene->light_sources.point_lights_array);
     array_destroy(make_system_allocator(),
@@ -144,6 +155,9 @@ void scene_environment(struct scene *scene, struct environment *env)
 void scene_light_point(struct scene *scene, handle_t *out_handle)
 {
     handle_buffer_array_push(&scene->light_sources.point_lights, out_handle);
+    // the push may have moved the array
+    scene->light_sources.point_lights_array =
+            scene->light_sources.point_lights.data_array;
 }
 
 /**
@@ -217,6 +231,9 @@ void scene_light_point_remove(struct scene *scene, handle_t handle)
 void scene_light_direc(struct scene *scene, handle_t *out_handle)
 {
     handle_buffer_array_push(&scene->light_sources.direc_lights, out_handle);
+    // the push may have moved the array
+    scene->light_sources.direc_lights_array =
+            scene->light_sources.direc_lights.data_array;
 }
 
 /**
@@ -264,6 +281,8 @@ void scene_light_direc_remove(struct scene *scene, handle_t handle)
  */
 void scene_draw(struct scene *scene, u32 time)
 {
+    struct frustum frustum = { 0 };
+
     if (scene->env) {
         glClearColor(scene->env->bg_color[0], scene->env->bg_color[1],
                 scene->env->bg_color[2], 1.);
@@ -271,26 +290,28 @@ void scene_draw(struct scene *scene, u32 time)
         glClearColor(.1, .1, .1, 1.);
     }
 
+    // the depth buffer is only cleared where writing to it is allowed
+    gl_state_depth_mask(GL_TRUE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    handle_buffer_array_flush(&scene->light_sources.point_lights);
+    handle_buffer_array_flush(&scene->light_sources.direc_lights);
+
+    scene_frame_send_uniforms(scene, time);
+    scene_bind_uniform_blocks(scene);
+
     if (scene->env && scene->env->shader) {
-        camera_send_uniforms(scene->camera, scene->env->shader);
         environment_draw(scene->env);
     }
 
-    for (size_t i = 0 ; i < array_length(scene->models_array) ; i++) {
-        if (scene->env) environment_send_uniforms(scene->env,
-                scene->models_array[i]->shader);
-        if (scene->camera) camera_send_uniforms(scene->camera,
-                scene->models_array[i]->shader);
-
-        scene_lights_bind_uniform_blocks(scene,
-                scene->models_array[i]->shader);
-        scene_lights_send_uniforms(scene, scene->models_array[i]->shader);
-
-        scene_time_send_uniforms(time, scene->models_array[i]->shader);
+    if (scene->camera) {
+        frustum_from_camera(&frustum, scene->camera);
+    }
 
-        model_draw(scene->models_array[i]);
+    scene_build_draw_queue(scene);
+    for (size_t i = 0 ; i < array_length(scene->draw_queue) ; i++) {
+        model_draw(scene->draw_queue[i].model, scene->camera,
+                scene->camera ? &frustum : nullptr);
     }
 }
 
@@ -310,6 +331,13 @@ void scene_load(struct scene *scene)
         // Load lights -- directional lights
         handle_buffer_array_load(&scene->light_sources.direc_lights);
 
+        // Frame-global data, rewritten each frame
+        glGenBuffers(1, &scene->gpu_side.frame_ubo);
+        gl_state_bind_buffer(GL_UNIFORM_BUFFER, scene->gpu_side.frame_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(struct frame_uniforms), NULL,
+                GL_DYNAMIC_DRAW);
+        gl_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+
         scene->load_state.flags |= LOADABLE_FLAG_LOADED;
 
         // load models assigned to the scene
@@ -339,6 +367,10 @@ void scene_unload(struct scene *scene)
         handle_buffer_array_unload(&scene->light_sources.point_lights);
         handle_buffer_array_unload(&scene->light_sources.direc_lights);
 
+        gl_state_forget_buffer(scene->gpu_side.frame_ubo);
+        glDeleteBuffers(1, &scene->gpu_side.frame_ubo);
+        scene->gpu_side.frame_ubo = 0;
+
         for (size_t i = 0 ; i < array_length(scene->models_array) ; i++) {
             model_unload(scene->models_array[i]);
         }
@@ -355,83 +387,87 @@ void scene_unload(struct scene *scene)
 // -----------------------------------------------------------------------------
 
 /**
- * @brief Binds the UBOs containing the lights to the inputs of a shader
- * program.
+ * @brief Binds the UBOs shared by all shaders (frame data and lights) to their
+ * binding points.
  *
  * @param[in] scene
- * @param[in] model
  */
-static void scene_lights_bind_uniform_blocks(struct scene *scene,
-        struct shader *shader)
+static void scene_bind_uniform_blocks(struct scene *scene)
 {
-    GLint block_name = -1;
-
-    glUseProgram(shader->program);
-
-    block_name = glGetUniformBlockIndex(shader->program,
-            "BLOCK_LIGHT_POINTS");
-    glUniformBlockBinding(shader->program, block_name,
-            SHADER_UBO_LIGHT_POINT);
-
-    glBindBuffer(GL_UNIFORM_BUFFER,
+    // the blocks were bound to their binding points when the shaders were
+    // linked
+    gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, SHADER_UBO_FRAME,
+            scene->gpu_side.frame_ubo);
+    gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, SHADER_UBO_LIGHT_POINT,
             scene->light_sources.point_lights.buffer_name);
-    glBindBufferBase(GL_UNIFORM_BUFFER, block_name,
-            scene->light_sources.point_lights.buffer_name);
-
-    block_name = glGetUniformBlockIndex(shader->program,
-            "BLOCK_LIGHT_DIRECTIONALS");
-    glUniformBlockBinding(shader->program, block_name,
-            SHADER_UBO_LIGHT_DIREC);
-
-    glBindBuffer(GL_UNIFORM_BUFFER,
-            scene->light_sources.direc_lights.buffer_name);
-    glBindBufferBase(GL_UNIFORM_BUFFER, block_name,
+    gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, SHADER_UBO_LIGHT_DIREC,
             scene->light_sources.direc_lights.buffer_name);
-
-    glUseProgram(0);
 }
 
 /**
- * @brief Sends the uniforms related to the light collections to the inputs
- * of a shader program.
+ * @brief Gathers the frame-global data (camera, environment, lights, time) and
+ * writes it to the frame UBO, once for all shaders.
  *
  * @param[in] scene
- * @param[in] model
+ * @param[in] time
  */
-static void scene_lights_send_uniforms(struct scene *scene,
-         struct shader *shader)
+static void scene_frame_send_uniforms(struct scene *scene, u32 time)
 {
-    GLint uniform_name = -1;
-
-    glUseProgram(shader->program);
+    struct frame_uniforms frame = { 0 };
 
-    uniform_name = glGetUniformLocation(shader->program, "LIGHT_POINTS_NB");
-    glUniform1ui(uniform_name,
-            array_length(scene->light_sources.point_lights_array));
+    if (scene->camera) {
+        camera_frame_uniforms(scene->camera, &frame);
+    }
+    if (scene->env) {
+        environment_frame_uniforms(scene->env, &frame);
+    }
 
-    uniform_name = glGetUniformLocation(shader->program,
-            "LIGHT_DIRECTIONALS_NB");
-    glUniform1ui(uniform_name,
-            array_length(scene->light_sources.direc_lights_array));
+    frame.time = time;
+    frame.light_points_nb =
+            array_length(scene->light_sources.point_lights_array);
+    frame.light_directionals_nb =
+            array_length(scene->light_sources.direc_lights_array);
 
-    glUseProgram(0);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, scene->gpu_side.frame_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
 }
 
 /**
- * @brief Sends the uniform related to the time to the inputs of a shader
- * program.
+ * @brief Fills the scene's draw queue with its models, sorted by their draw
+ * key so that models sharing OpenGL state are drawn together.
  *
- * @param[in] time
- * @param[in] model
+ * @param[inout] scene
  */
-static void scene_time_send_uniforms(u32 time, struct shader *shader)
+static void scene_build_draw_queue(struct scene *scene)
 {
-    GLint uniform_name = -1;
+    array_clear(scene->draw_queue);
+    array_ensure_capacity(make_system_allocator(),
+            (void **) &scene->draw_queue, array_length(scene->models_array));
 
-    glUseProgram(shader->program);
+    for (size_t i = 0 ; i < array_length(scene->models_array) ; i++) {
+        struct scene_draw_item item = {
+                .key = model_sort_key(scene->models_array[i], scene->camera),
+                .model = scene->models_array[i],
+        };
+        array_push(scene->draw_queue, &item);
+    }
+
+    qsort(scene->draw_queue, array_length(scene->draw_queue),
+            sizeof(*scene->draw_queue), &scene_draw_item_compare);
+}
 
-    uniform_name = glGetUniformLocation(shader->program, "TIME");
-        glUniform1ui(uniform_name, time);
+/**
+ * @brief Orders two draw items by their key.
+ *
+ * @param[in] lhs
+ * @param[in] rhs
+ * @return i32
+ */
+static i32 scene_draw_item_compare(const void *lhs, const void *rhs)
+{
+    u64 key_lhs = ((const struct scene_draw_item *) lhs)->key;
+    u64 key_rhs = ((const struct scene_draw_item *) rhs)->key;
 
-    glUseProgram(0);
+    return (key_lhs > key_rhs) - (key_lhs < key_rhs);
 }
@@ -51,6 +51,15 @@ void handle_buffer_array_push(struct handle_buffer_array *hb_array,
 // Removes an element from the bound array, syncing if needed.
 void handle_buffer_array_remove(struct handle_buffer_array *hb_array,
         handle_t handle);
+// Adds several new elements at the end of the bound array, syncing once.
+void handle_buffer_array_push_many(struct handle_buffer_array *hb_array,
+        size_t count, handle_t *out_handles);
+// Removes several elements from the bound array, syncing once.
+void handle_buffer_array_remove_many(struct handle_buffer_array *hb_array,
+        const handle_t *handles, size_t count, u32 *out_indices);
+// Position of the element referenced by a handle in the bound array.
+size_t handle_buffer_array_index_of(const struct handle_buffer_array *hb_array,
+        handle_t handle);
 // Manually sync an element of the array.
 void handle_buffer_array_sync(struct handle_buffer_array *hb_array,
         handle_t handle, size_t offset, size_t size);
@@ -58,6 +67,21 @@ void handle_buffer_array_sync(struct handle_buffer_array *hb_array,
 void handle_buffer_array_set(struct handle_buffer_array *hb_array,
         handle_t handle, void *value, size_t offset, size_t size);
 
+// Changes how modifications of the array are written to the GPU.
+void handle_buffer_array_sync_mode(struct handle_buffer_array *hb_array,
+        enum handle_buffer_array_sync mode);
+// Sets the same part of several elements of the bound array, syncing once.
+void handle_buffer_array_set_many(struct handle_buffer_array *hb_array,
+        const handle_t *handles, size_t count, const void *values,
+        size_t values_stride, size_t offset, size_t size);
+
+// Writes the changes marked in deferred or streaming mode to the GPU.
+void handle_buffer_array_flush(struct handle_buffer_array *hb_array);
+// Marks the region of the buffer last flushed as in use by the GPU.
+void handle_buffer_array_fence(struct handle_buffer_array *hb_array);
+// Byte offset of the up-to-date data in the buffer object.
+size_t handle_buffer_array_offset(const struct handle_buffer_array *hb_array);
+
 // Query the array to be loaded, if not, to the GPU.
 void handle_buffer_array_load(struct handle_buffer_array *hb_array);
 // Mark the array as no longer needing to be loaded to the GPU.
@@ -11,6 +11,9 @@
  */
 
 #include "3dful_dynamic_data.h"
+#include "../gl_state/3dful_gl_state.h"
+
+#include <stdlib.h>
 
 #include <ustd_impl/array_impl.h>
 
@@ -23,10 +26,33 @@ static void handle_buffer_array_sync_capacity(
 static void handle_buffer_array_sync_element(
         struct handle_buffer_array *hb_array, size_t index,
         size_t offset, size_t size);
+static void handle_buffer_array_mark_dirty(
+        struct handle_buffer_array *hb_array, size_t start, size_t end);
+static void handle_buffer_array_flush_stream(
+        struct handle_buffer_array *hb_array);
+static void handle_buffer_array_release_fences(
+        struct handle_buffer_array *hb_array);
+static enum handle_buffer_array_sync handle_buffer_array_batch_begin(
+        struct handle_buffer_array *hb_array);
+static void handle_buffer_array_batch_end(
+        struct handle_buffer_array *hb_array,
+        enum handle_buffer_array_sync mode);
+static i32 byte_range_compare(const void *lhs, const void *rhs);
 
-static size_t handle_buffer_array_index_of(
-            struct handle_buffer_array *hb_array, handle_t handle);
-static i32 handle_compare(const void *lhs, const void *rhs);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Value in handle_buffer_array::indices for handles without an element. */
+#define HANDLE_BUFFER_ARRAY_NO_INDEX (UINT32_MAX)
+
+/// Number of elements the bound array and buffer object can hold at least,
+/// once they need to grow.
+#define HANDLE_BUFFER_ARRAY_MIN_CAPACITY (16u)
+
+/// Nanoseconds to wait at most for the GPU to release a region of a streaming
+/// array before orphaning the whole storage instead.
+#define HANDLE_BUFFER_ARRAY_FENCE_TIMEOUT (1000000000ull)
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -35,7 +61,8 @@ static i32 handle_compare(const void *lhs, const void *rhs);
 /**
  * @brief Allocates memory for a handles/data map.
  * The object produced is not yet usable. It still needs a bound array and
- * an OpenGL usage.
+ * an OpenGL usage. Changes are synchronized immediately unless the
+ * sync_mode field is changed.
  *
  * @param[out] hb_array (overwritten) target array map.
  */
@@ -48,9 +75,22 @@ void handle_buffer_array_create(struct handle_buffer_array *hb_array)
             .data_array = nullptr,
             .handles = array_create(make_system_allocator(),
                     sizeof(*hb_array->handles), 32),
+            .indices = array_create(make_system_allocator(),
+                    sizeof(*hb_array->indices), 32),
             .buffer_name = 0,
             .buffer_usage = GL_NONE,
+            .buffer_capacity = 0,
+
+            .sync_mode = HANDLE_BUFFER_ARRAY_SYNC_IMMEDIATE,
+            .dirty_ranges = array_create(make_system_allocator(),
+                    sizeof(*hb_array->dirty_ranges), 32),
+
+            .stream = { 0 },
     };
+
+    // handle 0 is never given out, its slot is only there to keep
+    // handles and positions in the indices array aligned
+    array_push(hb_array->indices, &(u32) { HANDLE_BUFFER_ARRAY_NO_INDEX });
 }
 
 /**
@@ -64,6 +104,9 @@ void handle_buffer_array_create(struct handle_buffer_array *hb_array)
 void handle_buffer_array_delete(struct handle_buffer_array *hb_array)
 {
     array_destroy(make_system_allocator(), (ARRAY_ANY *) &hb_array->handles);
+    array_destroy(make_system_allocator(), (ARRAY_ANY *) &hb_array->indices);
+    array_destroy(make_system_allocator(),
+            (ARRAY_ANY *) &hb_array->dirty_ranges);
     *hb_array = (struct handle_buffer_array) { 0 };
 }
 
@@ -108,18 +151,93 @@ void handle_buffer_array_push(struct handle_buffer_array *hb_array,
     *out_handle = hb_array->id_counter;
     hb_array->id_counter += 1;
 
+    // handles are given out in sequence : the new handle's slot is the next
+    // one in the indices array
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &hb_array->indices, 1);
+    array_push(hb_array->indices,
+            &(u32) { (u32) array_length(hb_array->handles) });
+
     array_ensure_capacity(make_system_allocator(),
             (ARRAY_ANY *) &hb_array->handles, 1);
     array_push(hb_array->handles, out_handle);
 
-    array_ensure_capacity(make_system_allocator(),
-            (ARRAY_ANY *) &hb_array->data_array, 1);
+    // the bound array doubles in size, so pushes are amortized
+    if (target->length == target->capacity) {
+        array_ensure_capacity(make_system_allocator(),
+                (ARRAY_ANY *) &hb_array->data_array,
+                (target->capacity > HANDLE_BUFFER_ARRAY_MIN_CAPACITY) ?
+                        target->capacity : HANDLE_BUFFER_ARRAY_MIN_CAPACITY);
+        target = array_impl_of(hb_array->data_array);
+    }
     // no need to push something just accept garbage at the end
     target->length += 1;
 
     handle_buffer_array_sync_capacity(hb_array);
 }
 
+/**
+ * @brief Adds several new empty elements at the end of the bound array, and
+ * assigns an handle to each of them. Memory is reserved once for all elements,
+ * and the buffer object grows at most once.
+ * If the handles run out, the remaining handles are set to 0 and no element is
+ * added for them.
+ *
+ * @param[inout] hb_array Target array.
+ * @param[in] count Number of elements to add.
+ * @param[out] out_handles (needed) Array of at least count handles.
+ */
+void handle_buffer_array_push_many(struct handle_buffer_array *hb_array,
+        size_t count, handle_t *out_handles)
+{
+    struct array_impl *target = array_impl_of(hb_array->data_array);
+    size_t nb_pushed = 0;
+    size_t missing = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &hb_array->indices, count);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &hb_array->handles, count);
+
+    // same geometric growth as single pushes
+    if (target->length + count > target->capacity) {
+        missing = (target->capacity > HANDLE_BUFFER_ARRAY_MIN_CAPACITY) ?
+                target->capacity : HANDLE_BUFFER_ARRAY_MIN_CAPACITY;
+        while (target->capacity + missing < target->length + count) {
+            missing *= 2;
+        }
+        array_ensure_capacity(make_system_allocator(),
+                (ARRAY_ANY *) &hb_array->data_array, missing);
+        target = array_impl_of(hb_array->data_array);
+    }
+
+    for (nb_pushed = 0 ; nb_pushed < count ; nb_pushed++) {
+        if (hb_array->id_counter == HANDLE_MAX) {
+            break;
+        }
+
+        out_handles[nb_pushed] = hb_array->id_counter;
+        hb_array->id_counter += 1;
+
+        array_push(hb_array->indices,
+                &(u32) { (u32) array_length(hb_array->handles) });
+        array_push(hb_array->handles, &out_handles[nb_pushed]);
+    }
+
+    for (size_t i = nb_pushed ; i < count ; i++) {
+        out_handles[i] = 0;
+    }
+
+    // garbage at the end, as for single pushes
+    target->length += nb_pushed;
+
+    handle_buffer_array_sync_capacity(hb_array);
+}
+
 /**
  * @brief Removes an element previously added to the array.
  * The removal procedure is not stable. The order of elements is not guaranteed
@@ -132,6 +250,7 @@ void handle_buffer_array_remove(struct handle_buffer_array *hb_array,
         handle_t handle)
 {
     size_t idx = handle_buffer_array_index_of(hb_array, handle);
+    handle_t moved_handle = 0;
 
     struct array_impl *target = array_impl_of(hb_array->data_array);
 
@@ -139,12 +258,76 @@ void handle_buffer_array_remove(struct handle_buffer_array *hb_array,
         return;
     }
 
+    // the last element is moved into the freed spot
+    moved_handle = hb_array->handles[array_length(hb_array->handles) - 1];
+
     array_remove_swapback(hb_array->handles, idx);
     array_remove_swapback(hb_array->data_array, idx);
 
+    // order matters when the removed element was the last one
+    hb_array->indices[moved_handle] = (u32) idx;
+    hb_array->indices[handle] = HANDLE_BUFFER_ARRAY_NO_INDEX;
+
     handle_buffer_array_sync_element(hb_array, idx, 0, target->stride);
 }
 
+/**
+ * @brief Removes several elements previously added to the array. The changes
+ * are synchronized once for the whole batch. Each removal moves the last
+ * element into the freed spot : arrays kept parallel to the bound one can
+ * replay the same moves from the removed positions.
+ *
+ * @param[inout] hb_array Target array.
+ * @param[in] handles Handles to the removed elements.
+ * @param[in] count Number of handles.
+ * @param[out] out_indices Null, or an array of at least count indices, filled
+ * with the position each element was removed from, in order. Unknown handles
+ * get the length the array had when they were reached.
+ */
+void handle_buffer_array_remove_many(struct handle_buffer_array *hb_array,
+        const handle_t *handles, size_t count, u32 *out_indices)
+{
+    enum handle_buffer_array_sync mode = handle_buffer_array_batch_begin(
+            hb_array);
+
+    for (size_t i = 0 ; i < count ; i++) {
+        if (out_indices) {
+            out_indices[i] = (u32) handle_buffer_array_index_of(hb_array,
+                    handles[i]);
+        }
+        handle_buffer_array_remove(hb_array, handles[i]);
+    }
+
+    handle_buffer_array_batch_end(hb_array, mode);
+}
+
+/**
+ * @brief Finds the position of the element referenced by a handle in the bound
+ * array, in constant time. Returns the length of the array if the handle does
+ * not reference any element.
+ *
+ * @param[in] hb_array Target array.
+ * @param[in] handle Handle to the element.
+ * @return size_t
+ */
+size_t handle_buffer_array_index_of(
+        const struct handle_buffer_array *hb_array, handle_t handle)
+{
+    u32 idx = HANDLE_BUFFER_ARRAY_NO_INDEX;
+
+    if (handle >= array_length(hb_array->indices)) {
+        return array_length(hb_array->handles);
+    }
+
+    idx = hb_array->indices[handle];
+
+    if (idx == HANDLE_BUFFER_ARRAY_NO_INDEX) {
+        return array_length(hb_array->handles);
+    }
+
+    return idx;
+}
+
 /**
  * @brief Manually synchronize part (or the entirety) of an element. This means
  * that if the array is marked as loaded, the data corresponding to the handle
@@ -195,6 +378,180 @@ void handle_buffer_array_set(struct handle_buffer_array *hb_array,
     handle_buffer_array_sync_element(hb_array, idx, offset, size);
 }
 
+/**
+ * @brief Sets the same part of several elements of the bound array, from
+ * values read with some stride in memory. The changes are synchronized once
+ * for the whole batch.
+ * Unknown handles are skipped.
+ *
+ * @param[inout] hb_array Target array.
+ * @param[in] handles Handles to the modified elements.
+ * @param[in] count Number of handles.
+ * @param[in] values First value, written to the first handle's element.
+ * @param[in] values_stride Bytes between two values in memory.
+ * @param[in] offset Offset of the modified part in an element.
+ * @param[in] size Size of the modified part.
+ */
+void handle_buffer_array_set_many(struct handle_buffer_array *hb_array,
+        const handle_t *handles, size_t count, const void *values,
+        size_t values_stride, size_t offset, size_t size)
+{
+    struct array_impl *target = array_impl_of(hb_array->data_array);
+    enum handle_buffer_array_sync mode = HANDLE_BUFFER_ARRAY_SYNC_IMMEDIATE;
+    size_t idx = 0;
+
+    if ((offset + size) > target->stride) {
+        return;
+    }
+
+    mode = handle_buffer_array_batch_begin(hb_array);
+
+    for (size_t i = 0 ; i < count ; i++) {
+        idx = handle_buffer_array_index_of(hb_array, handles[i]);
+        if (idx >= array_length(hb_array->handles)) {
+            continue;
+        }
+
+        bytewise_copy((byte *) hb_array->data_array
+                        + (idx * target->stride) + offset,
+                (const byte *) values + (i * values_stride), size);
+        handle_buffer_array_sync_element(hb_array, idx, offset, size);
+    }
+
+    handle_buffer_array_batch_end(hb_array, mode);
+}
+
+/**
+ * @brief Changes the way modifications to the array reach the buffer object.
+ * If the array is loaded, its buffer object is laid out again for the new
+ * mode.
+ *
+ * @param[inout] hb_array Target array.
+ * @param[in] mode New synchronisation mode.
+ */
+void handle_buffer_array_sync_mode(struct handle_buffer_array *hb_array,
+        enum handle_buffer_array_sync mode)
+{
+    if (hb_array->sync_mode == mode) {
+        return;
+    }
+
+    handle_buffer_array_release_fences(hb_array);
+    hb_array->sync_mode = mode;
+    hb_array->stream.region_size = 0;
+    hb_array->stream.current = 0;
+
+    handle_buffer_array_reload(hb_array);
+}
+
+/**
+ * @brief Writes all byte ranges marked as dirty since the last flush to the
+ * buffer object. Overlapping and adjacent ranges are merged beforehand, so
+ * the number of uploads is kept as low as possible.
+ * In streaming mode, the whole array is written to the next region of the
+ * buffer object instead, if anything changed.
+ * Does nothing for arrays in immediate mode, as they have no pending change.
+ *
+ * @param[inout] hb_array Target array.
+ */
+void handle_buffer_array_flush(struct handle_buffer_array *hb_array)
+{
+    struct array_impl *target = nullptr;
+    size_t live_end = 0;
+    size_t nb_merged = 0;
+    struct byte_range *ranges = hb_array->dirty_ranges;
+
+    if (hb_array->sync_mode == HANDLE_BUFFER_ARRAY_SYNC_STREAMING) {
+        handle_buffer_array_flush_stream(hb_array);
+        return;
+    }
+
+    if (array_length(ranges) == 0) {
+        return;
+    }
+
+    if (!(hb_array->load_state.flags & LOADABLE_FLAG_LOADED)) {
+        array_clear(hb_array->dirty_ranges);
+        return;
+    }
+
+    target = array_impl_of(hb_array->data_array);
+    live_end = target->length * target->stride;
+
+    qsort(ranges, array_length(ranges), sizeof(*ranges), &byte_range_compare);
+
+    // merge in place : ranges[0 .. nb_merged] holds the merged ranges
+    for (size_t i = 1 ; i < array_length(ranges) ; i++) {
+        if (ranges[i].start <= ranges[nb_merged].end) {
+            if (ranges[i].end > ranges[nb_merged].end) {
+                ranges[nb_merged].end = ranges[i].end;
+            }
+        } else {
+            nb_merged += 1;
+            ranges[nb_merged] = ranges[i];
+        }
+    }
+    nb_merged += 1;
+
+    gl_state_bind_buffer(hb_array->buffer_usage, hb_array->buffer_name);
+    for (size_t i = 0 ; i < nb_merged ; i++) {
+        // elements might have been removed after being marked
+        if (ranges[i].end > live_end) {
+            ranges[i].end = live_end;
+        }
+        if (ranges[i].start >= ranges[i].end) {
+            continue;
+        }
+
+        glBufferSubData(hb_array->buffer_usage, ranges[i].start,
+                ranges[i].end - ranges[i].start,
+                (byte *) hb_array->data_array + ranges[i].start);
+    }
+    gl_state_bind_buffer(hb_array->buffer_usage, 0);
+
+    array_clear(hb_array->dirty_ranges);
+}
+
+/**
+ * @brief Marks the region of a streaming array last written to as being read
+ * by the GPU, for all commands issued until now. The region will not be
+ * written to again before those commands are complete.
+ * Call this after the draw calls reading the array.
+ *
+ * @param[inout] hb_array Target array.
+ */
+void handle_buffer_array_fence(struct handle_buffer_array *hb_array)
+{
+    GLsync *fence = nullptr;
+
+    if ((hb_array->sync_mode != HANDLE_BUFFER_ARRAY_SYNC_STREAMING)
+            || !(hb_array->load_state.flags & LOADABLE_FLAG_LOADED)) {
+        return;
+    }
+
+    fence = &hb_array->stream.fences[hb_array->stream.current];
+    if (*fence) {
+        glDeleteSync(*fence);
+    }
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * @brief Returns where, in bytes, the up-to-date data starts in the buffer
+ * object. This is always 0, except for streaming arrays.
+ *
+ * @param[in] hb_array Target array.
+ * @return size_t
+ */
+size_t handle_buffer_array_offset(const struct handle_buffer_array *hb_array)
+{
+    if (hb_array->sync_mode != HANDLE_BUFFER_ARRAY_SYNC_STREAMING) {
+        return 0;
+    }
+
+    return hb_array->stream.current * hb_array->stream.region_size;
+}
+
 /**
  * @brief Query the array to be loaded. If it already was, the new user is
  * counted. If it wasn't, the contents of the bound array will be written to
@@ -209,14 +566,18 @@ void handle_buffer_array_load(struct handle_buffer_array *hb_array)
     loadable_add_user((struct loadable *) hb_array);
     if (loadable_needs_loading((struct loadable *) hb_array)) {
 
+        hb_array->buffer_capacity = target->capacity * target->stride;
+
         glGenBuffers(1, &hb_array->buffer_name);
-        glBindBuffer(hb_array->buffer_usage, hb_array->buffer_name);
+        gl_state_bind_buffer(hb_array->buffer_usage, hb_array->buffer_name);
         {
-            glBufferData(hb_array->buffer_usage,
-                    array_capacity(hb_array->data_array) * target->stride,
+            glBufferData(hb_array->buffer_usage, hb_array->buffer_capacity,
                     hb_array->data_array, GL_DYNAMIC_DRAW);
         }
-        glBindBuffer(hb_array->buffer_usage, 0);
+        gl_state_bind_buffer(hb_array->buffer_usage, 0);
+
+        // the ring is laid out on the first flush
+        hb_array->stream.changed = true;
 
         hb_array->load_state.flags |= LOADABLE_FLAG_LOADED;
     }
@@ -233,8 +594,14 @@ void handle_buffer_array_unload(struct handle_buffer_array *hb_array)
     loadable_remove_user((struct loadable *) hb_array);
     if (loadable_needs_unloading((struct loadable *) hb_array)) {
 
+        handle_buffer_array_release_fences(hb_array);
+
+        gl_state_forget_buffer(hb_array->buffer_name);
         glDeleteBuffers(1, &hb_array->buffer_name);
         hb_array->buffer_name = 0;
+        hb_array->buffer_capacity = 0;
+        hb_array->stream.region_size = 0;
+        hb_array->stream.current = 0;
 
         hb_array->load_state.flags &= ~LOADABLE_FLAG_LOADED;
     }
@@ -244,33 +611,59 @@ void handle_buffer_array_unload(struct handle_buffer_array *hb_array)
 // -----------------------------------------------------------------------------
 
 /**
- * @brief Synchronizes the buffer object capacity with the data array capacity.
+ * @brief Makes sure the buffer object can hold all elements of the data array.
+ * When it cannot, its storage is doubled until it does, and only the live
+ * elements are written back into it. The buffer object keeps its name, so
+ * vertex arrays pointing to it stay valid.
  *
  * @param[inout] hb_array
  */
 static void handle_buffer_array_sync_capacity(
         struct handle_buffer_array *hb_array)
 {
-    GLint buffer_size = 0;
+    struct array_impl *target = array_impl_of(hb_array->data_array);
+    size_t needed_capacity = target->length * target->stride;
+    size_t new_capacity = hb_array->buffer_capacity;
 
     if (!(hb_array->load_state.flags & LOADABLE_FLAG_LOADED)) {
         return;
     }
 
-    glBindBuffer(hb_array->buffer_usage, hb_array->buffer_name);
-    {
-        glGetBufferParameteriv(hb_array->buffer_usage, GL_BUFFER_SIZE,
-                &buffer_size);
+    // the ring grows by itself on flush
+    if (hb_array->sync_mode == HANDLE_BUFFER_ARRAY_SYNC_STREAMING) {
+        hb_array->stream.changed = true;
+        return;
     }
-    glBindBuffer(hb_array->buffer_usage, 0);
 
-    if (buffer_size != (GLint) array_capacity(hb_array->data_array)) {
-        handle_buffer_array_reload(hb_array);
+    if (needed_capacity <= hb_array->buffer_capacity) {
+        return;
+    }
+
+    if (new_capacity < HANDLE_BUFFER_ARRAY_MIN_CAPACITY * target->stride) {
+        new_capacity = HANDLE_BUFFER_ARRAY_MIN_CAPACITY * target->stride;
+    }
+    while (new_capacity < needed_capacity) {
+        new_capacity *= 2;
     }
+
+    gl_state_bind_buffer(hb_array->buffer_usage, hb_array->buffer_name);
+    {
+        glBufferData(hb_array->buffer_usage, new_capacity, NULL,
+                GL_DYNAMIC_DRAW);
+        glBufferSubData(hb_array->buffer_usage, 0, needed_capacity,
+                hb_array->data_array);
+    }
+    gl_state_bind_buffer(hb_array->buffer_usage, 0);
+
+    hb_array->buffer_capacity = new_capacity;
+
+    // the live range was just written
+    array_clear(hb_array->dirty_ranges);
 }
 
 /**
  * @brief Reloads ONE data element in the data array into the buffer object.
+ * In deferred mode, the element is only marked as needing to be reloaded.
  *
  * @param[inout] hb_array
  */
@@ -284,14 +677,26 @@ static void handle_buffer_array_sync_element(
         return;
     }
 
-    glBindBuffer(hb_array->buffer_usage, hb_array->buffer_name);
+    if (hb_array->sync_mode == HANDLE_BUFFER_ARRAY_SYNC_STREAMING) {
+        hb_array->stream.changed = true;
+        return;
+    }
+
+    if (hb_array->sync_mode == HANDLE_BUFFER_ARRAY_SYNC_DEFERRED) {
+        handle_buffer_array_mark_dirty(hb_array,
+                (index * target->stride) + offset,
+                (index * target->stride) + offset + size);
+        return;
+    }
+
+    gl_state_bind_buffer(hb_array->buffer_usage, hb_array->buffer_name);
     {
         glBufferSubData(hb_array->buffer_usage,
                 (index * target->stride) + offset, size,
                 (byte *) hb_array->data_array + (index * target->stride)
                 + offset);
     }
-    glBindBuffer(hb_array->buffer_usage, 0);
+    gl_state_bind_buffer(hb_array->buffer_usage, 0);
 }
 
 /**
@@ -307,46 +712,219 @@ static void handle_buffer_array_reload(struct handle_buffer_array *hb_array)
         return;
     }
 
-    glBindBuffer(hb_array->buffer_usage, hb_array->buffer_name);
+    if (hb_array->sync_mode == HANDLE_BUFFER_ARRAY_SYNC_STREAMING) {
+        // the ring is laid out again on the next flush
+        hb_array->stream.region_size = 0;
+        hb_array->stream.changed = true;
+        return;
+    }
+
+    hb_array->buffer_capacity = target->capacity * target->stride;
+
+    gl_state_bind_buffer(hb_array->buffer_usage, hb_array->buffer_name);
     {
-        glBufferData(hb_array->buffer_usage,
-                target->capacity * target->stride,
+        glBufferData(hb_array->buffer_usage, hb_array->buffer_capacity,
                 hb_array->data_array, GL_DYNAMIC_DRAW);
     }
-    glBindBuffer(hb_array->buffer_usage, 0);
+    gl_state_bind_buffer(hb_array->buffer_usage, 0);
+
+    // everything was just written
+    array_clear(hb_array->dirty_ranges);
 }
 
 /**
- * @brief
+ * @brief Writes the whole data array to the next region of the ring held by
+ * the buffer object, if it changed since the last flush. The region is only
+ * written once the GPU is done reading it, so the region in use is never
+ * waited on. If the regions are too small, or the GPU takes too long to
+ * release the next one, the whole buffer object is specified again, orphaning
+ * the storage the GPU still reads.
  *
- * @param model
- * @param handle
- * @return size_t
+ * @param[inout] hb_array
+ */
+static void handle_buffer_array_flush_stream(
+        struct handle_buffer_array *hb_array)
+{
+    struct array_impl *target = nullptr;
+    size_t live_size = 0;
+    size_t new_region_size = 0;
+    u32 next = 0;
+    void *mapped = nullptr;
+    bool orphan = false;
+    GLenum waited = GL_ALREADY_SIGNALED;
+
+    if (!(hb_array->load_state.flags & LOADABLE_FLAG_LOADED)
+            || !hb_array->stream.changed) {
+        return;
+    }
+
+    target = array_impl_of(hb_array->data_array);
+    live_size = target->length * target->stride;
+
+    gl_state_bind_buffer(hb_array->buffer_usage, hb_array->buffer_name);
+
+    orphan = (live_size > hb_array->stream.region_size)
+            || (hb_array->stream.region_size == 0);
+
+    if (!orphan) {
+        next = (hb_array->stream.current + 1) % HANDLE_BUFFER_ARRAY_RING_SIZE;
+
+        if (hb_array->stream.fences[next]) {
+            waited = glClientWaitSync(hb_array->stream.fences[next],
+                    GL_SYNC_FLUSH_COMMANDS_BIT,
+                    HANDLE_BUFFER_ARRAY_FENCE_TIMEOUT);
+            glDeleteSync(hb_array->stream.fences[next]);
+            hb_array->stream.fences[next] = nullptr;
+        }
+
+        // the region may still be read : it is left to the GPU with the
+        // rest of the storage
+        orphan = (waited == GL_TIMEOUT_EXPIRED) || (waited == GL_WAIT_FAILED);
+    }
+
+    if (orphan) {
+        // the previous storage is orphaned, its fences do not matter anymore
+        handle_buffer_array_release_fences(hb_array);
+
+        new_region_size = hb_array->stream.region_size;
+        if (new_region_size
+                < (HANDLE_BUFFER_ARRAY_MIN_CAPACITY * target->stride)) {
+            new_region_size = HANDLE_BUFFER_ARRAY_MIN_CAPACITY * target->stride;
+        }
+        while (new_region_size < live_size) {
+            new_region_size *= 2;
+        }
+
+        hb_array->stream.region_size = new_region_size;
+        hb_array->buffer_capacity =
+                new_region_size * HANDLE_BUFFER_ARRAY_RING_SIZE;
+        glBufferData(hb_array->buffer_usage, hb_array->buffer_capacity, NULL,
+                GL_STREAM_DRAW);
+        next = 0;
+    }
+
+    hb_array->stream.current = next;
+
+    if (live_size > 0) {
+        mapped = glMapBufferRange(hb_array->buffer_usage,
+                next * hb_array->stream.region_size, live_size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+                | GL_MAP_UNSYNCHRONIZED_BIT);
+
+        if (mapped) {
+            bytewise_copy(mapped, hb_array->data_array, live_size);
+            glUnmapBuffer(hb_array->buffer_usage);
+        } else {
+            glBufferSubData(hb_array->buffer_usage,
+                    next * hb_array->stream.region_size, live_size,
+                    hb_array->data_array);
+        }
+    }
+
+    gl_state_bind_buffer(hb_array->buffer_usage, 0);
+
+    hb_array->stream.changed = false;
+    array_clear(hb_array->dirty_ranges);
+}
+
+/**
+ * @brief Deletes all fences of the streaming ring.
+ *
+ * @param[inout] hb_array
  */
-static size_t handle_buffer_array_index_of(
-        struct handle_buffer_array *hb_array, handle_t handle)
+static void handle_buffer_array_release_fences(
+        struct handle_buffer_array *hb_array)
 {
-    size_t pos = 0;
+    for (size_t i = 0 ; i < HANDLE_BUFFER_ARRAY_RING_SIZE ; i++) {
+        if (hb_array->stream.fences[i]) {
+            glDeleteSync(hb_array->stream.fences[i]);
+            hb_array->stream.fences[i] = nullptr;
+        }
+    }
+}
 
-    if (array_find(hb_array->handles, &handle_compare, &handle, &pos)) {
-        return pos;
+/**
+ * @brief Records a span of bytes of the data array as needing to be written to
+ * the buffer object on the next flush. The span is merged with the last
+ * recorded one when they touch, which catches consecutive writes to the
+ * fields of a same element without growing the list.
+ *
+ * @param[inout] hb_array
+ * @param[in] start First dirty byte.
+ * @param[in] end Byte after the last dirty byte.
+ */
+static void handle_buffer_array_mark_dirty(
+        struct handle_buffer_array *hb_array, size_t start, size_t end)
+{
+    struct byte_range *last = nullptr;
+    size_t nb_ranges = array_length(hb_array->dirty_ranges);
+
+    if (nb_ranges > 0) {
+        last = &hb_array->dirty_ranges[nb_ranges - 1];
+
+        if ((start <= last->end) && (end >= last->start)) {
+            if (start < last->start) last->start = start;
+            if (end > last->end) last->end = end;
+            return;
+        }
     }
 
-    return array_length(hb_array->handles);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &hb_array->dirty_ranges, 1);
+    array_push(hb_array->dirty_ranges,
+            &(struct byte_range) { .start = start, .end = end });
 }
 
 /**
- * @brief Compares two handles by value.
+ * @brief Compares two byte ranges by their starting byte.
  * Returns -1, 0 or 1 if lesser, equal, or greater respectivelly.
  *
  * @param[in] lhs
  * @param[in] rhs
  * @return i32
  */
-static i32 handle_compare(const void *lhs, const void *rhs)
+static i32 byte_range_compare(const void *lhs, const void *rhs)
 {
-    handle_t handle_lhs = *(handle_t *) lhs;
-    handle_t handle_rhs = *(handle_t *) rhs;
+    size_t start_lhs = ((const struct byte_range *) lhs)->start;
+    size_t start_rhs = ((const struct byte_range *) rhs)->start;
+
+    return (start_lhs > start_rhs) - (start_lhs < start_rhs);
+}
 
-    return (handle_lhs > handle_rhs) - (handle_lhs < handle_rhs);
+/**
+ * @brief Starts a batch of modifications : an array in immediate mode will
+ * collect its changes like a deferred one until the batch ends.
+ *
+ * @param[inout] hb_array
+ * @return enum handle_buffer_array_sync The mode to restore at the end of the
+ * batch.
+ */
+static enum handle_buffer_array_sync handle_buffer_array_batch_begin(
+        struct handle_buffer_array *hb_array)
+{
+    enum handle_buffer_array_sync mode = hb_array->sync_mode;
+
+    if (mode == HANDLE_BUFFER_ARRAY_SYNC_IMMEDIATE) {
+        hb_array->sync_mode = HANDLE_BUFFER_ARRAY_SYNC_DEFERRED;
+    }
+
+    return mode;
+}
+
+/**
+ * @brief Ends a batch of modifications, writing them right away to the GPU if
+ * the array was in immediate mode.
+ *
+ * @param[inout] hb_array
+ * @param[in] mode Value returned by handle_buffer_array_batch_begin().
+ */
+static void handle_buffer_array_batch_end(
+        struct handle_buffer_array *hb_array,
+        enum handle_buffer_array_sync mode)
+{
+    hb_array->sync_mode = mode;
+
+    if (mode == HANDLE_BUFFER_ARRAY_SYNC_IMMEDIATE) {
+        handle_buffer_array_flush(hb_array);
+    }
 }
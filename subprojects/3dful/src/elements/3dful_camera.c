@@ -83,32 +83,20 @@ void camera_aspect(struct camera *camera, f32 aspect)
 }
 
 /**
- * @brief Sends a camera's matrices to a shader.
- * The expected uniforms are :
- * - mat4 VIEW_MATRIX ;
- * - mat4 PROJECTION_MATRIX ;
- * - vec3 CAMERA_POS.
+ * @brief Writes a camera's matrices and position to the frame-global data sent
+ * to the shaders.
  *
  * @param[in] camera Source camera.
- * @param[in] shader Shader supporting the uniforms.
+ * @param[inout] frame Frame data.
  */
-void camera_send_uniforms(struct camera *camera, struct shader *shader)
+void camera_frame_uniforms(const struct camera *camera,
+        struct frame_uniforms *frame)
 {
-    GLint uniform_name = -1;
+    bytewise_copy(frame->view, &camera->view, sizeof(frame->view));
+    bytewise_copy(frame->projection, &camera->projection,
+            sizeof(frame->projection));
 
-    glUseProgram(shader->program);
-    uniform_name = glGetUniformLocation(shader->program,
-            "VIEW_MATRIX");
-    glUniformMatrix4fv(uniform_name, 1, GL_FALSE,
-            (const GLfloat *) &camera->view);
-
-    uniform_name = glGetUniformLocation(shader->program,
-            "PROJECTION_MATRIX");
-    glUniformMatrix4fv(uniform_name, 1, GL_FALSE,
-            (const GLfloat *) &camera->projection);
-
-    uniform_name = glGetUniformLocation(shader->program,
-            "CAMERA_POS");
-    glUniform3f(uniform_name, camera->pos.x, camera->pos.y, camera->pos.z);
-    glUseProgram(0);
+    frame->camera_pos[0] = camera->pos.x;
+    frame->camera_pos[1] = camera->pos.y;
+    frame->camera_pos[2] = camera->pos.z;
 }
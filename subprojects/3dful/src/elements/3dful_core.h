@@ -23,6 +23,7 @@
 #include <3dful.h>
 #include "../inout/file_operations.h"
 #include "../dynamic_data/3dful_dynamic_data.h"
+#include "../gl_state/3dful_gl_state.h"
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -37,6 +38,30 @@ enum shader_ubo_binding {
     SHADER_UBO_MATERIAL,
     SHADER_UBO_LIGHT_DIREC,
     SHADER_UBO_LIGHT_POINT,
+    SHADER_UBO_FRAME,
+
+    SHADER_UBOS_NUMBER,
+};
+
+/**
+ * @brief Frame-global data sent once per frame to all shaders. Mirrors the
+ * std140 layout of BLOCK_FRAME found in the shader wrappers.
+ */
+struct frame_uniforms {
+    f32 view[16];
+    f32 projection[16];
+
+    f32 camera_pos[3];
+    u32 time;
+
+    f32 light_ambient[4];
+
+    f32 fog_color[3];
+    f32 fog_distance;
+
+    u32 light_points_nb;
+    u32 light_directionals_nb;
+    u32 padding[2];
 };
 
 /**
@@ -50,8 +75,23 @@ enum shader_vertex_binding {
     SHADER_VERT_INSTANCEPOSITION,
     SHADER_VERT_INSTANCESCALE,
     SHADER_VERT_INSTANCEROTATION,
+    SHADER_VERT_POS_ORIGIN,
+    SHADER_VERT_POS_EXTENT,
 };
 
+/**
+ * @brief Vertex sent to the GPU in the GEOMETRY_VERTEX_COMPACT format.
+ * The normal is a GL_INT_2_10_10_10_REV, the UV two half floats.
+ */
+struct vertex_compact { struct vector3 pos; u32 normal; u16 uv[2]; };
+
+/**
+ * @brief Vertex sent to the GPU in the GEOMETRY_VERTEX_PACKED format.
+ * The position is normalized in the geometry's bounding box, on 16 bits per
+ * axis ; the last one is padding.
+ */
+struct vertex_packed { u16 pos[4]; u32 normal; u16 uv[2]; };
+
 /**
  * @brief This enumeration is a direct correspondance with the multiple
  * uniform sampler2D layout indices found in the `frag_head.glsl`.
@@ -66,6 +106,50 @@ enum material_base_sampler {
     MATERIAL_BASE_SAMPLERS_NUMBER,
 };
 
+/**
+ * @brief Format, size and mip levels of the pixels a 2D texture sends to the
+ * GPU, telling which texture pool page it can share.
+ */
+struct texture_shape {
+    GLenum internal_format;
+    GLenum format;
+    u32 width, height;
+    u32 levels_nb;
+    bool compressed;
+};
+
+/**
+ * @brief Layout of the keys used to order the models drawn in a scene, from
+ * most to least significant bits. Models sharing the upper fields are drawn
+ * one after the other and share their OpenGL state.
+ */
+enum model_sort_key_field {
+    MODEL_SORT_KEY_DEPTH_BITS    = 16,
+    MODEL_SORT_KEY_TEXTURE_BITS  = 14,
+    MODEL_SORT_KEY_MATERIAL_BITS = 14,
+    MODEL_SORT_KEY_PROGRAM_BITS  = 16,
+    MODEL_SORT_KEY_LAYER_BITS    = 4,
+
+    MODEL_SORT_KEY_DEPTH_SHIFT    = 0,
+    MODEL_SORT_KEY_TEXTURE_SHIFT  = MODEL_SORT_KEY_DEPTH_SHIFT
+            + MODEL_SORT_KEY_DEPTH_BITS,
+    MODEL_SORT_KEY_MATERIAL_SHIFT = MODEL_SORT_KEY_TEXTURE_SHIFT
+            + MODEL_SORT_KEY_TEXTURE_BITS,
+    MODEL_SORT_KEY_PROGRAM_SHIFT  = MODEL_SORT_KEY_MATERIAL_SHIFT
+            + MODEL_SORT_KEY_MATERIAL_BITS,
+    MODEL_SORT_KEY_LAYER_SHIFT    = MODEL_SORT_KEY_PROGRAM_SHIFT
+            + MODEL_SORT_KEY_PROGRAM_BITS,
+};
+
+/**
+ * @brief Volume seen by a camera, as six inward planes (a, b, c, d) so that
+ * ax + by + cz + d is the signed distance of a point to the plane.
+ * Planes are in order : left, right, bottom, top, near, far.
+ */
+struct frustum {
+    f32 planes[6][4];
+};
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 // GEOMETRY --------------------------------------------------------------------
@@ -80,6 +164,10 @@ void geometry_push_face(struct geometry *geometry, u32 *out_idx);
 void geometry_face_indices(struct geometry *geometry, size_t idx,
         u32 indices[3u]);
 
+void geometry_compute_bounds(struct geometry *geometry);
+void geometry_point_vertex_attributes(const struct geometry *geometry);
+void geometry_send_position_decoding(const struct geometry *geometry);
+
 void geometry_load(struct geometry *geometry);
 void geometry_unload(struct geometry *geometry);
 
@@ -89,6 +177,15 @@ void geometry_unload(struct geometry *geometry);
 
 void texture_load(struct texture *texture);
 void texture_unload(struct texture *texture);
+bool texture_describe(struct texture *texture, struct texture_shape *out_shape);
+bool texture_upload_to_layer(struct texture *texture, u32 layer, u32 x, u32 y,
+        u32 levels_nb);
+void texture_settle(struct texture *texture, GLuint name, u32 layer,
+        const f32 rect[4], size_t bytes);
+
+void texture_pool_use(struct texture *texture);
+void texture_pool_unuse(struct texture *texture);
+void texture_pool_leave(struct texture *texture);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -96,9 +193,8 @@ void texture_unload(struct texture *texture);
 
 void material_load(struct material *material);
 void material_unload(struct material *material);
-void material_bind_uniform_blocks(struct material *material,
-        struct shader *shader);
-void material_bind_textures(struct material *material, struct shader *shader);
+void material_bind_uniform_blocks(struct material *material);
+void material_bind_textures(struct material *material);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -106,20 +202,38 @@ void material_bind_textures(struct material *material, struct shader *shader);
 
 void model_load(struct model *model);
 void model_unload(struct model *model);
-void model_draw(struct model *model);
+void model_draw(struct model *model, const struct camera *camera,
+        const struct frustum *frustum);
+u64 model_sort_key(const struct model *model, const struct camera *camera);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// FRUSTUM ---------------------------------------------------------------------
+
+void frustum_from_camera(struct frustum *frustum, const struct camera *camera);
+bool frustum_sphere_visible(const struct frustum *frustum,
+        struct vector3 center, f32 radius);
+size_t frustum_cull_spheres(const struct frustum *frustum,
+        const struct instance_spheres *spheres, u32 *out_indices);
+
+void instance_bounding_sphere(const struct geometry_bounds *bounds,
+        const struct instance *instance, struct vector3 *out_center,
+        f32 *out_radius);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 // CAMERA ----------------------------------------------------------------------
 
-void camera_send_uniforms(struct camera *camera, struct shader *shader);
+void camera_frame_uniforms(const struct camera *camera,
+        struct frame_uniforms *frame);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 // ENVIRONMENT -----------------------------------------------------------------
 
 void environment_draw(struct environment *env);
-void environment_send_uniforms(struct environment *env, struct shader *shader);
+void environment_frame_uniforms(const struct environment *env,
+        struct frame_uniforms *frame);
 
 void environment_load(struct environment *env);
 void environment_unload(struct environment *env);
@@ -132,27 +132,15 @@ void environment_load(struct environment *env)
     glGenVertexArrays(1, &env->gpu_side.vao);
 
     if (env->shader) {
-        glUseProgram(env->shader->program);
-        glBindVertexArray(env->gpu_side.vao);
+        gl_state_use_program(env->shader->program);
+        gl_state_bind_vertex_array(env->gpu_side.vao);
 
         if (env->shape) {
-            glBindBuffer(GL_ARRAY_BUFFER, env->shape->gpu_side.vbo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
-                    env->shape->gpu_side.ebo);
-
-            glVertexAttribPointer(SHADER_VERT_POS, 3, GL_FLOAT,
-                    GL_FALSE, sizeof(struct vertex),
-                    (void *) OFFSET_OF(struct vertex, pos));
-            glEnableVertexAttribArray(SHADER_VERT_POS);
+            geometry_point_vertex_attributes(env->shape);
         }
 
-        if (env->cube_texture) {
-            glBindTexture(GL_TEXTURE_CUBE_MAP,
-                    env->cube_texture->gpu_side.name);
-        }
-
-        glBindVertexArray(0);
-        glUseProgram(0);
+        gl_state_bind_vertex_array(0);
+        gl_state_use_program(0);
     }
 
 
@@ -173,6 +161,7 @@ void environment_unload(struct environment *env)
         if (env->shape) geometry_unload(env->shape);
         if (env->cube_texture) texture_unload(env->cube_texture);
 
+        gl_state_forget_vertex_array(env->gpu_side.vao);
         glDeleteVertexArrays(1, &env->gpu_side.vao);
         env->gpu_side.vao = 0;
 
@@ -188,48 +177,40 @@ void environment_unload(struct environment *env)
  */
 void environment_draw(struct environment *env)
 {
-    glDepthMask(GL_FALSE);
-    glCullFace(GL_FRONT);
+    gl_state_capability(GL_DEPTH_TEST, true);
+    gl_state_depth_mask(GL_FALSE);
+    gl_state_capability(GL_CULL_FACE, true);
+    gl_state_cull_face(GL_FRONT);
 
-    glUseProgram(env->shader->program);
-    glBindVertexArray(env->gpu_side.vao);
+    gl_state_use_program(env->shader->program);
+    gl_state_bind_vertex_array(env->gpu_side.vao);
     // TODO : make it clear the cube + texture is requiered to draw a
     // cubemap background !
     if (env->shape && env->cube_texture) {
-        glDrawElements(GL_TRIANGLES,
-                array_length(env->shape->faces)*3,
-                GL_UNSIGNED_INT, nullptr);
+        gl_state_bind_texture(0, GL_TEXTURE_CUBE_MAP,
+                env->cube_texture->gpu_side.name);
+        geometry_send_position_decoding(env->shape);
+        glDrawElements(GL_TRIANGLES, env->shape->gpu_side.nb_indices,
+                env->shape->gpu_side.index_type, nullptr);
     }
-    glBindVertexArray(0);
-    glUseProgram(0);
 
-    glCullFace(GL_BACK);
-    glDepthMask(GL_TRUE);
+    // models drawn next expect the default culling and depth writes
+    gl_state_cull_face(GL_BACK);
+    gl_state_depth_mask(GL_TRUE);
 }
 
 /**
- * @brief Sends an environment's variables to a shader.
- * The expected uniforms are :
- * - vec4 LIGHT_AMBIENT ;
- * - vec3 FOG_COLOR ;
- * - float FOG_DISTANCE.
+ * @brief Writes an environment's ambient light and fog to the frame-global
+ * data sent to the shaders.
  *
  * @param[in] env Source environment.
- * @param[in] shader Shader supporting the uniforms.
+ * @param[inout] frame Frame data.
  */
-void environment_send_uniforms(struct environment *env, struct shader *shader)
+void environment_frame_uniforms(const struct environment *env,
+        struct frame_uniforms *frame)
 {
-    GLint uniform_name = -1;
-
-    glUseProgram(shader->program);
-
-    uniform_name = glGetUniformLocation(shader->program, "LIGHT_AMBIENT");
-    glUniform4fv(uniform_name, 1, env->ambient_light.color);
-
-    uniform_name = glGetUniformLocation(shader->program, "FOG_COLOR");
-    glUniform3fv(uniform_name, 1, env->fog_color);
-    uniform_name = glGetUniformLocation(shader->program, "FOG_DISTANCE");
-    glUniform1f(uniform_name, env->fog_distance);
-
-    glUseProgram(0);
+    bytewise_copy(frame->light_ambient, env->ambient_light.color,
+            sizeof(frame->light_ambient));
+    bytewise_copy(frame->fog_color, env->fog_color, sizeof(frame->fog_color));
+    frame->fog_distance = env->fog_distance;
 }
@@ -0,0 +1,362 @@
+/**
+ * @file 3dful_frustum.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the view frustum used to cull instances on the CPU.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <math.h>
+
+#include <ustd/array.h>
+
+#include "3dful_core.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FRUSTUM_CULL_X86 1
+#include <immintrin.h>
+#else
+#define FRUSTUM_CULL_X86 0
+#endif
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+static void frustum_plane(struct frustum *frustum, size_t plane,
+        const f32 clip[16], size_t row, f32 sign);
+
+typedef size_t (*frustum_cull_kernel_f)(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices);
+
+static size_t frustum_cull_scalar(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices);
+#if FRUSTUM_CULL_X86
+static size_t frustum_cull_sse(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices);
+static size_t frustum_cull_avx2(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices);
+#endif
+
+// Culling function selected at the first call.
+static frustum_cull_kernel_f frustum_cull_kernel = nullptr;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Extracts the six planes of the volume seen by a camera from its
+ * view-projection matrix (Gribb & Hartmann). The planes point inward and are
+ * normalized, so signed distances can be compared to a radius.
+ *
+ * @param[out] frustum Filled frustum.
+ * @param[in] camera Camera the frustum is seen from.
+ */
+void frustum_from_camera(struct frustum *frustum, const struct camera *camera)
+{
+    // matrices are column-major, as sent to OpenGL
+    const f32 *proj = camera->projection.v;
+    const f32 *view = camera->view.v;
+    f32 clip[16] = { 0 };
+
+    for (size_t col = 0 ; col < 4 ; col++) {
+        for (size_t row = 0 ; row < 4 ; row++) {
+            for (size_t k = 0 ; k < 4 ; k++) {
+                clip[(col * 4) + row] += proj[(k * 4) + row]
+                        * view[(col * 4) + k];
+            }
+        }
+    }
+
+    frustum_plane(frustum, 0, clip, 0,  1.f);   // left
+    frustum_plane(frustum, 1, clip, 0, -1.f);   // right
+    frustum_plane(frustum, 2, clip, 1,  1.f);   // bottom
+    frustum_plane(frustum, 3, clip, 1, -1.f);   // top
+    frustum_plane(frustum, 4, clip, 2,  1.f);   // near
+    frustum_plane(frustum, 5, clip, 2, -1.f);   // far
+}
+
+/**
+ * @brief Tells if a sphere is at least partly inside a frustum.
+ *
+ * @param[in] frustum Tested frustum.
+ * @param[in] center Center of the sphere, in world space.
+ * @param[in] radius Radius of the sphere.
+ * @return bool
+ */
+bool frustum_sphere_visible(const struct frustum *frustum,
+        struct vector3 center, f32 radius)
+{
+    for (size_t i = 0 ; i < COUNT_OF(frustum->planes) ; i++) {
+        f32 dist = (frustum->planes[i][0] * center.x)
+                + (frustum->planes[i][1] * center.y)
+                + (frustum->planes[i][2] * center.z)
+                + frustum->planes[i][3];
+
+        if (dist < -radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Computes the world-space sphere enclosing an instance of some
+ * geometry : the geometry's bounding sphere moved the same way the vertex
+ * shader moves the instance's vertices.
+ *
+ * @param[in] bounds Bounds of the instanciated geometry.
+ * @param[in] instance Placed instance.
+ * @param[out] out_center Center of the sphere.
+ * @param[out] out_radius Radius of the sphere.
+ */
+void instance_bounding_sphere(const struct geometry_bounds *bounds,
+        const struct instance *instance, struct vector3 *out_center,
+        f32 *out_radius)
+{
+    struct vector3 v = bounds->center;
+    struct quaternion q = instance->rotation;
+    struct vector3 c = { 0 };
+
+    // v + 2 * cross(cross(v, q.xyz) + q.w * v, q.xyz), as in vert_head.glsl
+    c.x = ((v.y * q.z) - (v.z * q.y)) + (q.w * v.x);
+    c.y = ((v.z * q.x) - (v.x * q.z)) + (q.w * v.y);
+    c.z = ((v.x * q.y) - (v.y * q.x)) + (q.w * v.z);
+
+    out_center->x = instance->position.x + (instance->scale.x
+            * (v.x + (2.f * ((c.y * q.z) - (c.z * q.y)))));
+    out_center->y = instance->position.y + (instance->scale.y
+            * (v.y + (2.f * ((c.z * q.x) - (c.x * q.z)))));
+    out_center->z = instance->position.z + (instance->scale.z
+            * (v.z + (2.f * ((c.x * q.y) - (c.y * q.x)))));
+
+    *out_radius = bounds->radius * fmaxf(fabsf(instance->scale.x),
+            fmaxf(fabsf(instance->scale.y), fabsf(instance->scale.z)));
+}
+
+/**
+ * @brief Tests a set of spheres against a frustum, and writes the indices of
+ * the ones at least partly inside it. The spheres are given as a structure of
+ * arrays so several of them can be tested at once : the widest instruction set
+ * supported by the CPU is picked on the first call.
+ *
+ * @param[in] frustum Tested frustum.
+ * @param[in] spheres Tested spheres.
+ * @param[out] out_indices Array of at least as many indices as there are
+ * spheres, filled with the indices of the visible ones, in order.
+ * @return size_t Number of visible spheres.
+ */
+size_t frustum_cull_spheres(const struct frustum *frustum,
+        const struct instance_spheres *spheres, u32 *out_indices)
+{
+    if (!frustum_cull_kernel) {
+        frustum_cull_kernel = &frustum_cull_scalar;
+#if FRUSTUM_CULL_X86
+        if (SDL_HasAVX2()) {
+            frustum_cull_kernel = &frustum_cull_avx2;
+        } else if (SDL_HasSSE()) {
+            frustum_cull_kernel = &frustum_cull_sse;
+        }
+#endif
+    }
+
+    return frustum_cull_kernel(frustum, spheres->x, spheres->y, spheres->z,
+            spheres->radius, array_length(spheres->x), out_indices);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Builds one plane of the frustum by adding or subtracting a row of the
+ * clip matrix to its last row, then normalizes it.
+ *
+ * @param[inout] frustum
+ * @param[in] plane Index of the built plane.
+ * @param[in] clip View-projection matrix, column-major.
+ * @param[in] row Row combined with the last one.
+ * @param[in] sign 1 to add the row, -1 to subtract it.
+ */
+static void frustum_plane(struct frustum *frustum, size_t plane,
+        const f32 clip[16], size_t row, f32 sign)
+{
+    f32 length = 0.f;
+
+    for (size_t col = 0 ; col < 4 ; col++) {
+        frustum->planes[plane][col] = clip[(col * 4) + 3]
+                + (sign * clip[(col * 4) + row]);
+    }
+
+    length = sqrtf((frustum->planes[plane][0] * frustum->planes[plane][0])
+            + (frustum->planes[plane][1] * frustum->planes[plane][1])
+            + (frustum->planes[plane][2] * frustum->planes[plane][2]));
+
+    if (length > 0.f) {
+        for (size_t col = 0 ; col < 4 ; col++) {
+            frustum->planes[plane][col] /= length;
+        }
+    }
+}
+
+/**
+ * @brief Tests spheres against a frustum one at a time. Used for the CPUs
+ * without the supported vector extensions, and for the remaining spheres of
+ * the vectorized kernels.
+ *
+ * @param[in] frustum Tested frustum.
+ * @param[in] x Centers, x coordinates.
+ * @param[in] y Centers, y coordinates.
+ * @param[in] z Centers, z coordinates.
+ * @param[in] radius Radii.
+ * @param[in] count Number of spheres.
+ * @param[out] out_indices Indices of the visible spheres.
+ * @return size_t Number of visible spheres.
+ */
+static size_t frustum_cull_scalar(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices)
+{
+    size_t visible_nb = 0;
+
+    for (size_t i = 0 ; i < count ; i++) {
+        if (frustum_sphere_visible(frustum,
+                    (struct vector3) { x[i], y[i], z[i] }, radius[i])) {
+            out_indices[visible_nb++] = (u32) i;
+        }
+    }
+
+    return visible_nb;
+}
+
+#if FRUSTUM_CULL_X86
+
+/**
+ * @brief Tests spheres against a frustum four at a time, with SSE. Spheres are
+ * rejected with the same ordered comparison as frustum_sphere_visible(), so
+ * the ones with NaN components are kept like in the scalar path.
+ *
+ * @param[in] frustum Tested frustum.
+ * @param[in] x Centers, x coordinates.
+ * @param[in] y Centers, y coordinates.
+ * @param[in] z Centers, z coordinates.
+ * @param[in] radius Radii.
+ * @param[in] count Number of spheres.
+ * @param[out] out_indices Indices of the visible spheres.
+ * @return size_t Number of visible spheres.
+ */
+__attribute__((target("sse")))
+static size_t frustum_cull_sse(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices)
+{
+    size_t visible_nb = 0;
+    size_t i = 0;
+
+    for ( ; (i + 4) <= count ; i += 4) {
+        __m128 cx = _mm_loadu_ps(x + i);
+        __m128 cy = _mm_loadu_ps(y + i);
+        __m128 cz = _mm_loadu_ps(z + i);
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+        __m128 outside = _mm_setzero_ps();
+        u32 mask = 0;
+
+        for (size_t p = 0 ; p < COUNT_OF(frustum->planes) ; p++) {
+            __m128 dist = _mm_add_ps(
+                    _mm_add_ps(
+                            _mm_mul_ps(cx, _mm_set1_ps(frustum->planes[p][0])),
+                            _mm_mul_ps(cy, _mm_set1_ps(frustum->planes[p][1]))),
+                    _mm_add_ps(
+                            _mm_mul_ps(cz, _mm_set1_ps(frustum->planes[p][2])),
+                            _mm_set1_ps(frustum->planes[p][3])));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, neg_r));
+        }
+
+        mask = ~((u32) _mm_movemask_ps(outside)) & 0xFu;
+        while (mask) {
+            out_indices[visible_nb++] = (u32) (i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+
+    for (size_t j = 0 ; j < (count - i) ; j++) {
+        if (frustum_sphere_visible(frustum,
+                    (struct vector3) { x[i + j], y[i + j], z[i + j] },
+                    radius[i + j])) {
+            out_indices[visible_nb++] = (u32) (i + j);
+        }
+    }
+
+    return visible_nb;
+}
+
+/**
+ * @brief Tests spheres against a frustum eight at a time, with AVX2. Spheres
+ * are rejected as in frustum_cull_sse().
+ *
+ * @param[in] frustum Tested frustum.
+ * @param[in] x Centers, x coordinates.
+ * @param[in] y Centers, y coordinates.
+ * @param[in] z Centers, z coordinates.
+ * @param[in] radius Radii.
+ * @param[in] count Number of spheres.
+ * @param[out] out_indices Indices of the visible spheres.
+ * @return size_t Number of visible spheres.
+ */
+__attribute__((target("avx2")))
+static size_t frustum_cull_avx2(const struct frustum *frustum,
+        const f32 *x, const f32 *y, const f32 *z, const f32 *radius,
+        size_t count, u32 *out_indices)
+{
+    size_t visible_nb = 0;
+    size_t i = 0;
+
+    for ( ; (i + 8) <= count ; i += 8) {
+        __m256 cx = _mm256_loadu_ps(x + i);
+        __m256 cy = _mm256_loadu_ps(y + i);
+        __m256 cz = _mm256_loadu_ps(z + i);
+        __m256 neg_r = _mm256_sub_ps(_mm256_setzero_ps(),
+                _mm256_loadu_ps(radius + i));
+        __m256 outside = _mm256_setzero_ps();
+        u32 mask = 0;
+
+        for (size_t p = 0 ; p < COUNT_OF(frustum->planes) ; p++) {
+            __m256 dist = _mm256_add_ps(
+                    _mm256_add_ps(
+                            _mm256_mul_ps(cx,
+                                    _mm256_set1_ps(frustum->planes[p][0])),
+                            _mm256_mul_ps(cy,
+                                    _mm256_set1_ps(frustum->planes[p][1]))),
+                    _mm256_add_ps(
+                            _mm256_mul_ps(cz,
+                                    _mm256_set1_ps(frustum->planes[p][2])),
+                            _mm256_set1_ps(frustum->planes[p][3])));
+            outside = _mm256_or_ps(outside,
+                    _mm256_cmp_ps(dist, neg_r, _CMP_LT_OQ));
+        }
+
+        mask = ~((u32) _mm256_movemask_ps(outside)) & 0xFFu;
+        while (mask) {
+            out_indices[visible_nb++] = (u32) (i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+
+    for (size_t j = 0 ; j < (count - i) ; j++) {
+        if (frustum_sphere_visible(frustum,
+                    (struct vector3) { x[i + j], y[i + j], z[i + j] },
+                    radius[i + j])) {
+            out_indices[visible_nb++] = (u32) (i + j);
+        }
+    }
+
+    return visible_nb;
+}
+
+#endif
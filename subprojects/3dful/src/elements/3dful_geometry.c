@@ -11,9 +11,24 @@
 
 #include "3dful_core.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <ustd/array.h>
 
 #include "geometry_parsing/3ful_geometry_parsing.h"
+#include "geometry_processing/3dful_geometry_processing.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+static void geometry_upload(struct geometry *geometry);
+static u16 geometry_half_of(f32 value);
+static u32 geometry_packed_normal(struct vector3 normal);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
 
 /**
  * @brief Allocates memory for a geometry object so it can store vertices and
@@ -29,6 +44,11 @@ void geometry_create(struct geometry *geometry)
                 sizeof(*geometry->vertices), 2),
         .faces    = array_create(make_system_allocator(),
                 sizeof(*geometry->faces), 2),
+        .lod_faces = array_create(make_system_allocator(),
+                sizeof(*geometry->lod_faces), 2),
+        .lods_nb = 0,
+        .meshlets = array_create(make_system_allocator(),
+                sizeof(*geometry->meshlets), 2),
     };
 }
 
@@ -56,23 +76,20 @@ void geometry_wavobj(struct geometry *geometry, const char *path)
  * memory.
  *
  * @param[inout] geometry Modified geometry.
- * @param[in] obj Array of bytes. Must have been created with ustd/array.h.
+ * @param[in] obj_buffer Contents of the file, read in place.
+ * @param[in] length Length of the contents, in bytes.
  */
 void geometry_wavobj_mem(struct geometry *geometry, const byte *obj_buffer,
         size_t length)
 {
-    struct allocator alloc = make_system_allocator();
     struct wavefront_obj obj = { };
-    ARRAY(byte) buffer = nullptr;
 
     wavefront_obj_create(&obj);
-    buffer = array_create(alloc, sizeof(*buffer), length);
 
-    array_append_mem(buffer, obj_buffer, length);
-    wavefront_obj_parse(&obj, buffer);
+    wavefront_obj_parse(&obj, obj_buffer, length);
     wavefront_obj_to(&obj, geometry);
+    geometry_compute_bounds(geometry);
 
-    array_destroy(alloc, (ARRAY_ANY *) &buffer);
     wavefront_obj_delete(&obj);
 }
 
@@ -85,6 +102,8 @@ void geometry_delete(struct geometry *geometry)
 {
     array_destroy(make_system_allocator(), (ARRAY_ANY *) &geometry->vertices);
     array_destroy(make_system_allocator(), (ARRAY_ANY *) &geometry->faces);
+    array_destroy(make_system_allocator(), (ARRAY_ANY *) &geometry->lod_faces);
+    array_destroy(make_system_allocator(), (ARRAY_ANY *) &geometry->meshlets);
 
     *geometry = (struct geometry) { 0 };
 }
@@ -104,24 +123,64 @@ void geometry_load(struct geometry *geometry)
         return;
     }
 
-    glGenBuffers(1, &geometry->gpu_side.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->gpu_side.vbo);
-    glBufferData(GL_ARRAY_BUFFER, array_length(geometry->vertices)
-            * sizeof(*geometry->vertices), geometry->vertices,
-            GL_STATIC_DRAW);
+    // vertices might have been set by hand since the last computation
+    geometry_compute_bounds(geometry);
 
+    glGenBuffers(1, &geometry->gpu_side.vbo);
     glGenBuffers(1, &geometry->gpu_side.ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->gpu_side.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, array_length(geometry->faces)
-            * sizeof(*geometry->faces), geometry->faces,
-            GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    geometry_upload(geometry);
 
     geometry->load_state.flags |= LOADABLE_FLAG_LOADED;
 }
 
+/**
+ * @brief Computes the axis-aligned box and the sphere enclosing all the
+ * vertices of the geometry. The sphere is centered on the box.
+ *
+ * @param[inout] geometry Measured geometry.
+ */
+void geometry_compute_bounds(struct geometry *geometry)
+{
+    struct geometry_bounds bounds = { 0 };
+    f32 radius_sq = 0.f;
+
+    if (array_length(geometry->vertices) == 0) {
+        geometry->bounds = bounds;
+        return;
+    }
+
+    bounds.min = geometry->vertices[0].pos;
+    bounds.max = geometry->vertices[0].pos;
+    for (size_t i = 1 ; i < array_length(geometry->vertices) ; i++) {
+        struct vector3 pos = geometry->vertices[i].pos;
+
+        bounds.min.x = (pos.x < bounds.min.x) ? pos.x : bounds.min.x;
+        bounds.min.y = (pos.y < bounds.min.y) ? pos.y : bounds.min.y;
+        bounds.min.z = (pos.z < bounds.min.z) ? pos.z : bounds.min.z;
+        bounds.max.x = (pos.x > bounds.max.x) ? pos.x : bounds.max.x;
+        bounds.max.y = (pos.y > bounds.max.y) ? pos.y : bounds.max.y;
+        bounds.max.z = (pos.z > bounds.max.z) ? pos.z : bounds.max.z;
+    }
+
+    bounds.center = (struct vector3) {
+            .x = (bounds.min.x + bounds.max.x) * .5f,
+            .y = (bounds.min.y + bounds.max.y) * .5f,
+            .z = (bounds.min.z + bounds.max.z) * .5f,
+    };
+
+    for (size_t i = 0 ; i < array_length(geometry->vertices) ; i++) {
+        f32 dx = geometry->vertices[i].pos.x - bounds.center.x;
+        f32 dy = geometry->vertices[i].pos.y - bounds.center.y;
+        f32 dz = geometry->vertices[i].pos.z - bounds.center.z;
+        f32 dist = (dx * dx) + (dy * dy) + (dz * dz);
+
+        radius_sq = (dist > radius_sq) ? dist : radius_sq;
+    }
+    bounds.radius = sqrtf(radius_sq);
+
+    geometry->bounds = bounds;
+}
+
 /**
  * @brief Quiery OpenGL to delete the buffers created during geometry_load().
  *
@@ -135,6 +194,8 @@ void geometry_unload(struct geometry *geometry)
         return;
     }
 
+    gl_state_forget_buffer(geometry->gpu_side.ebo);
+    gl_state_forget_buffer(geometry->gpu_side.vbo);
     glDeleteBuffers(1, &geometry->gpu_side.ebo);
     glDeleteBuffers(1, &geometry->gpu_side.vbo);
 
@@ -232,6 +293,206 @@ void geometry_set_layering(struct geometry *geometry,
     geometry->render_flags.layering = layering & 0x3;
 }
 
+/**
+ * @brief Chooses the layout of the vertices sent to the GPU. Compact layouts
+ * take less memory and bandwidth for a small loss of precision. This must be
+ * chosen before the geometry is loaded.
+ *
+ * @param[inout] geometry Modified geometry.
+ * @param[in] format Layout of the vertices on the GPU.
+ */
+void geometry_set_vertex_format(struct geometry *geometry,
+        enum geometry_vertex_format format)
+{
+    if (geometry->load_state.flags & LOADABLE_FLAG_LOADED) {
+        fprintf(stderr, "cannot change the vertex format of a loaded "
+                "geometry.\n");
+        return;
+    }
+
+    geometry->render_flags.vertex_format = format & 0x3;
+}
+
+/**
+ * @brief Points the vertex attributes of the bound vertex array to the
+ * geometry's buffers, in the geometry's vertex format. This also binds the
+ * geometry's faces to the vertex array.
+ *
+ * @param[in] geometry Loaded geometry.
+ */
+void geometry_point_vertex_attributes(const struct geometry *geometry)
+{
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, geometry->gpu_side.vbo);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, geometry->gpu_side.ebo);
+
+    switch ((enum geometry_vertex_format)
+            geometry->render_flags.vertex_format) {
+        case GEOMETRY_VERTEX_FULL:
+            glVertexAttribPointer(SHADER_VERT_POS, 3, GL_FLOAT, GL_FALSE,
+                    sizeof(struct vertex),
+                    (void *) OFFSET_OF(struct vertex, pos));
+            glVertexAttribPointer(SHADER_VERT_NORMAL, 3, GL_FLOAT, GL_FALSE,
+                    sizeof(struct vertex),
+                    (void *) OFFSET_OF(struct vertex, normal));
+            glVertexAttribPointer(SHADER_VERT_UV, 2, GL_FLOAT, GL_FALSE,
+                    sizeof(struct vertex),
+                    (void *) OFFSET_OF(struct vertex, uv));
+            break;
+
+        case GEOMETRY_VERTEX_COMPACT:
+            glVertexAttribPointer(SHADER_VERT_POS, 3, GL_FLOAT, GL_FALSE,
+                    sizeof(struct vertex_compact),
+                    (void *) OFFSET_OF(struct vertex_compact, pos));
+            glVertexAttribPointer(SHADER_VERT_NORMAL, 4,
+                    GL_INT_2_10_10_10_REV, GL_TRUE,
+                    sizeof(struct vertex_compact),
+                    (void *) OFFSET_OF(struct vertex_compact, normal));
+            glVertexAttribPointer(SHADER_VERT_UV, 2, GL_HALF_FLOAT, GL_FALSE,
+                    sizeof(struct vertex_compact),
+                    (void *) OFFSET_OF(struct vertex_compact, uv));
+            break;
+
+        case GEOMETRY_VERTEX_PACKED:
+            glVertexAttribPointer(SHADER_VERT_POS, 3, GL_UNSIGNED_SHORT,
+                    GL_TRUE, sizeof(struct vertex_packed),
+                    (void *) OFFSET_OF(struct vertex_packed, pos));
+            glVertexAttribPointer(SHADER_VERT_NORMAL, 4,
+                    GL_INT_2_10_10_10_REV, GL_TRUE,
+                    sizeof(struct vertex_packed),
+                    (void *) OFFSET_OF(struct vertex_packed, normal));
+            glVertexAttribPointer(SHADER_VERT_UV, 2, GL_HALF_FLOAT, GL_FALSE,
+                    sizeof(struct vertex_packed),
+                    (void *) OFFSET_OF(struct vertex_packed, uv));
+            break;
+    }
+
+    glEnableVertexAttribArray(SHADER_VERT_POS);
+    glEnableVertexAttribArray(SHADER_VERT_NORMAL);
+    glEnableVertexAttribArray(SHADER_VERT_UV);
+}
+
+/**
+ * @brief Sends the values used by the shaders to decode the positions of the
+ * geometry's vertices. They are not part of the vertex array's state, and must
+ * be sent before each draw.
+ *
+ * @param[in] geometry Loaded geometry.
+ */
+void geometry_send_position_decoding(const struct geometry *geometry)
+{
+    glVertexAttrib3f(SHADER_VERT_POS_ORIGIN, geometry->gpu_side.pos_origin.x,
+            geometry->gpu_side.pos_origin.y, geometry->gpu_side.pos_origin.z);
+    glVertexAttrib3f(SHADER_VERT_POS_EXTENT, geometry->gpu_side.pos_extent.x,
+            geometry->gpu_side.pos_extent.y, geometry->gpu_side.pos_extent.z);
+}
+
+/**
+ * @brief Reorders the faces and vertices of a geometry so the GPU reuses more
+ * of the vertices it transforms, and fetches them in sequence. The geometry
+ * looks the same. If the geometry is loaded, its buffers are updated.
+ *
+ * @param[inout] geometry Optimized geometry.
+ * @param[out] out_before Optional, filled with measures taken before the pass.
+ * @param[out] out_after Optional, filled with measures taken after the pass.
+ */
+void geometry_optimize(struct geometry *geometry,
+        struct geometry_cache_stats *out_before,
+        struct geometry_cache_stats *out_after)
+{
+    size_t vertices_nb = array_length(geometry->vertices);
+    size_t faces_nb = array_length(geometry->faces);
+
+    if (out_before) {
+        *out_before = vertex_cache_measure(geometry->faces, faces_nb,
+                vertices_nb);
+    }
+
+    vertex_cache_optimize(geometry->faces, faces_nb, vertices_nb);
+    vertex_fetch_optimize(geometry->vertices, vertices_nb, geometry->faces,
+            faces_nb);
+
+    if (out_after) {
+        *out_after = vertex_cache_measure(geometry->faces, faces_nb,
+                vertices_nb);
+    }
+
+    // the meshlets were ranges of the faces in their previous order
+    if (array_length(geometry->meshlets) > 0) {
+        array_clear(geometry->meshlets);
+        meshlets_build(geometry->vertices, vertices_nb, geometry->faces,
+                faces_nb, &geometry->meshlets);
+    }
+
+    // the levels of detail index the vertices in their previous order
+    if (geometry->lods_nb > 0) {
+        geometry_build_lods(geometry, geometry->lods_nb - 1);
+    } else if (geometry->load_state.flags & LOADABLE_FLAG_LOADED) {
+        geometry_upload(geometry);
+    }
+}
+
+/**
+ * @brief Builds coarser levels of detail of the geometry, each with about half
+ * the faces of the previous one, by collapsing the edges that change its
+ * shape the least. The levels reuse the geometry's vertices, and are drawn by
+ * models for instances far enough from the camera. Fewer levels are built if
+ * the geometry cannot be simplified further. If the geometry is loaded, its
+ * buffers are updated.
+ *
+ * @param[inout] geometry Simplified geometry.
+ * @param[in] levels_nb Number of levels, beyond the full geometry (at most
+ * GEOMETRY_LODS_MAX - 1).
+ */
+void geometry_build_lods(struct geometry *geometry, size_t levels_nb)
+{
+    size_t faces_nb = array_length(geometry->faces);
+    size_t built_nb = 0;
+
+    levels_nb = (levels_nb < (GEOMETRY_LODS_MAX - 1))
+            ? levels_nb : (GEOMETRY_LODS_MAX - 1);
+
+    array_clear(geometry->lod_faces);
+    geometry->lods[0] = (struct geometry_lod) {
+            .first_face = 0,
+            .faces_nb = (u32) faces_nb,
+            .error = 0.f,
+    };
+
+    built_nb = lod_chain_build(geometry->vertices,
+            array_length(geometry->vertices), geometry->faces, faces_nb,
+            levels_nb, &geometry->lod_faces, geometry->lods + 1);
+
+    // levels are sent right after the full faces
+    for (size_t i = 1 ; i <= built_nb ; i++) {
+        geometry->lods[i].first_face += (u32) faces_nb;
+    }
+    geometry->lods_nb = (built_nb > 0) ? (u32) (built_nb + 1) : 0;
+
+    if (geometry->load_state.flags & LOADABLE_FLAG_LOADED) {
+        geometry_upload(geometry);
+    }
+}
+
+/**
+ * @brief Splits the full faces of the geometry into meshlets, small clusters
+ * of neighbouring faces that models cull on their own when they are out of
+ * view or face away from the camera. The faces are reordered so each meshlet
+ * is a range of them. If the geometry is loaded, its buffers are updated.
+ *
+ * @param[inout] geometry Split geometry.
+ */
+void geometry_build_meshlets(struct geometry *geometry)
+{
+    array_clear(geometry->meshlets);
+    meshlets_build(geometry->vertices, array_length(geometry->vertices),
+            geometry->faces, array_length(geometry->faces),
+            &geometry->meshlets);
+
+    if (geometry->load_state.flags & LOADABLE_FLAG_LOADED) {
+        geometry_upload(geometry);
+    }
+}
+
 /**
  * @brief Adds an empty face to the geometry, filling an index used to
  * reference it.
@@ -245,6 +506,11 @@ void geometry_push_face(struct geometry *geometry, u32 *out_idx)
             (void **) &geometry->faces, 1);
     array_push(geometry->faces, &(struct face) { 0 });
 
+    // the levels of detail are sent after the faces, and would be outdated
+    array_clear(geometry->lod_faces);
+    geometry->lods_nb = 0;
+    array_clear(geometry->meshlets);
+
     if (out_idx) *out_idx = (u32) array_length(geometry->faces) - 1;
 }
 
@@ -263,3 +529,185 @@ void geometry_face_indices(struct geometry *geometry, size_t idx,
     geometry->faces[idx].idx_vert[1] = indices[1];
     geometry->faces[idx].idx_vert[2] = indices[2];
 }
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Sends the vertices and faces of the geometry to its buffer objects,
+ * converted to the geometry's vertex format. Faces are sent as 16 bits
+ * indices when all vertices can be indexed on 16 bits, followed by the faces
+ * of the levels of detail.
+ *
+ * @param[inout] geometry Geometry, with its buffer objects created.
+ */
+static void geometry_upload(struct geometry *geometry)
+{
+    struct allocator alloc = make_system_allocator();
+    size_t vertices_nb = array_length(geometry->vertices);
+    size_t faces_nb = array_length(geometry->faces);
+    size_t lod_faces_nb = array_length(geometry->lod_faces);
+    struct geometry_bounds *bounds = &geometry->bounds;
+    const void *vertex_data = geometry->vertices;
+    size_t vertex_size = sizeof(*geometry->vertices);
+    size_t index_size = sizeof(u32);
+    struct vertex_compact *compact = nullptr;
+    struct vertex_packed *packed = nullptr;
+    u32 *indices = nullptr;
+    u16 *short_indices = nullptr;
+    const void *index_data = nullptr;
+
+    geometry->gpu_side.pos_origin = (struct vector3) { 0.f, 0.f, 0.f };
+    geometry->gpu_side.pos_extent = (struct vector3) { 1.f, 1.f, 1.f };
+
+    switch ((enum geometry_vertex_format)
+            geometry->render_flags.vertex_format) {
+        case GEOMETRY_VERTEX_FULL:
+            break;
+
+        case GEOMETRY_VERTEX_COMPACT:
+            compact = alloc.malloc(alloc, (vertices_nb + 1) * sizeof(*compact));
+            for (size_t i = 0 ; i < vertices_nb ; i++) {
+                compact[i] = (struct vertex_compact) {
+                        .pos = geometry->vertices[i].pos,
+                        .normal = geometry_packed_normal(
+                                geometry->vertices[i].normal),
+                        .uv = {
+                            geometry_half_of(geometry->vertices[i].uv.x),
+                            geometry_half_of(geometry->vertices[i].uv.y) },
+                };
+            }
+            vertex_data = compact;
+            vertex_size = sizeof(*compact);
+            break;
+
+        case GEOMETRY_VERTEX_PACKED:
+            geometry->gpu_side.pos_origin = bounds->min;
+            geometry->gpu_side.pos_extent = (struct vector3) {
+                    bounds->max.x - bounds->min.x,
+                    bounds->max.y - bounds->min.y,
+                    bounds->max.z - bounds->min.z,
+            };
+            packed = alloc.malloc(alloc, (vertices_nb + 1) * sizeof(*packed));
+            for (size_t i = 0 ; i < vertices_nb ; i++) {
+                struct vector3 pos = geometry->vertices[i].pos;
+                struct vector3 extent = geometry->gpu_side.pos_extent;
+
+                packed[i] = (struct vertex_packed) {
+                        .pos = {
+                            (extent.x > 0.f) ? (u16) roundf(((pos.x
+                                    - bounds->min.x) / extent.x) * 65535.f) : 0,
+                            (extent.y > 0.f) ? (u16) roundf(((pos.y
+                                    - bounds->min.y) / extent.y) * 65535.f) : 0,
+                            (extent.z > 0.f) ? (u16) roundf(((pos.z
+                                    - bounds->min.z) / extent.z) * 65535.f) : 0,
+                            0 },
+                        .normal = geometry_packed_normal(
+                                geometry->vertices[i].normal),
+                        .uv = {
+                            geometry_half_of(geometry->vertices[i].uv.x),
+                            geometry_half_of(geometry->vertices[i].uv.y) },
+                };
+            }
+            vertex_data = packed;
+            vertex_size = sizeof(*packed);
+            break;
+    }
+
+    // levels of detail follow the full faces in the same buffer
+    // 0xFFFF is kept out, as it restarts primitives on some contexts
+    if (vertices_nb < 0xFFFF) {
+        short_indices = alloc.malloc(alloc,
+                (((faces_nb + lod_faces_nb) * 3) + 1)
+                * sizeof(*short_indices));
+        for (size_t i = 0 ; i < (faces_nb + lod_faces_nb) ; i++) {
+            const struct face *face = (i < faces_nb) ? geometry->faces + i
+                    : geometry->lod_faces + (i - faces_nb);
+
+            for (size_t j = 0 ; j < 3 ; j++) {
+                short_indices[(i * 3) + j] = (u16) face->idx_vert[j];
+            }
+        }
+        index_data = short_indices;
+        index_size = sizeof(*short_indices);
+        geometry->gpu_side.index_type = GL_UNSIGNED_SHORT;
+    } else if (lod_faces_nb > 0) {
+        indices = alloc.malloc(alloc,
+                ((faces_nb + lod_faces_nb) * 3) * sizeof(*indices));
+        memcpy(indices, geometry->faces, faces_nb * sizeof(*geometry->faces));
+        memcpy(indices + (faces_nb * 3), geometry->lod_faces,
+                lod_faces_nb * sizeof(*geometry->lod_faces));
+        index_data = indices;
+        geometry->gpu_side.index_type = GL_UNSIGNED_INT;
+    } else {
+        index_data = geometry->faces;
+        geometry->gpu_side.index_type = GL_UNSIGNED_INT;
+    }
+    geometry->gpu_side.nb_indices = faces_nb * 3;
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, geometry->gpu_side.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices_nb * vertex_size, vertex_data,
+            GL_STATIC_DRAW);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+    // the element array binding is part of the bound vertex array
+    gl_state_bind_vertex_array(0);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, geometry->gpu_side.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+            (faces_nb + lod_faces_nb) * 3 * index_size, index_data,
+            GL_STATIC_DRAW);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (compact) alloc.free(alloc, compact);
+    if (packed) alloc.free(alloc, packed);
+    if (indices) alloc.free(alloc, indices);
+    if (short_indices) alloc.free(alloc, short_indices);
+}
+
+/**
+ * @brief Converts a float to a half float, rounding to the nearest. Values too
+ * small for a normal half become zero, values too large become infinite.
+ *
+ * @param[in] value
+ * @return u16
+ */
+static u16 geometry_half_of(f32 value)
+{
+    union { f32 f; u32 u; } bits = { .f = value };
+    u32 sign = (bits.u >> 16) & 0x8000u;
+    i32 exponent = (i32) ((bits.u >> 23) & 0xFFu) - 127 + 15;
+    u32 mantissa = bits.u & 0x7FFFFFu;
+
+    if (exponent <= 0) {
+        return (u16) sign;
+    }
+
+    mantissa += 0x1000u;
+    if (mantissa & 0x800000u) {
+        mantissa = 0;
+        exponent += 1;
+    }
+
+    if (exponent >= 31) {
+        return (u16) (sign | 0x7C00u);
+    }
+
+    return (u16) (sign | ((u32) exponent << 10) | (mantissa >> 13));
+}
+
+/**
+ * @brief Packs a normal in a GL_INT_2_10_10_10_REV, signed and normalized.
+ *
+ * @param[in] normal
+ * @return u32
+ */
+static u32 geometry_packed_normal(struct vector3 normal)
+{
+    i32 x = (i32) roundf(fmaxf(-1.f, fminf(1.f, normal.x)) * 511.f);
+    i32 y = (i32) roundf(fmaxf(-1.f, fminf(1.f, normal.y)) * 511.f);
+    i32 z = (i32) roundf(fmaxf(-1.f, fminf(1.f, normal.z)) * 511.f);
+
+    return ((u32) x & 0x3FFu)
+            | (((u32) y & 0x3FFu) << 10)
+            | (((u32) z & 0x3FFu) << 20);
+}
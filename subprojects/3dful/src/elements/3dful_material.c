@@ -8,21 +8,7 @@ static void material_set_sampler(struct material *material, u8 true_index,
         struct texture *texture);
 static void material_update_ubo(struct material *material, size_t offset,
         size_t size);
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-
-/**
- * @brief Map of sampler enumeration values to their expected name in a shade
- * program.
- */
-static const char * material_sampler_uniforms[MATERIAL_BASE_SAMPLERS_NUMBER] = {
-        [MATERIAL_BASE_SAMPLER_AMBIENT_MASK]  = "ambient_mask",
-        [MATERIAL_BASE_SAMPLER_SPECULAR_MASK] = "specular_mask",
-        [MATERIAL_BASE_SAMPLER_DIFFUSE_MASK]  = "diffuse_mask",
-        [MATERIAL_BASE_SAMPLER_EMISSIVE_MASK] = "emissive_mask",
-        [MATERIAL_BASE_SAMPLER_TEXTURE]       = "base_texture",
-};
+static void material_place_sampler(struct material *material, size_t index);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -223,10 +209,10 @@ void material_load(struct material *material)
     }
 
     glGenBuffers(1, &material->gpu_side.ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, material->gpu_side.ubo);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, material->gpu_side.ubo);
     glBufferData(GL_UNIFORM_BUFFER, sizeof(material->properties),
             &(material->properties), GL_STATIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
 
     material->load_state.flags |= LOADABLE_FLAG_LOADED;
 
@@ -250,6 +236,7 @@ void material_unload(struct material *material)
         return;
     }
 
+    gl_state_forget_buffer(material->gpu_side.ubo);
     glDeleteBuffers(1, &material->gpu_side.ubo);
     material->load_state.flags &= ~LOADABLE_FLAG_LOADED;
 
@@ -265,49 +252,34 @@ void material_unload(struct material *material)
  * shader can take them as inputs.
  *
  * @param[in] material Target loaded material.
- * @param[in] shader Shader taking the inputs.
  */
-void material_bind_uniform_blocks(struct material *material,
-        struct shader *shader)
+void material_bind_uniform_blocks(struct material *material)
 {
-    glUseProgram(shader->program);
-
-    GLint block_name = -1;
-
-    block_name = glGetUniformBlockIndex(shader->program, "BLOCK_MATERIAL");
-    glUniformBlockBinding(shader->program, block_name, SHADER_UBO_MATERIAL);
-
-    glBindBuffer(GL_UNIFORM_BUFFER, material->gpu_side.ubo);
-    glBindBufferBase(GL_UNIFORM_BUFFER, block_name, material->gpu_side.ubo);
-
-    glUseProgram(0);
+    // the block was bound to its binding point when the shader was linked
+    gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, SHADER_UBO_MATERIAL,
+            material->gpu_side.ubo);
 }
 
 /**
  * @brief Bind the textures loaded by the material to the opengl context so a
- * shader can take them as inputs
+ * shader can take them as inputs. 2D textures are array textures, and the
+ * base samplers are told where their texture lies in them.
  *
  * @param[in] material Target loaded material.
- * @param[in] shader Shader taking the textures.
  */
-void material_bind_textures(struct material *material, struct shader *shader)
+void material_bind_textures(struct material *material)
 {
-    glUseProgram(shader->program);
+    // base samplers were assigned their texture unit when the shader was
+    // linked
     for (size_t i = 0 ; i < COUNT_OF(material->samplers) ; i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
         if (material->samplers[i]) {
-            glBindTexture(GL_TEXTURE_2D,
-                    material->samplers[i]->gpu_side.name);
-
             if (i < MATERIAL_BASE_SAMPLERS_NUMBER) {
-                glUniform1i(glGetUniformLocation(shader->program,
-                        material_sampler_uniforms[i]), i);
-            } else {
-                // custom texture name here
+                material_place_sampler(material, i);
             }
+            gl_state_bind_texture(i, GL_TEXTURE_2D_ARRAY,
+                    material->samplers[i]->gpu_side.name);
         }
     }
-    glUseProgram(0);
 }
 
 // -----------------------------------------------------------------------------
@@ -350,8 +322,45 @@ static void material_update_ubo(struct material *material, size_t offset,
         return;
     }
 
-    glBindBuffer(GL_UNIFORM_BUFFER, material->gpu_side.ubo);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, material->gpu_side.ubo);
     glBufferSubData(GL_UNIFORM_BUFFER, offset, size,
             (byte *) &(material->properties) + offset);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/**
+ * @brief Sends where the texture of a base sampler lies in its array texture
+ * to the material's UBO, if it moved since it was last sent : textures are
+ * moved to the array texture of their pool page once it is sent.
+ *
+ * @param[inout] material Material binding its textures.
+ * @param[in] index Index of the base sampler.
+ */
+static void material_place_sampler(struct material *material, size_t index)
+{
+    const struct texture *texture = material->samplers[index];
+    f32 *rect = material->properties.sampler_rects[index];
+    f32 *layer = material->properties.sampler_layers + index;
+
+    if ((rect[0] == texture->gpu_side.rect[0])
+            && (rect[1] == texture->gpu_side.rect[1])
+            && (rect[2] == texture->gpu_side.rect[2])
+            && (rect[3] == texture->gpu_side.rect[3])
+            && (*layer == (f32) texture->gpu_side.layer)) {
+        return;
+    }
+
+    for (size_t i = 0 ; i < 4 ; i++) {
+        rect[i] = texture->gpu_side.rect[i];
+    }
+    *layer = (f32) texture->gpu_side.layer;
+
+    material_update_ubo(material,
+            OFFSET_OF(struct material_properties, sampler_rects)
+                    + (index * sizeof(*material->properties.sampler_rects)),
+            sizeof(*material->properties.sampler_rects));
+    material_update_ubo(material,
+            OFFSET_OF(struct material_properties, sampler_layers)
+                    + (index * sizeof(*material->properties.sampler_layers)),
+            sizeof(*material->properties.sampler_layers));
 }
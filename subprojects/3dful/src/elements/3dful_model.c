@@ -9,6 +9,8 @@
  *
  */
 
+#include <math.h>
+
 #include <ustd/array.h>
 
 #include <3dful.h>
@@ -18,6 +20,41 @@
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
+/** Error, as a fraction of the screen's height, allowed by the level of detail
+ * picked for an instance (about a pixel on a 1080p screen). */
+#define MODEL_LOD_SCREEN_ERROR (1.f / 1000.f)
+
+/** Most instances drawn meshlet by meshlet : each of them takes its own draws,
+ * so larger crowds are drawn whole with a single instanced draw. */
+#define MODEL_MESHLET_INSTANCES_MAX (16u)
+
+static void model_point_instance_attributes(struct model *model,
+        GLuint buffer, size_t offset);
+static void model_compute_cull_spheres(struct model *model);
+static void model_append_cull_spheres(struct model *model);
+static void model_update_cull_spheres(struct model *model,
+        const handle_t *handles, size_t count);
+static void model_remove_cull_sphere(struct model *model, size_t index);
+static size_t model_gather_instances(struct model *model,
+        const struct camera *camera, bool lod_selected,
+        const struct frustum *frustum,
+        size_t out_lod_counts[GEOMETRY_LODS_MAX]);
+static f32 model_instance_distance(const struct model *model, size_t instance,
+        struct vector3 eye);
+static u8 model_instance_lod(const struct model *model, size_t instance,
+        f32 distance, f32 error_per_distance);
+static void model_draw_meshlets(struct model *model,
+        const struct instance *instances, size_t instances_nb,
+        GLuint instances_source, size_t instances_offset,
+        const struct camera *camera, const struct frustum *frustum);
+static size_t model_cull_meshlets(struct model *model,
+        const struct instance *instance, const struct camera *camera,
+        const struct frustum *frustum);
+static struct vector3 model_rotate_back(struct quaternion q, struct vector3 v);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
 /**
  * @brief Allocates memory for a model object.
  *
@@ -36,12 +73,35 @@ void model_create(struct model *model)
                     sizeof(*model->instances_array), 32),
             .instances = { { 0 }, 0 },
 
+            .culling = false,
+            .cull_spheres = {
+                .x = array_create(make_system_allocator(),
+                        sizeof(*model->cull_spheres.x), 32),
+                .y = array_create(make_system_allocator(),
+                        sizeof(*model->cull_spheres.y), 32),
+                .z = array_create(make_system_allocator(),
+                        sizeof(*model->cull_spheres.z), 32),
+                .radius = array_create(make_system_allocator(),
+                        sizeof(*model->cull_spheres.radius), 32),
+                .dirty = true,
+            },
+            .visible_indices = array_create(make_system_allocator(),
+                    sizeof(*model->visible_indices), 32),
+            .visible_lods = array_create(make_system_allocator(),
+                    sizeof(*model->visible_lods), 32),
+            .visible_array = array_create(make_system_allocator(),
+                    sizeof(*model->visible_array), 32),
+            .visible_ranges = array_create(make_system_allocator(),
+                    sizeof(*model->visible_ranges), 64),
+            .nearest_distance = -1.f,
+
             .gpu_side = { 0 },
     };
 
     handle_buffer_array_create(&model->instances);
     handle_buffer_array_bind(&model->instances, model->instances_array);
     model->instances.buffer_usage = GL_ARRAY_BUFFER;
+    model->instances.sync_mode = HANDLE_BUFFER_ARRAY_SYNC_DEFERRED;
 }
 
 /**
@@ -53,6 +113,22 @@ void model_delete(struct model *model)
 {
     array_destroy(make_system_allocator(),
         (ARRAY_ANY*) &model->instances_array);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->cull_spheres.x);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->cull_spheres.y);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->cull_spheres.z);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->cull_spheres.radius);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->visible_indices);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->visible_lods);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->visible_array);
+    array_destroy(make_system_allocator(),
+        (ARRAY_ANY*) &model->visible_ranges);
     handle_buffer_array_delete(&model->instances);
 
     *model = (struct model) { 0 };
@@ -77,6 +153,7 @@ void model_geometry(struct model *model, struct geometry *geometry)
     }
 
     model->geometry = geometry;
+    model->cull_spheres.dirty = true;
 }
 
 /**
@@ -122,6 +199,9 @@ void model_material(struct model *model, struct material *material)
 void model_instantiate(struct model *model, handle_t *out_handle)
 {
     handle_buffer_array_push(&model->instances, out_handle);
+    // the push may have moved the array
+    model->instances_array = model->instances.data_array;
+    model_append_cull_spheres(model);
 }
 
 /**
@@ -137,6 +217,7 @@ void model_instance_position(struct model *model, handle_t handle,
     handle_buffer_array_set(&model->instances, handle,
             &pos, OFFSET_OF(struct instance, position),
             sizeof(pos));
+    model_update_cull_spheres(model, &handle, 1);
 }
 
 /**
@@ -152,6 +233,7 @@ void model_instance_rotation(struct model *model, handle_t handle,
     handle_buffer_array_set(&model->instances, handle,
             &rotation, OFFSET_OF(struct instance, rotation),
             sizeof(rotation));
+    model_update_cull_spheres(model, &handle, 1);
 }
 
 /**
@@ -167,6 +249,7 @@ void model_instance_scale(struct model *model, handle_t handle,
     handle_buffer_array_set(&model->instances, handle,
             scale, OFFSET_OF(struct instance, scale),
             sizeof(f32)*3);
+    model_update_cull_spheres(model, &handle, 1);
 }
 
 /**
@@ -177,7 +260,138 @@ void model_instance_scale(struct model *model, handle_t handle,
  */
 void model_instance_remove(struct model *model, handle_t handle)
 {
+    size_t index = handle_buffer_array_index_of(&model->instances, handle);
+
     handle_buffer_array_remove(&model->instances, handle);
+    model_remove_cull_sphere(model, index);
+}
+
+/**
+ * @brief Adds several instances of this model at once. The new instances
+ * should then be placed with model_instances_positions() and friends.
+ *
+ * @param[inout] model Model to instanciate.
+ * @param[in] count Number of new instances.
+ * @param[out] out_handles Array of at least count handles, filled with the
+ * ids of the new instances.
+ */
+void model_instantiate_many(struct model *model, size_t count,
+        handle_t *out_handles)
+{
+    handle_buffer_array_push_many(&model->instances, count, out_handles);
+    // the push may have moved the array
+    model->instances_array = model->instances.data_array;
+    model_append_cull_spheres(model);
+}
+
+/**
+ * @brief Removes several instances from a model. The handles become unusable.
+ *
+ * @param[inout] model Model the instances belong to.
+ * @param[in] handles Handles to instances of this model.
+ * @param[in] count Number of handles.
+ */
+void model_instances_remove(struct model *model, const handle_t *handles,
+        size_t count)
+{
+    u32 *removed = nullptr;
+
+    // the visible indices are rebuilt at each draw, and hold the removed
+    // positions in the meantime
+    if (!model->cull_spheres.dirty) {
+        array_clear(model->visible_indices);
+        array_ensure_capacity(make_system_allocator(),
+                (ARRAY_ANY *) &model->visible_indices, count);
+        removed = model->visible_indices;
+    }
+
+    handle_buffer_array_remove_many(&model->instances, handles, count,
+            removed);
+
+    for (size_t i = 0 ; removed && (i < count) ; i++) {
+        model_remove_cull_sphere(model, removed[i]);
+    }
+}
+
+/**
+ * @brief Sets the positions of several instances of a model.
+ *
+ * @param[inout] model Model the instances belong to.
+ * @param[in] handles Handles to instances of this model.
+ * @param[in] count Number of handles.
+ * @param[in] positions One position for each handle.
+ */
+void model_instances_positions(struct model *model, const handle_t *handles,
+        size_t count, const f32 (*positions)[3])
+{
+    handle_buffer_array_set_many(&model->instances, handles, count,
+            positions, sizeof(*positions),
+            OFFSET_OF(struct instance, position), sizeof(*positions));
+    model_update_cull_spheres(model, handles, count);
+}
+
+/**
+ * @brief Sets the rotations of several instances of a model.
+ *
+ * @param[inout] model Model the instances belong to.
+ * @param[in] handles Handles to instances of this model.
+ * @param[in] count Number of handles.
+ * @param[in] rotations One quaternion rotation for each handle.
+ */
+void model_instances_rotations(struct model *model, const handle_t *handles,
+        size_t count, const struct quaternion *rotations)
+{
+    handle_buffer_array_set_many(&model->instances, handles, count,
+            rotations, sizeof(*rotations),
+            OFFSET_OF(struct instance, rotation), sizeof(*rotations));
+    model_update_cull_spheres(model, handles, count);
+}
+
+/**
+ * @brief Sets the scales of several instances of a model.
+ *
+ * @param[inout] model Model the instances belong to.
+ * @param[in] handles Handles to instances of this model.
+ * @param[in] count Number of handles.
+ * @param[in] scales One scale for each handle.
+ */
+void model_instances_scales(struct model *model, const handle_t *handles,
+        size_t count, const f32 (*scales)[3])
+{
+    handle_buffer_array_set_many(&model->instances, handles, count,
+            scales, sizeof(*scales),
+            OFFSET_OF(struct instance, scale), sizeof(*scales));
+    model_update_cull_spheres(model, handles, count);
+}
+
+/**
+ * @brief Chooses how the instances of a model are sent to the GPU. Streamed
+ * instances are rewritten all at once each frame they change, without ever
+ * waiting on the GPU : this is the better choice when most instances move
+ * every frame.
+ *
+ * @param[inout] model Modified model.
+ * @param[in] streaming Wether the instances are streamed.
+ */
+void model_instances_streaming(struct model *model, bool streaming)
+{
+    handle_buffer_array_sync_mode(&model->instances,
+            streaming ? HANDLE_BUFFER_ARRAY_SYNC_STREAMING
+                      : HANDLE_BUFFER_ARRAY_SYNC_DEFERRED);
+}
+
+/**
+ * @brief Chooses if the instances of a model are tested against the camera's
+ * frustum before being drawn. Only the visible instances are then sent to the
+ * GPU : this pays off for models with many instances spread around the scene,
+ * and costs more than it saves for small models.
+ *
+ * @param[inout] model Modified model.
+ * @param[in] culling Wether the instances are culled.
+ */
+void model_culling(struct model *model, bool culling)
+{
+    model->culling = culling;
 }
 
 /**
@@ -196,60 +410,36 @@ void model_load(struct model *model)
 
         handle_buffer_array_load(&model->instances);
 
+        // draw-time buffer for the instances left after culling
+        glGenBuffers(1, &model->gpu_side.visible_vbo);
+        model->gpu_side.visible_capacity = 0;
+        model->cull_spheres.dirty = true;
+
         // model's vao
         glGenVertexArrays(1, &model->gpu_side.vao);
 
-        glUseProgram(model->shader->program);
+        gl_state_use_program(model->shader->program);
         // binding scenario for this VAO
-        glBindVertexArray(model->gpu_side.vao);
+        gl_state_bind_vertex_array(model->gpu_side.vao);
 
-        // vertex data from geometry
+        // vertex data from geometry, in its vertex format
         if (model->geometry) {
-            glBindBuffer(GL_ARRAY_BUFFER,
-                    model->geometry->gpu_side.vbo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
-                    model->geometry->gpu_side.ebo);
+            geometry_point_vertex_attributes(model->geometry);
         }
 
-        glVertexAttribPointer(SHADER_VERT_POS, 3, GL_FLOAT, GL_FALSE,
-                sizeof(struct vertex),
-                (void *) OFFSET_OF(struct vertex, pos));
-        glEnableVertexAttribArray(SHADER_VERT_POS);
-
-        glVertexAttribPointer(SHADER_VERT_NORMAL, 3, GL_FLOAT,
-                GL_FALSE, sizeof(struct vertex),
-                (void *) OFFSET_OF(struct vertex, normal));
-        glEnableVertexAttribArray(SHADER_VERT_NORMAL);
-
-        glVertexAttribPointer(SHADER_VERT_UV, 2, GL_FLOAT, GL_FALSE,
-                sizeof(struct vertex),
-                (void *) OFFSET_OF(struct vertex, uv));
-        glEnableVertexAttribArray(SHADER_VERT_UV);
-
         // instances data
-        glBindBuffer(GL_ARRAY_BUFFER, model->instances.buffer_name);
-
         glEnableVertexAttribArray(SHADER_VERT_INSTANCEPOSITION);
-        glVertexAttribPointer(SHADER_VERT_INSTANCEPOSITION, 3,
-                GL_FLOAT, GL_FALSE, sizeof(struct instance),
-                (void*) (OFFSET_OF(struct instance, position)));
-
         glEnableVertexAttribArray(SHADER_VERT_INSTANCESCALE);
-        glVertexAttribPointer(SHADER_VERT_INSTANCESCALE, 3,
-                GL_FLOAT, GL_FALSE, sizeof(struct instance),
-                (void*) (OFFSET_OF(struct instance, scale)));
-
         glEnableVertexAttribArray(SHADER_VERT_INSTANCEROTATION);
-        glVertexAttribPointer(SHADER_VERT_INSTANCEROTATION, 4,
-                GL_FLOAT, GL_FALSE, sizeof(struct instance),
-                (void*) (OFFSET_OF(struct instance, rotation)));
+        model_point_instance_attributes(model, model->instances.buffer_name,
+                handle_buffer_array_offset(&model->instances));
 
         glVertexAttribDivisor(SHADER_VERT_INSTANCEPOSITION, 1);
         glVertexAttribDivisor(SHADER_VERT_INSTANCESCALE, 1);
         glVertexAttribDivisor(SHADER_VERT_INSTANCEROTATION, 1);
 
-        glBindVertexArray(0);
-        glUseProgram(0);
+        gl_state_bind_vertex_array(0);
+        gl_state_use_program(0);
 
         model->load_state.flags |= LOADABLE_FLAG_LOADED;
     }
@@ -266,9 +456,15 @@ void model_unload(struct model *model)
 
     if (loadable_needs_unloading((struct loadable *) model)) {
 
+        gl_state_forget_vertex_array(model->gpu_side.vao);
         glDeleteVertexArrays(1, &model->gpu_side.vao);
         model->gpu_side.vao = 0;
 
+        gl_state_forget_buffer(model->gpu_side.visible_vbo);
+        glDeleteBuffers(1, &model->gpu_side.visible_vbo);
+        model->gpu_side.visible_vbo = 0;
+        model->gpu_side.visible_capacity = 0;
+
         model->load_state.flags &= ~LOADABLE_FLAG_LOADED;
 
         if (model->geometry) geometry_unload(model->geometry);
@@ -280,62 +476,708 @@ void model_unload(struct model *model)
 
 /**
  * @brief Renders a model's instances to the current OpenGL context.
- * The model should have been loaded.
+ * The model should have been loaded. If its geometry has levels of detail,
+ * instances are drawn with the coarsest level that looks the same from the
+ * camera, with one draw per level. If its geometry was split in meshlets,
+ * the few instances drawn with the full geometry only draw the meshlets that
+ * are in view and face the camera.
  *
  * @param[in] model Drawn model.
+ * @param[in] camera Camera the scene is seen from, used to pick the levels of
+ * detail. Can be null to draw the full geometry.
+ * @param[in] frustum Volume seen by the camera, used to cull the model's
+ * instances if it was asked to. Can be null to draw all instances.
  */
-void model_draw(struct model *model)
+void model_draw(struct model *model, const struct camera *camera,
+        const struct frustum *frustum)
 {
+    GLuint instances_source = model->instances.buffer_name;
+    size_t instances_offset = 0;
+    size_t lod_counts[GEOMETRY_LODS_MAX] = { 0 };
+    size_t lods_nb = 1;
+    size_t index_size = 0;
+    bool culled = false;
+    bool lod_selected = false;
+    bool meshlets_culled = false;
+
+    handle_buffer_array_flush(&model->instances);
+
+    culled = model->culling && frustum && model->geometry;
+    lod_selected = camera && model->geometry
+            && (model->geometry->lods_nb > 1);
+    meshlets_culled = camera && frustum && model->geometry
+            && (array_length(model->geometry->meshlets) > 0);
+
+    if (culled || lod_selected) {
+        if (model_gather_instances(model, camera, lod_selected,
+                    culled ? frustum : nullptr, lod_counts) == 0) {
+            return;
+        }
+        instances_source = model->gpu_side.visible_vbo;
+        lods_nb = lod_selected ? model->geometry->lods_nb : 1;
+    } else {
+        model->nearest_distance = -1.f;
+
+        // streamed instances move around the buffer object
+        lod_counts[0] = array_length(model->instances_array);
+        instances_offset = handle_buffer_array_offset(&model->instances);
+    }
+
     if (model->material) {
-        material_bind_uniform_blocks(model->material, model->shader);
-        material_bind_textures(model->material, model->shader);
+        material_bind_uniform_blocks(model->material);
+        material_bind_textures(model->material);
     }
 
     if (model->geometry) {
         switch ((enum geometry_culling)
                 model->geometry->render_flags.culling) {
             case GEOMETRY_CULL_NONE:
-                glDisable(GL_CULL_FACE);
+                gl_state_capability(GL_CULL_FACE, false);
                 break;
 
             case GEOMETRY_CULL_FRONT:
-                glEnable(GL_CULL_FACE);
-                glCullFace(GL_FRONT);
+                gl_state_capability(GL_CULL_FACE, true);
+                gl_state_cull_face(GL_FRONT);
                 break;
 
             case GEOMETRY_CULL_BACK:
-                glEnable(GL_CULL_FACE);
-                glCullFace(GL_BACK);
+                gl_state_capability(GL_CULL_FACE, true);
+                gl_state_cull_face(GL_BACK);
                 break;
         }
 
         switch ((enum geometry_layering)
                 model->geometry->render_flags.layering) {
             case GEOMETRY_LAYER_NORMAL:
-                glEnable(GL_DEPTH_TEST);
-                glDepthMask(GL_TRUE);
+                gl_state_capability(GL_DEPTH_TEST, true);
+                gl_state_depth_mask(GL_TRUE);
                 break;
 
             case GEOMETRY_LAYER_FRONT:
-                glDisable(GL_DEPTH_TEST);
+                gl_state_capability(GL_DEPTH_TEST, false);
                 break;
 
             case GEOMETRY_LAYER_BACK:
-                glEnable(GL_DEPTH_TEST);
-                glDepthMask(GL_FALSE);
+                gl_state_capability(GL_DEPTH_TEST, true);
+                gl_state_depth_mask(GL_FALSE);
                 break;
 
         }
     }
 
-    glUseProgram(model->shader->program);
-    glBindVertexArray(model->gpu_side.vao);
+    gl_state_use_program(model->shader->program);
+    gl_state_bind_vertex_array(model->gpu_side.vao);
+    if (model->geometry) {
+        geometry_send_position_decoding(model->geometry);
+        index_size = (model->geometry->gpu_side.index_type
+                == GL_UNSIGNED_SHORT) ? sizeof(u16) : sizeof(u32);
+
+        // instances are grouped by level of detail in the instance buffer
+        for (size_t lod = 0 ; lod < lods_nb ; lod++) {
+            size_t first_face = (lods_nb > 1)
+                    ? model->geometry->lods[lod].first_face : 0;
+            size_t nb_indices = (lods_nb > 1)
+                    ? model->geometry->lods[lod].faces_nb * 3
+                    : model->geometry->gpu_side.nb_indices;
+
+            if ((lod == 0) && meshlets_culled && (lod_counts[0] > 0)
+                    && (lod_counts[0] <= MODEL_MESHLET_INSTANCES_MAX)) {
+                // the full geometry's instances come first in both buffers
+                model_draw_meshlets(model, (instances_source
+                                == model->gpu_side.visible_vbo)
+                        ? model->visible_array : model->instances_array,
+                        lod_counts[0], instances_source, instances_offset,
+                        camera, frustum);
+            } else if (lod_counts[lod] > 0) {
+                if ((instances_source != model->gpu_side.instances_source)
+                        || (instances_offset
+                                != model->gpu_side.instances_offset)) {
+                    model_point_instance_attributes(model, instances_source,
+                            instances_offset);
+                }
+
+                glDrawElementsInstanced(GL_TRIANGLES, nb_indices,
+                        model->geometry->gpu_side.index_type,
+                        (void *) (first_face * 3 * index_size),
+                        lod_counts[lod]);
+            }
+
+            instances_offset += lod_counts[lod] * sizeof(struct instance);
+        }
+    }
+
+    // the program and vertex array stay bound : the next draw will only
+    // change what it needs
+
+    handle_buffer_array_fence(&model->instances);
+}
+
+/**
+ * @brief Computes the key used to order the draws of a scene's models.
+ * Models are grouped by layer (back, normal, then front), then by program,
+ * material and texture to avoid state changes, and finally by distance of
+ * their nearest instance to the camera, front to back, so opaque geometry
+ * benefits from early depth rejection. The distance is the one measured when
+ * the model's instances were last gathered, so models that are not culled nor
+ * drawn with levels of detail come first.
+ *
+ * @param[in] model Model drawn this frame.
+ * @param[in] camera Camera the scene is seen from, can be null.
+ * @return u64
+ */
+u64 model_sort_key(const struct model *model, const struct camera *camera)
+{
+    u64 layer = 1;
+    u64 program = 0;
+    u64 material = 0;
+    u64 texture = 0;
+    u64 depth = 0;
+
     if (model->geometry) {
-        glDrawElementsInstanced(GL_TRIANGLES,
-                array_length(model->geometry->faces) * 3,
-                GL_UNSIGNED_INT, 0,
-                array_length(model->instances_array));
+        switch ((enum geometry_layering)
+                model->geometry->render_flags.layering) {
+            case GEOMETRY_LAYER_BACK:
+                layer = 0;
+                break;
+            case GEOMETRY_LAYER_NORMAL:
+                layer = 1;
+                break;
+            case GEOMETRY_LAYER_FRONT:
+                layer = 2;
+                break;
+        }
     }
-    glBindVertexArray(0);
-    glUseProgram(0);
+
+    if (model->shader) {
+        program = model->shader->program;
+    }
+
+    if (model->material) {
+        material = model->material->gpu_side.ubo;
+        for (size_t i = 0 ; i < COUNT_OF(model->material->samplers) ; i++) {
+            if (model->material->samplers[i]) {
+                texture = model->material->samplers[i]->gpu_side.name;
+                break;
+            }
+        }
+    }
+
+    if (camera && (camera->far > 0.f) && (model->nearest_distance > 0.f)) {
+        f32 nearest = fminf(model->nearest_distance, camera->far);
+
+        // buckets are spread on the logarithm of the distance : closer
+        // ranges get finer buckets
+        depth = (u64) ((log2f(1.f + nearest) / log2f(1.f + camera->far))
+                * (f32) ((1u << MODEL_SORT_KEY_DEPTH_BITS) - 1));
+    }
+
+    return ((layer & ((1ull << MODEL_SORT_KEY_LAYER_BITS) - 1))
+                    << MODEL_SORT_KEY_LAYER_SHIFT)
+            | ((program & ((1ull << MODEL_SORT_KEY_PROGRAM_BITS) - 1))
+                    << MODEL_SORT_KEY_PROGRAM_SHIFT)
+            | ((material & ((1ull << MODEL_SORT_KEY_MATERIAL_BITS) - 1))
+                    << MODEL_SORT_KEY_MATERIAL_SHIFT)
+            | ((texture & ((1ull << MODEL_SORT_KEY_TEXTURE_BITS) - 1))
+                    << MODEL_SORT_KEY_TEXTURE_SHIFT)
+            | ((depth & ((1ull << MODEL_SORT_KEY_DEPTH_BITS) - 1))
+                    << MODEL_SORT_KEY_DEPTH_SHIFT);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Points the instance attributes of the model's vertex array to some
+ * buffer object of instances, starting at some offset. The vertex array must
+ * be bound.
+ *
+ * @param[inout] model
+ * @param[in] buffer Buffer object holding the instances.
+ * @param[in] offset Offset of the first instance in the buffer, in bytes.
+ */
+static void model_point_instance_attributes(struct model *model,
+        GLuint buffer, size_t offset)
+{
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+    glVertexAttribPointer(SHADER_VERT_INSTANCEPOSITION, 3,
+            GL_FLOAT, GL_FALSE, sizeof(struct instance),
+            (void*) (offset + OFFSET_OF(struct instance, position)));
+
+    glVertexAttribPointer(SHADER_VERT_INSTANCESCALE, 3,
+            GL_FLOAT, GL_FALSE, sizeof(struct instance),
+            (void*) (offset + OFFSET_OF(struct instance, scale)));
+
+    glVertexAttribPointer(SHADER_VERT_INSTANCEROTATION, 4,
+            GL_FLOAT, GL_FALSE, sizeof(struct instance),
+            (void*) (offset + OFFSET_OF(struct instance, rotation)));
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+    model->gpu_side.instances_source = buffer;
+    model->gpu_side.instances_offset = offset;
+}
+
+/**
+ * @brief Recomputes the world-space bounding spheres of all instances of the
+ * model, as a structure of arrays fed to the culling kernels.
+ *
+ * @param[inout] model
+ */
+static void model_compute_cull_spheres(struct model *model)
+{
+    struct instance_spheres *spheres = &model->cull_spheres;
+
+    array_clear(spheres->x);
+    array_clear(spheres->y);
+    array_clear(spheres->z);
+    array_clear(spheres->radius);
+
+    spheres->dirty = false;
+    model_append_cull_spheres(model);
+}
+
+/**
+ * @brief Computes the bounding spheres of the instances pushed after the last
+ * one with a sphere. Does nothing while the spheres wait to be recomputed.
+ *
+ * @param[inout] model
+ */
+static void model_append_cull_spheres(struct model *model)
+{
+    struct instance_spheres *spheres = &model->cull_spheres;
+    size_t length = array_length(model->instances_array);
+    size_t added = 0;
+
+    if (spheres->dirty || !model->geometry
+            || (array_length(spheres->x) >= length)) {
+        return;
+    }
+
+    added = length - array_length(spheres->x);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &spheres->x, added);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &spheres->y, added);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &spheres->z, added);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &spheres->radius, added);
+
+    for (size_t i = array_length(spheres->x) ; i < length ; i++) {
+        struct vector3 center = { 0 };
+        f32 radius = 0.f;
+
+        instance_bounding_sphere(&model->geometry->bounds,
+                model->instances_array + i, &center, &radius);
+        array_push(spheres->x, &center.x);
+        array_push(spheres->y, &center.y);
+        array_push(spheres->z, &center.z);
+        array_push(spheres->radius, &radius);
+    }
+}
+
+/**
+ * @brief Recomputes the bounding spheres of some moved instances. Does nothing
+ * while the spheres wait to be recomputed.
+ *
+ * @param[inout] model
+ * @param[in] handles Handles to the moved instances, unknown ones are skipped.
+ * @param[in] count Number of handles.
+ */
+static void model_update_cull_spheres(struct model *model,
+        const handle_t *handles, size_t count)
+{
+    struct instance_spheres *spheres = &model->cull_spheres;
+    size_t index = 0;
+
+    if (spheres->dirty || !model->geometry) {
+        return;
+    }
+
+    for (size_t i = 0 ; i < count ; i++) {
+        struct vector3 center = { 0 };
+
+        index = handle_buffer_array_index_of(&model->instances, handles[i]);
+        if (index >= array_length(spheres->x)) {
+            continue;
+        }
+
+        instance_bounding_sphere(&model->geometry->bounds,
+                model->instances_array + index, &center,
+                spheres->radius + index);
+        spheres->x[index] = center.x;
+        spheres->y[index] = center.y;
+        spheres->z[index] = center.z;
+    }
+}
+
+/**
+ * @brief Removes the bounding sphere of a removed instance the same way the
+ * instance was removed : the last sphere takes its place. Does nothing while
+ * the spheres wait to be recomputed.
+ *
+ * @param[inout] model
+ * @param[in] index Position the instance was removed from.
+ */
+static void model_remove_cull_sphere(struct model *model, size_t index)
+{
+    struct instance_spheres *spheres = &model->cull_spheres;
+
+    if (spheres->dirty || (index >= array_length(spheres->x))) {
+        return;
+    }
+
+    array_remove_swapback(spheres->x, index);
+    array_remove_swapback(spheres->y, index);
+    array_remove_swapback(spheres->z, index);
+    array_remove_swapback(spheres->radius, index);
+}
+
+/**
+ * @brief Gathers the instances of the model drawn this frame, grouped by level
+ * of detail, and sends them to the model's draw-time buffer object. The
+ * instances' spheres are only recomputed when the instances changed. The
+ * distance to the nearest gathered instance is kept to order the next draw.
+ *
+ * @param[inout] model
+ * @param[in] camera Camera the scene is seen from, can be null.
+ * @param[in] lod_selected Whether the camera picks the levels of detail,
+ * instead of drawing all instances with the full geometry.
+ * @param[in] frustum Volume seen by the camera, null to keep all instances.
+ * @param[out] out_lod_counts Filled with the number of instances drawn with
+ * each level of detail.
+ * @return size_t Number of instances drawn.
+ */
+static size_t model_gather_instances(struct model *model,
+        const struct camera *camera, bool lod_selected,
+        const struct frustum *frustum,
+        size_t out_lod_counts[GEOMETRY_LODS_MAX])
+{
+    size_t instances_nb = array_length(model->instances_array);
+    size_t lods_nb = lod_selected ? model->geometry->lods_nb : 1;
+    f32 error_per_distance = 0.f;
+    size_t needed_capacity = 0;
+    size_t visible_nb = 0;
+
+    if (model->cull_spheres.dirty) {
+        model_compute_cull_spheres(model);
+    }
+
+    array_clear(model->visible_indices);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &model->visible_indices, instances_nb);
+    if (frustum) {
+        visible_nb = frustum_cull_spheres(frustum, &model->cull_spheres,
+                model->visible_indices);
+    } else {
+        for (u32 i = 0 ; i < instances_nb ; i++) {
+            array_push(model->visible_indices, &i);
+        }
+        visible_nb = instances_nb;
+    }
+
+    model->nearest_distance = -1.f;
+    if (visible_nb == 0) {
+        return 0;
+    }
+
+    // screen height covered at a distance of 1, from the fov in degrees
+    if (lod_selected) {
+        error_per_distance = 2.f * tanf(camera->fov * (3.14159265f / 360.f))
+                * MODEL_LOD_SCREEN_ERROR;
+    }
+
+    array_clear(model->visible_lods);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &model->visible_lods, visible_nb);
+    for (size_t i = 0 ; i < visible_nb ; i++) {
+        f32 distance = 0.f;
+        u8 lod = 0;
+
+        if (camera) {
+            distance = model_instance_distance(model,
+                    model->visible_indices[i], camera->pos);
+            if ((model->nearest_distance < 0.f)
+                    || (distance < model->nearest_distance)) {
+                model->nearest_distance = distance;
+            }
+        }
+        if (lods_nb > 1) {
+            lod = model_instance_lod(model, model->visible_indices[i],
+                    distance, error_per_distance);
+        }
+
+        array_push(model->visible_lods, &lod);
+        out_lod_counts[lod] += 1;
+    }
+
+    array_clear(model->visible_array);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &model->visible_array, visible_nb);
+    for (size_t lod = 0 ; lod < lods_nb ; lod++) {
+        for (size_t i = 0 ; (i < visible_nb) && (out_lod_counts[lod] > 0) ;
+                i++) {
+            if (model->visible_lods[i] == lod) {
+                array_push(model->visible_array,
+                        model->instances_array + model->visible_indices[i]);
+            }
+        }
+    }
+
+    needed_capacity = array_length(model->visible_array)
+            * sizeof(*model->visible_array);
+    if (needed_capacity > model->gpu_side.visible_capacity) {
+        model->gpu_side.visible_capacity = array_capacity(model->visible_array)
+                * sizeof(*model->visible_array);
+    }
+
+    // orphan last frame's storage instead of waiting for the GPU to be done
+    // with it
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, model->gpu_side.visible_vbo);
+    glBufferData(GL_ARRAY_BUFFER, model->gpu_side.visible_capacity, nullptr,
+            GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, needed_capacity, model->visible_array);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+    return array_length(model->visible_array);
+}
+
+/**
+ * @brief Measures the distance from the camera to the surface of the bounding
+ * sphere of an instance, the nearest the geometry can be. Zero when the camera
+ * is inside the sphere.
+ *
+ * @param[in] model
+ * @param[in] instance Index of the instance, with its bounding sphere computed.
+ * @param[in] eye Position of the camera.
+ * @return f32
+ */
+static f32 model_instance_distance(const struct model *model, size_t instance,
+        struct vector3 eye)
+{
+    const struct instance_spheres *spheres = &model->cull_spheres;
+    f32 dx = spheres->x[instance] - eye.x;
+    f32 dy = spheres->y[instance] - eye.y;
+    f32 dz = spheres->z[instance] - eye.z;
+
+    return fmaxf(sqrtf((dx * dx) + (dy * dy) + (dz * dz))
+            - spheres->radius[instance], 0.f);
+}
+
+/**
+ * @brief Picks the coarsest level of detail of the model's geometry whose
+ * error, scaled like the instance and seen from the camera, stays under
+ * MODEL_LOD_SCREEN_ERROR.
+ *
+ * @param[in] model
+ * @param[in] instance Index of the instance, with its bounding sphere computed.
+ * @param[in] distance Distance from the camera to the instance.
+ * @param[in] error_per_distance Error allowed for each unit of distance from
+ * the camera.
+ * @return u8
+ */
+static u8 model_instance_lod(const struct model *model, size_t instance,
+        f32 distance, f32 error_per_distance)
+{
+    const struct instance_spheres *spheres = &model->cull_spheres;
+    const struct geometry *geometry = model->geometry;
+    f32 scale = 1.f;
+
+    if (distance <= 0.f) {
+        return 0;
+    }
+
+    if (geometry->bounds.radius > 0.f) {
+        scale = spheres->radius[instance] / geometry->bounds.radius;
+    }
+
+    for (u8 lod = (u8) (geometry->lods_nb - 1) ; lod > 0 ; lod--) {
+        if ((geometry->lods[lod].error * scale)
+                <= (distance * error_per_distance)) {
+            return lod;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Draws some instances of the model's full geometry one by one, each
+ * with only its meshlets in view of the camera, as ranges of the index buffer.
+ * The vertex array must be bound.
+ *
+ * @param[inout] model
+ * @param[in] instances Drawn instances, as they are in the buffer object.
+ * @param[in] instances_nb Number of drawn instances.
+ * @param[in] instances_source Buffer object holding the instances.
+ * @param[in] instances_offset Offset of the first instance in the buffer, in
+ * bytes.
+ * @param[in] camera Camera the scene is seen from.
+ * @param[in] frustum Volume seen by the camera.
+ */
+static void model_draw_meshlets(struct model *model,
+        const struct instance *instances, size_t instances_nb,
+        GLuint instances_source, size_t instances_offset,
+        const struct camera *camera, const struct frustum *frustum)
+{
+    GLenum index_type = model->geometry->gpu_side.index_type;
+    size_t index_size = (index_type == GL_UNSIGNED_SHORT)
+            ? sizeof(u16) : sizeof(u32);
+    size_t ranges_nb = 0;
+
+    for (size_t i = 0 ; i < instances_nb ; i++) {
+        ranges_nb = model_cull_meshlets(model, instances + i, camera, frustum);
+        if (ranges_nb == 0) {
+            continue;
+        }
+
+        model_point_instance_attributes(model, instances_source,
+                instances_offset + (i * sizeof(struct instance)));
+
+        for (size_t j = 0 ; j < ranges_nb ; j++) {
+            glDrawElementsInstanced(GL_TRIANGLES,
+                    model->visible_ranges[(j * 2) + 1] * 3, index_type,
+                    (void *) ((size_t) model->visible_ranges[j * 2] * 3
+                            * index_size), 1);
+        }
+    }
+}
+
+/**
+ * @brief Lists the ranges of faces of the model's meshlets seen from the
+ * camera for some instance, merging neighbouring meshlets. The camera and the
+ * frustum are brought in the geometry's space once, so each meshlet is tested
+ * as it was built. Meshlets facing away are only dropped for geometries
+ * culling their back faces, and instances that are not mirrored.
+ *
+ * @param[inout] model
+ * @param[in] instance Tested instance.
+ * @param[in] camera Camera the scene is seen from.
+ * @param[in] frustum Volume seen by the camera.
+ * @return size_t Number of ranges in the model's visible_ranges.
+ */
+static size_t model_cull_meshlets(struct model *model,
+        const struct instance *instance, const struct camera *camera,
+        const struct frustum *frustum)
+{
+    const struct geometry *geometry = model->geometry;
+    struct vector3 scale = instance->scale;
+    f32 planes[6][4] = { 0 };
+    f32 planes_scale[6] = { 0 };
+    struct vector3 eye = { 0 };
+    bool cone_culled = false;
+    u32 range_start = 0;
+    u32 range_end = 0;
+
+    array_clear(model->visible_ranges);
+
+    // world positions are position + scale * rotate(local) : a plane n.w + d
+    // is rotate_back(scale * n).local + (n.position + d) in the geometry
+    for (size_t i = 0 ; i < 6 ; i++) {
+        const f32 *plane = frustum->planes[i];
+        struct vector3 normal = model_rotate_back(instance->rotation,
+                (struct vector3) { plane[0] * scale.x, plane[1] * scale.y,
+                        plane[2] * scale.z });
+
+        planes[i][0] = normal.x;
+        planes[i][1] = normal.y;
+        planes[i][2] = normal.z;
+        planes[i][3] = plane[3] + (plane[0] * instance->position.x)
+                + (plane[1] * instance->position.y)
+                + (plane[2] * instance->position.z);
+        planes_scale[i] = sqrtf((normal.x * normal.x) + (normal.y * normal.y)
+                + (normal.z * normal.z));
+    }
+
+    cone_culled = ((enum geometry_culling) geometry->render_flags.culling
+                    == GEOMETRY_CULL_BACK)
+            && (scale.x > 0.f) && (scale.y > 0.f) && (scale.z > 0.f);
+    if (cone_culled) {
+        eye = model_rotate_back(instance->rotation, (struct vector3) {
+                (camera->pos.x - instance->position.x) / scale.x,
+                (camera->pos.y - instance->position.y) / scale.y,
+                (camera->pos.z - instance->position.z) / scale.z });
+    }
+
+    for (size_t i = 0 ; i < array_length(geometry->meshlets) ; i++) {
+        const struct geometry_meshlet *meshlet = geometry->meshlets + i;
+        bool visible = true;
+
+        for (size_t j = 0 ; (j < 6) && visible ; j++) {
+            visible = ((planes[j][0] * meshlet->center.x)
+                    + (planes[j][1] * meshlet->center.y)
+                    + (planes[j][2] * meshlet->center.z) + planes[j][3])
+                    >= -(meshlet->radius * planes_scale[j]);
+        }
+
+        if (visible && cone_culled) {
+            f32 dx = meshlet->center.x - eye.x;
+            f32 dy = meshlet->center.y - eye.y;
+            f32 dz = meshlet->center.z - eye.z;
+
+            visible = ((dx * meshlet->cone_axis.x) + (dy * meshlet->cone_axis.y)
+                    + (dz * meshlet->cone_axis.z))
+                    < ((meshlet->cone_cutoff
+                            * sqrtf((dx * dx) + (dy * dy) + (dz * dz)))
+                            + meshlet->radius);
+        }
+
+        if (!visible) {
+            continue;
+        }
+
+        if ((range_end != range_start) && (meshlet->first_face == range_end)) {
+            range_end += meshlet->faces_nb;
+            continue;
+        }
+
+        if (range_end != range_start) {
+            array_ensure_capacity(make_system_allocator(),
+                    (ARRAY_ANY *) &model->visible_ranges, 2);
+            array_push(model->visible_ranges, &range_start);
+            range_end -= range_start;
+            array_push(model->visible_ranges, &range_end);
+        }
+        range_start = meshlet->first_face;
+        range_end = meshlet->first_face + meshlet->faces_nb;
+    }
+
+    if (range_end != range_start) {
+        array_ensure_capacity(make_system_allocator(),
+                (ARRAY_ANY *) &model->visible_ranges, 2);
+        array_push(model->visible_ranges, &range_start);
+        range_end -= range_start;
+        array_push(model->visible_ranges, &range_end);
+    }
+
+    return array_length(model->visible_ranges) / 2;
+}
+
+/**
+ * @brief Rotates a vector by the inverse of a rotation, as in vert_head.glsl
+ * with the conjugate quaternion.
+ *
+ * @param[in] q Unit quaternion of the rotation.
+ * @param[in] v Rotated vector.
+ * @return struct vector3
+ */
+static struct vector3 model_rotate_back(struct quaternion q, struct vector3 v)
+{
+    struct vector3 c = { 0 };
+
+    q.x = -q.x;
+    q.y = -q.y;
+    q.z = -q.z;
+
+    // v + 2 * cross(cross(v, q.xyz) + q.w * v, q.xyz)
+    c.x = ((v.y * q.z) - (v.z * q.y)) + (q.w * v.x);
+    c.y = ((v.z * q.x) - (v.x * q.z)) + (q.w * v.y);
+    c.z = ((v.x * q.y) - (v.y * q.x)) + (q.w * v.z);
+
+    return (struct vector3) {
+            v.x + (2.f * ((c.y * q.z) - (c.z * q.y))),
+            v.y + (2.f * ((c.z * q.x) - (c.x * q.z))),
+            v.z + (2.f * ((c.x * q.y) - (c.y * q.x))),
+    };
 }
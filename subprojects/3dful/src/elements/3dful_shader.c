@@ -12,6 +12,7 @@
 #include "3dful_core.h"
 
 #include <ustd/array.h>
+#include <ustd/hashmap.h>
 #include <ustd/res.h>
 
 // -----------------------------------------------------------------------------
@@ -30,6 +31,32 @@ DECLARE_RES(fragment_tail, "res_shaders_wrapper_frag_tail_glsl")
 static char static_shader_diagnostic_buffer[SHADER_DIAGNOSTIC_MAX_LENGTH] =
         { 0 };
 
+/// Longest uniform name read back from a linked program.
+#define SHADER_UNIFORM_NAME_MAX_LENGTH (128)
+
+/**
+ * @brief Map of uniform blocks binding points to their name in a shader
+ * program.
+ */
+static const char *shader_ubo_names[SHADER_UBOS_NUMBER] = {
+        [SHADER_UBO_MATERIAL]    = "BLOCK_MATERIAL",
+        [SHADER_UBO_LIGHT_DIREC] = "BLOCK_LIGHT_DIRECTIONALS",
+        [SHADER_UBO_LIGHT_POINT] = "BLOCK_LIGHT_POINTS",
+        [SHADER_UBO_FRAME]       = "BLOCK_FRAME",
+};
+
+/**
+ * @brief Map of sampler enumeration values to their expected name in a shade
+ * program.
+ */
+static const char *shader_sampler_names[MATERIAL_BASE_SAMPLERS_NUMBER] = {
+        [MATERIAL_BASE_SAMPLER_AMBIENT_MASK]  = "ambient_mask",
+        [MATERIAL_BASE_SAMPLER_SPECULAR_MASK] = "specular_mask",
+        [MATERIAL_BASE_SAMPLER_DIFFUSE_MASK]  = "diffuse_mask",
+        [MATERIAL_BASE_SAMPLER_EMISSIVE_MASK] = "emissive_mask",
+        [MATERIAL_BASE_SAMPLER_TEXTURE]       = "base_texture",
+};
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
@@ -39,6 +66,7 @@ static GLuint shader_compile(const byte *shader_source, size_t length,
         GLenum kind);
 static GLuint shader_material_compile(const byte *shader_source, size_t length,
         GLenum kind);
+static void shader_reflect(struct shader *shader);
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -109,16 +137,46 @@ void shader_frag_mem(struct shader *shader, const byte *source,
 void shader_uniform_float(struct shader *shader, const char *name,
         float value)
 {
-    GLint loc = 0;
+    GLint loc = shader_uniform_location(shader, name);
 
-    glUseProgram(shader->program);
-    loc = glGetUniformLocation(shader->program, name);
+    if (loc < 0) {
+        return;
+    }
+
+    gl_state_use_program(shader->program);
     glUniform1f(loc, value);
 }
 
+/**
+ * @brief Returns the location of an active uniform of a linked shader program,
+ * or -1 if the program has no such uniform. The lookup does not query OpenGL.
+ *
+ * @param[in] shader Linked shader.
+ * @param[in] name Name of the uniform.
+ * @return GLint
+ */
+GLint shader_uniform_location(const struct shader *shader, const char *name)
+{
+    size_t pos = 0;
+
+    if (!shader->uniforms_by_name) {
+        return -1;
+    }
+
+    pos = hashmap_index_of(shader->uniforms_by_name, name);
+
+    if (pos < array_length(shader->uniforms_by_name)) {
+        return shader->uniforms_by_name[pos];
+    }
+
+    return -1;
+}
+
 /**
  * @brief Links a shader program, assembling the vertex part and fragment part
  * into one usable program.
+ * The locations of the program's uniforms are read once here, and the uniform
+ * blocks and samplers are given their fixed binding points and texture units.
  *
  * @param[inout] shader Linked shader.
  */
@@ -132,7 +190,10 @@ void shader_link(struct shader *shader)
 
     if (!check_shader_linking(shader->program)) {
         shader->program = 0;
+        return;
     }
+
+    shader_reflect(shader);
 }
 
 /**
@@ -145,10 +206,16 @@ void shader_delete(struct shader *shader)
 {
     glDetachShader(shader->program, shader->frag_shader);
     glDetachShader(shader->program, shader->vert_shader);
+    gl_state_forget_program(shader->program);
     glDeleteProgram(shader->program);
     glDeleteShader(shader->frag_shader);
     glDeleteShader(shader->vert_shader);
 
+    if (shader->uniforms_by_name) {
+        hashmap_destroy(make_system_allocator(),
+                (HASHMAP_ANY *) &shader->uniforms_by_name);
+    }
+
     *shader = (struct shader) { 0 };
 }
 
@@ -290,3 +357,70 @@ static GLuint shader_material_compile(const byte *shader_source, size_t length,
 
     return out_shader;
 }
+
+/**
+ * @brief Fills the reflection data of a freshly linked shader : the locations
+ * of all its active uniforms. The uniform
+ * blocks and samplers the engine knows about are bound to their fixed binding
+ * points and texture units, so drawing never needs to look them up.
+ *
+ * @param[inout] shader
+ */
+static void shader_reflect(struct shader *shader)
+{
+    struct allocator alloc = make_system_allocator();
+    GLint nb_uniforms = 0;
+    GLint size = 0;
+    GLenum type = GL_NONE;
+    GLint location = -1;
+    GLuint block_index = GL_INVALID_INDEX;
+    char name[SHADER_UNIFORM_NAME_MAX_LENGTH] = { 0 };
+
+    if (shader->uniforms_by_name) {
+        hashmap_destroy(alloc, (HASHMAP_ANY *) &shader->uniforms_by_name);
+    }
+
+    glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &nb_uniforms);
+    shader->uniforms_by_name = hashmap_create(alloc,
+            sizeof(*shader->uniforms_by_name), (size_t) nb_uniforms + 1);
+
+    for (GLint i = 0 ; i < nb_uniforms ; i++) {
+        glGetActiveUniform(shader->program, (GLuint) i, sizeof(name), nullptr,
+                &size, &type, name);
+        location = glGetUniformLocation(shader->program, name);
+
+        // members of uniform blocks have no location
+        if (location < 0) {
+            continue;
+        }
+
+        // arrays are reported as "name[0]", but are also reachable as "name"
+        for (size_t c = 0 ; name[c] != '\0' ; c++) {
+            if (name[c] == '[') {
+                name[c] = '\0';
+                break;
+            }
+        }
+
+        hashmap_ensure_capacity(alloc,
+                (HASHMAP_ANY *) &shader->uniforms_by_name, 1);
+        hashmap_set(shader->uniforms_by_name, name, &location);
+    }
+
+    for (size_t i = 0 ; i < SHADER_UBOS_NUMBER ; i++) {
+        block_index = glGetUniformBlockIndex(shader->program,
+                shader_ubo_names[i]);
+        if (block_index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shader->program, block_index, i);
+        }
+    }
+
+    gl_state_use_program(shader->program);
+    for (size_t i = 0 ; i < MATERIAL_BASE_SAMPLERS_NUMBER ; i++) {
+        location = shader_uniform_location(shader, shader_sampler_names[i]);
+        if (location >= 0) {
+            glUniform1i(location, (GLint) i);
+        }
+    }
+    gl_state_use_program(0);
+}
@@ -11,15 +11,37 @@
 
 #include "3dful_core.h"
 
+#include <stdio.h>
+#include <string.h>
+
 #include <ustd/array.h>
 
+#include "texture_processing/3dful_texture_processing.h"
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
 static void texture_load_as_2D(struct texture *texture);
 static void texture_load_as_cubemap(struct texture *texture);
 static void texture_reload(struct texture *texture);
+static bool texture_leave_pool(struct texture *texture);
 static GLenum format_from_surface(struct SDL_Surface *s);
+static void texture_decode_task(void *data);
+static void texture_cancel_decoding(struct texture *texture);
+
+static void texture_attach_image(struct texture *texture,
+        SDL_Surface **slot, SDL_Surface *image);
+static void texture_release_pixels(struct texture *texture);
+static void texture_restore_pixels(struct texture *texture);
+static bool texture_map_baked(struct texture *texture);
+static void texture_drop_baked(struct texture *texture);
+static size_t surface_bytes(const SDL_Surface *s);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Memory taken by all textures, kept up to date as images come and go. */
+static struct texture_memory_stats texture_memory = { 0 };
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
@@ -33,11 +55,13 @@ void texture_2D_default(struct texture *texture)
 {
     struct SDL_Surface *def = nullptr;
 
+    texture_cancel_decoding(texture);
+
     def = SDL_CreateRGBSurface(0, 2, 2, 32, 0, 0, 0, 0);
     SDL_FillRect(def, nullptr, 0xffffffff);
 
     texture->flavor = TEXTURE_FLAVOR_2D;
-    texture->specific.image_for_2D = def;
+    texture_attach_image(texture, &texture->specific.image_for_2D, def);
 }
 
 /**
@@ -48,10 +72,18 @@ void texture_2D_default(struct texture *texture)
  */
 void texture_2D_file(struct texture *texture, const char *path)
 {
-    texture->flavor = TEXTURE_FLAVOR_2D;
-    texture->specific.image_for_2D = IMG_Load(path);
+    texture_cancel_decoding(texture);
 
-    texture_reload(texture);
+    texture->flavor = TEXTURE_FLAVOR_2D;
+    texture->source.buffer = nullptr;
+    texture->source.length = 0;
+    texture_drop_baked(texture);
+    texture_attach_image(texture, &texture->specific.image_for_2D,
+            IMG_Load(path));
+
+    if (!texture_leave_pool(texture)) {
+        texture_reload(texture);
+    }
 }
 
 /**
@@ -65,12 +97,176 @@ void texture_2D_file_mem(struct texture *texture, const byte *image_buffer,
 {
     SDL_RWops *mem_rw = SDL_RWFromMem((void *) image_buffer, length);
 
+    texture_cancel_decoding(texture);
+
     texture->flavor = TEXTURE_FLAVOR_2D;
-    texture->specific.image_for_2D = IMG_Load_RW(mem_rw, 0);
+    texture->source.buffer = image_buffer;
+    texture->source.length = length;
+    texture_drop_baked(texture);
+    texture_attach_image(texture, &texture->specific.image_for_2D,
+            IMG_Load_RW(mem_rw, 0));
 
     SDL_RWclose(mem_rw);
 
-    texture_reload(texture);
+    if (!texture_leave_pool(texture)) {
+        texture_reload(texture);
+    }
+}
+
+/**
+ * @brief Starts decoding a texture from a buffer on the worker threads, so
+ * the calling thread can go on. The texture is plain white until
+ * texture_finish_decoding() swaps the decoded image in, and the buffer must
+ * stay valid until then. The decoded image can also be baked to a file by
+ * the worker threads, compressed or not, to be loaded next time with
+ * texture_2D_baked().
+ *
+ * @param[out] texture Object receiving the texture.
+ * @param[in] image_buffer Buffer containing a read image file.
+ * @param[in] length Length of the buffer, in bytes.
+ * @param[in] bake_path Optional, path to the baked texture file to write.
+ * @param[in] source_hash Hash of the buffer, tagging the baked texture.
+ * @param[in] compression Compression of the baked texture.
+ */
+void texture_2D_file_mem_async(struct texture *texture,
+        const byte *image_buffer, size_t length, const char *bake_path,
+        u64 source_hash, enum texture_compression compression)
+{
+    struct allocator alloc = make_system_allocator();
+
+    texture_cancel_decoding(texture);
+    texture_drop_baked(texture);
+
+    if (!texture->specific.image_for_2D) {
+        texture_2D_default(texture);
+    }
+    texture->flavor = TEXTURE_FLAVOR_2D;
+
+    // the placeholder is sent on its own until the image is decoded
+    texture_leave_pool(texture);
+
+    if (!image_buffer) {
+        fprintf(stderr, "no image to decode the texture from\n");
+        return;
+    }
+
+    texture->source.buffer = image_buffer;
+    texture->source.length = length;
+    texture->decoding.buffer = image_buffer;
+    texture->decoding.length = length;
+
+    if (bake_path) {
+        texture->baked.path = alloc.malloc(alloc, strlen(bake_path) + 1);
+        if (texture->baked.path) {
+            strcpy(texture->baked.path, bake_path);
+            texture->baked.source_hash = source_hash;
+            texture->baked.compression = compression;
+            texture->decoding.bake = true;
+        }
+    }
+
+    workers_push(&texture->decoding.group, &texture_decode_task, texture);
+}
+
+/**
+ * @brief Loads a 2D texture from a baked texture file, if it exists and was
+ * baked from the data described by some hash with some compression. The file
+ * is mapped in memory, and its pixels and mip levels are sent to the GPU as
+ * they are.
+ * Returns false, leaving the texture untouched, if the file cannot be used.
+ *
+ * @param[inout] texture Object receiving the texture.
+ * @param[in] path Path to the baked texture file.
+ * @param[in] source_hash Hash of the data the texture should come from.
+ * @param[in] compression Compression the texture should have.
+ * @return bool
+ */
+bool texture_2D_baked(struct texture *texture, const char *path,
+        u64 source_hash, enum texture_compression compression)
+{
+    struct allocator alloc = make_system_allocator();
+    const byte *mapped = nullptr;
+    size_t length = 0;
+
+    if (!texture_baked_map(path, source_hash, compression, &mapped,
+                &length)) {
+        return false;
+    }
+
+    texture_cancel_decoding(texture);
+    texture_drop_baked(texture);
+
+    texture->baked.path = alloc.malloc(alloc, strlen(path) + 1);
+    if (!texture->baked.path) {
+        texture_baked_unmap(mapped, length);
+        return false;
+    }
+    strcpy(texture->baked.path, path);
+    texture->baked.source_hash = source_hash;
+    texture->baked.compression = compression;
+    texture->baked.mapped = mapped;
+    texture->baked.length = length;
+    texture_memory.cpu_bytes += length;
+
+    texture->flavor = TEXTURE_FLAVOR_2D;
+    texture->source.buffer = nullptr;
+    texture->source.length = 0;
+    texture_attach_image(texture, &texture->specific.image_for_2D, nullptr);
+
+    if (!texture_leave_pool(texture)) {
+        texture_reload(texture);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Swaps in the image of a texture decoded by the worker threads, if it
+ * is ready, and sends it to the GPU if the texture is loaded. Must be called
+ * from the thread owning the OpenGL context. Returns false while the image is
+ * still being decoded.
+ *
+ * @param[inout] texture Decoded texture.
+ * @return bool
+ */
+bool texture_finish_decoding(struct texture *texture)
+{
+    if (!texture->decoding.buffer) {
+        return true;
+    }
+
+    if (!workers_done(&texture->decoding.group)) {
+        return false;
+    }
+
+    // a freshly baked texture is used from its file straight away, and the
+    // decoded image otherwise, so its pixels keep the same shape when they
+    // are released and restored
+    if (texture->decoding.image && texture->decoding.bake
+            && texture_map_baked(texture)) {
+        SDL_FreeSurface(texture->decoding.image);
+        texture_attach_image(texture, &texture->specific.image_for_2D,
+                nullptr);
+    } else {
+        texture_drop_baked(texture);
+        // the placeholder stays if the image could not be decoded
+        if (texture->decoding.image) {
+            texture_attach_image(texture, &texture->specific.image_for_2D,
+                    texture->decoding.image);
+        }
+    }
+
+    texture->decoding.buffer = nullptr;
+    texture->decoding.length = 0;
+    texture->decoding.image = nullptr;
+    texture->decoding.bake = false;
+
+    if (texture->load_state.flags & LOADABLE_FLAG_LOADED) {
+        texture_load_as_2D(texture);
+        texture_release_pixels(texture);
+    }
+
+    return true;
 }
 
 /**
@@ -84,8 +280,11 @@ void texture_2D_file_mem(struct texture *texture, const byte *image_buffer,
 void texture_cubemap_file(struct texture *texture, enum cubemap_face face,
         const char *path)
 {
+    texture_cancel_decoding(texture);
+
     texture->flavor = TEXTURE_FLAVOR_CUBEMAP;
-    texture->specific.images_for_cubemap[face] = IMG_Load(path);
+    texture_attach_image(texture, texture->specific.images_for_cubemap + face,
+            IMG_Load(path));
 
     texture_reload(texture);
 }
@@ -103,8 +302,11 @@ void texture_cubemap_file_mem(struct texture *texture, enum cubemap_face face,
 {
     SDL_RWops *mem_rw = SDL_RWFromMem((void *) image_buffer, length);
 
+    texture_cancel_decoding(texture);
+
     texture->flavor = TEXTURE_FLAVOR_CUBEMAP;
-    texture->specific.images_for_cubemap[face] = IMG_Load_RW(mem_rw, 0);
+    texture_attach_image(texture, texture->specific.images_for_cubemap + face,
+            IMG_Load_RW(mem_rw, 0));
 
     SDL_RWclose(mem_rw);
 
@@ -120,17 +322,64 @@ void texture_delete(struct texture *texture)
 {
     size_t nb_textures = 0;
 
+    workers_wait(&texture->decoding.group);
+    texture_pool_leave(texture);
+    SDL_FreeSurface(texture->decoding.image);
+    texture_drop_baked(texture);
+
     switch (texture->flavor) {
         case TEXTURE_FLAVOR_2D:
-            SDL_FreeSurface(texture->specific.image_for_2D);
+            texture_attach_image(texture, &texture->specific.image_for_2D,
+                    nullptr);
             break;
         case TEXTURE_FLAVOR_CUBEMAP:
             nb_textures = COUNT_OF(texture->specific.images_for_cubemap);
             for (size_t i = 0 ; i < nb_textures ; i++) {
-                SDL_FreeSurface(texture->specific.images_for_cubemap[i]);
+                texture_attach_image(texture,
+                        texture->specific.images_for_cubemap + i, nullptr);
             }
             break;
     }
+
+    texture_memory.released_bytes -= texture->released_bytes;
+    texture->released_bytes = 0;
+}
+
+/**
+ * @brief Sets where the pixels of a texture live once it is sent to the GPU.
+ * Only 2D textures read from a buffer or from a baked texture file can
+ * release their pixels, as they are mapped or decoded again when needed : the
+ * buffer must stay valid as long as the texture. Other textures always keep
+ * their pixels.
+ *
+ * @param[inout] texture Modified texture.
+ * @param[in] residency New policy.
+ */
+void texture_set_residency(struct texture *texture,
+        enum texture_residency residency)
+{
+    texture->residency = residency;
+
+    switch (residency) {
+        case TEXTURE_RESIDENCY_KEEP_CPU:
+            texture_restore_pixels(texture);
+            break;
+        case TEXTURE_RESIDENCY_GPU_ONLY:
+            texture_release_pixels(texture);
+            break;
+    }
+}
+
+/**
+ * @brief Returns the memory taken by all textures, in system memory and on
+ * the GPU, and how much was saved by releasing the pixels of textures that
+ * only live on the GPU.
+ *
+ * @return struct texture_memory_stats
+ */
+struct texture_memory_stats texture_get_memory_stats(void)
+{
+    return texture_memory;
 }
 
 /**
@@ -143,18 +392,25 @@ void texture_load(struct texture *texture)
     loadable_add_user((struct loadable *) texture);
 
     if (loadable_needs_loading((struct loadable *) texture)) {
-        glGenTextures(1, &texture->gpu_side.name);
-
         switch (texture->flavor) {
         case TEXTURE_FLAVOR_2D:
-            texture_load_as_2D(texture);
+            if (texture->pooled.page) {
+                texture_pool_use(texture);
+            } else {
+                glGenTextures(1, &texture->gpu_side.name);
+                texture_restore_pixels(texture);
+                texture_load_as_2D(texture);
+            }
             break;
         case TEXTURE_FLAVOR_CUBEMAP:
+            glGenTextures(1, &texture->gpu_side.name);
             texture_load_as_cubemap(texture);
             break;
         }
 
         texture->load_state.flags |= LOADABLE_FLAG_LOADED;
+
+        texture_release_pixels(texture);
     }
 }
 
@@ -169,39 +425,255 @@ void texture_unload(struct texture *texture)
 
     if (loadable_needs_unloading((struct loadable *) texture)) {
 
-        glDeleteTextures(1, &texture->gpu_side.name);
+        // the array texture of a pool page is shared with other textures
+        if (texture->pooled.resident) {
+            texture_pool_unuse(texture);
+        } else {
+            gl_state_forget_texture(texture->gpu_side.name);
+            glDeleteTextures(1, &texture->gpu_side.name);
+        }
         texture->gpu_side.name = 0;
+        texture_memory.gpu_bytes -= texture->gpu_side.bytes;
+        texture->gpu_side.bytes = 0;
 
         texture->load_state.flags &= ~LOADABLE_FLAG_LOADED;
     }
 }
 
+/**
+ * @brief Tells the format, size and mip levels of the pixels a 2D texture
+ * sends to the GPU. Images are sent as RGBA, with their mip levels generated.
+ * Returns false if the texture is not a 2D texture with its pixels decoded.
+ *
+ * @param[inout] texture Described texture, its released pixels brought back
+ * for the time being.
+ * @param[out] out_shape Shape of the pixels.
+ * @return bool
+ */
+bool texture_describe(struct texture *texture, struct texture_shape *out_shape)
+{
+    struct texture_baked_layout layout = { 0 };
+    bool described = true;
+
+    if ((texture->flavor != TEXTURE_FLAVOR_2D) || texture->decoding.buffer) {
+        return false;
+    }
+
+    texture_restore_pixels(texture);
+
+    if (texture->baked.mapped) {
+        texture_baked_read(texture->baked.mapped, &layout);
+        *out_shape = (struct texture_shape) {
+                .internal_format = layout.internal_format,
+                .format = layout.format,
+                .width = layout.levels[0].width,
+                .height = layout.levels[0].height,
+                .levels_nb = (u32) layout.levels_nb,
+                .compressed = layout.compressed,
+        };
+    } else if (texture->specific.image_for_2D) {
+        *out_shape = (struct texture_shape) {
+                .internal_format = GL_RGBA8,
+                .format = GL_RGBA,
+                .width = (u32) texture->specific.image_for_2D->w,
+                .height = (u32) texture->specific.image_for_2D->h,
+                .levels_nb = 1,
+        };
+    } else {
+        described = false;
+    }
+
+    texture_release_pixels(texture);
+
+    return described;
+}
+
+/**
+ * @brief Sends the pixels of a 2D texture to a region of a layer of the array
+ * texture bound to the first unit, with up to some mip levels. Returns false
+ * if the texture gave fewer levels, which are then left to be generated.
+ *
+ * @param[inout] texture Sent texture, its released pixels brought back for
+ * the time being.
+ * @param[in] layer Layer of the array texture.
+ * @param[in] x Left of the region, in pixels of the first level.
+ * @param[in] y Bottom of the region, in pixels of the first level.
+ * @param[in] levels_nb Number of levels of the array texture.
+ * @return bool
+ */
+bool texture_upload_to_layer(struct texture *texture, u32 layer, u32 x, u32 y,
+        u32 levels_nb)
+{
+    struct texture_baked_layout layout = { 0 };
+    SDL_Surface *image = nullptr;
+    SDL_Surface *converted = nullptr;
+    bool complete = false;
+
+    texture_restore_pixels(texture);
+
+    // rows of baked levels are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (texture->baked.mapped) {
+        texture_baked_read(texture->baked.mapped, &layout);
+
+        for (size_t i = 0 ; (i < layout.levels_nb) && (i < levels_nb) ; i++) {
+            if (layout.compressed) {
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint) i,
+                        (GLint) (x >> i), (GLint) (y >> i), (GLint) layer,
+                        (GLsizei) layout.levels[i].width,
+                        (GLsizei) layout.levels[i].height, 1,
+                        layout.internal_format,
+                        (GLsizei) layout.levels[i].length,
+                        layout.levels[i].pixels);
+            } else {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint) i,
+                        (GLint) (x >> i), (GLint) (y >> i), (GLint) layer,
+                        (GLsizei) layout.levels[i].width,
+                        (GLsizei) layout.levels[i].height, 1, layout.format,
+                        GL_UNSIGNED_BYTE, layout.levels[i].pixels);
+            }
+        }
+        complete = (layout.levels_nb >= levels_nb);
+    } else if (texture->specific.image_for_2D) {
+        image = texture->specific.image_for_2D;
+        if (image->format->format != SDL_PIXELFORMAT_RGBA32) {
+            converted = SDL_ConvertSurfaceFormat(image,
+                    SDL_PIXELFORMAT_RGBA32, 0);
+            image = converted;
+        }
+
+        if (image) {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image->pitch / 4);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, (GLint) x, (GLint) y,
+                    (GLint) layer, image->w, image->h, 1, GL_RGBA,
+                    GL_UNSIGNED_BYTE, image->pixels);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        } else {
+            fprintf(stderr, "could not convert texture : %s\n",
+                    SDL_GetError());
+        }
+        SDL_FreeSurface(converted);
+        complete = (levels_nb <= 1);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    texture_release_pixels(texture);
+
+    return complete;
+}
+
+/**
+ * @brief Points a 2D texture to the texture object it is sampled from, and to
+ * where its pixels lie in it, counting the GPU memory they take.
+ *
+ * @param[inout] texture Placed texture.
+ * @param[in] name Texture object, an array texture.
+ * @param[in] layer Layer of the array texture.
+ * @param[in] rect Offset and scale of the texture coordinates in the layer.
+ * @param[in] bytes GPU memory taken by the pixels of the texture.
+ */
+void texture_settle(struct texture *texture, GLuint name, u32 layer,
+        const f32 rect[4], size_t bytes)
+{
+    texture->gpu_side.name = name;
+    texture->gpu_side.layer = layer;
+    for (size_t i = 0 ; i < 4 ; i++) {
+        texture->gpu_side.rect[i] = rect[i];
+    }
+
+    texture_memory.gpu_bytes -= texture->gpu_side.bytes;
+    texture->gpu_side.bytes = bytes;
+    texture_memory.gpu_bytes += texture->gpu_side.bytes;
+}
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
 /**
- * @brief Loads a texture as if it were holding a single 2D image.
+ * @brief Loads a texture as if it were holding a single 2D image. The image
+ * is sent as the only layer of an array texture, so it is sampled the same
+ * way as the textures sharing the array textures of a texture pool.
  *
  * @param[inout] texture
  */
 static void texture_load_as_2D(struct texture *texture)
 {
-    glBindTexture(GL_TEXTURE_2D, texture->gpu_side.name);
+    struct texture_baked_layout layout = { 0 };
+    SDL_Surface *image = nullptr;
+    SDL_Surface *converted = nullptr;
+
+    gl_state_bind_texture(0, GL_TEXTURE_2D_ARRAY, texture->gpu_side.name);
+    texture_memory.gpu_bytes -= texture->gpu_side.bytes;
+    texture->gpu_side.bytes = 0;
+    texture->gpu_side.layer = 0;
+    texture->gpu_side.rect[0] = 0.f;
+    texture->gpu_side.rect[1] = 0.f;
+    texture->gpu_side.rect[2] = 1.f;
+    texture->gpu_side.rect[3] = 1.f;
+
+    if (texture->baked.mapped) {
+        texture_baked_read(texture->baked.mapped, &layout);
+
+        // rows of baked levels are tightly packed
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0 ; i < layout.levels_nb ; i++) {
+            if (layout.compressed) {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint) i,
+                        layout.internal_format,
+                        (GLsizei) layout.levels[i].width,
+                        (GLsizei) layout.levels[i].height, 1, 0,
+                        (GLsizei) layout.levels[i].length,
+                        layout.levels[i].pixels);
+            } else {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint) i,
+                        (GLint) layout.internal_format,
+                        (GLsizei) layout.levels[i].width,
+                        (GLsizei) layout.levels[i].height, 1, 0,
+                        layout.format, GL_UNSIGNED_BYTE,
+                        layout.levels[i].pixels);
+            }
+            texture->gpu_side.bytes += layout.levels[i].length;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                (GLint) layout.levels_nb - 1);
+    } else {
+        // sent as RGBA8, the format of the pool pages it can be moved to
+        image = texture->specific.image_for_2D;
+        if (image->format->format != SDL_PIXELFORMAT_RGBA32) {
+            converted = SDL_ConvertSurfaceFormat(image,
+                    SDL_PIXELFORMAT_RGBA32, 0);
+            image = converted;
+        }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-            texture->specific.image_for_2D->w,
-            texture->specific.image_for_2D->h, 0,
-            format_from_surface(texture->specific.image_for_2D),
-            GL_UNSIGNED_BYTE, texture->specific.image_for_2D->pixels);
-    glGenerateMipmap(GL_TEXTURE_2D);
+        if (image) {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image->pitch / 4);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, image->w,
+                    image->h, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 1000);
+
+            // the mipmaps take a third of the full image
+            texture->gpu_side.bytes = ((size_t) image->w * (size_t) image->h
+                    * 4 * 4) / 3;
+        } else {
+            fprintf(stderr, "could not convert texture : %s\n",
+                    SDL_GetError());
+        }
+        SDL_FreeSurface(converted);
+    }
+    texture_memory.gpu_bytes += texture->gpu_side.bytes;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
             GL_NEAREST_MIPMAP_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    gl_state_bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
 }
 
 /**
@@ -211,7 +683,7 @@ static void texture_load_as_2D(struct texture *texture)
  */
 static void texture_load_as_cubemap(struct texture *texture)
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture->gpu_side.name);
+    gl_state_bind_texture(0, GL_TEXTURE_CUBE_MAP, texture->gpu_side.name);
 
     for (size_t i = 0 ; i < CUBEMAP_FACES_NUMBER ; i++) {
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
@@ -221,6 +693,15 @@ static void texture_load_as_cubemap(struct texture *texture)
             GL_UNSIGNED_BYTE,
             texture->specific.images_for_cubemap[i]->pixels);
     }
+    texture_memory.gpu_bytes -= texture->gpu_side.bytes;
+    texture->gpu_side.bytes = 0;
+    for (size_t i = 0 ; i < CUBEMAP_FACES_NUMBER ; i++) {
+        texture->gpu_side.bytes += (size_t)
+                texture->specific.images_for_cubemap[i]->w
+                * (size_t) texture->specific.images_for_cubemap[i]->h * 4;
+    }
+    texture_memory.gpu_bytes += texture->gpu_side.bytes;
+
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S,
@@ -230,7 +711,7 @@ static void texture_load_as_cubemap(struct texture *texture)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R,
             GL_CLAMP_TO_EDGE);
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    gl_state_bind_texture(0, GL_TEXTURE_CUBE_MAP, 0);
 }
 
 /**
@@ -255,6 +736,50 @@ static GLenum format_from_surface(struct SDL_Surface *s)
     return GL_NONE;
 }
 
+/**
+ * @brief Decodes the image of a texture, on some worker thread.
+ *
+ * @param[inout] data Decoded texture.
+ */
+static void texture_decode_task(void *data)
+{
+    struct texture *texture = data;
+    SDL_RWops *mem_rw = SDL_RWFromConstMem(texture->decoding.buffer,
+            texture->decoding.length);
+
+    texture->decoding.image = IMG_Load_RW(mem_rw, 0);
+    SDL_RWclose(mem_rw);
+
+    if (!texture->decoding.image) {
+        fprintf(stderr, "could not decode texture : %s\n", IMG_GetError());
+        return;
+    }
+
+    // remembers if the file was written, for the texture to use it
+    if (texture->decoding.bake) {
+        texture->decoding.bake = texture_baked_write(texture->decoding.image,
+                texture->baked.path, texture->baked.source_hash,
+                texture->baked.compression);
+    }
+}
+
+/**
+ * @brief Waits for the image of a texture being decoded by the worker threads
+ * and throws it away, so it does not replace an image set in the meantime nor
+ * read the texture while it changes.
+ *
+ * @param[inout] texture
+ */
+static void texture_cancel_decoding(struct texture *texture)
+{
+    workers_wait(&texture->decoding.group);
+    SDL_FreeSurface(texture->decoding.image);
+    texture->decoding.buffer = nullptr;
+    texture->decoding.length = 0;
+    texture->decoding.image = nullptr;
+    texture->decoding.bake = false;
+}
+
 /**
  * @brief Reloads a texture. Useful for image changes.
  *
@@ -269,3 +794,188 @@ static void texture_reload(struct texture *texture)
     texture_unload(texture);
     texture_load(texture);
 }
+
+/**
+ * @brief Takes a 2D texture out of its texture pool page, if it is in one,
+ * sending its current pixels to a texture object of its own if it was loaded
+ * from the page. Returns false if nothing was sent.
+ *
+ * @param[inout] texture
+ * @return bool
+ */
+static bool texture_leave_pool(struct texture *texture)
+{
+    bool resident = texture->pooled.resident;
+
+    if (!texture->pooled.page) {
+        return false;
+    }
+
+    texture_pool_leave(texture);
+
+    if (!resident) {
+        return false;
+    }
+
+    glGenTextures(1, &texture->gpu_side.name);
+    texture_restore_pixels(texture);
+    texture_load_as_2D(texture);
+    texture_release_pixels(texture);
+
+    return true;
+}
+
+/**
+ * @brief Replaces an image of a texture, freeing the previous one, and keeps
+ * the memory measures up to date.
+ *
+ * @param[inout] texture Texture owning the image.
+ * @param[inout] slot Where the image is stored in the texture.
+ * @param[in] image New image, can be null.
+ */
+static void texture_attach_image(struct texture *texture,
+        SDL_Surface **slot, SDL_Surface *image)
+{
+    texture_memory.cpu_bytes -= surface_bytes(*slot);
+    SDL_FreeSurface(*slot);
+
+    *slot = image;
+    texture_memory.cpu_bytes += surface_bytes(image);
+
+    // fresh pixels replace the ones released
+    if (image && (texture->released_bytes > 0)) {
+        texture_memory.released_bytes -= texture->released_bytes;
+        texture->released_bytes = 0;
+    }
+}
+
+/**
+ * @brief Frees the pixels of a 2D texture that only needs them on the GPU,
+ * once they were sent there and are not being decoded anymore.
+ *
+ * @param[inout] texture
+ */
+static void texture_release_pixels(struct texture *texture)
+{
+    size_t bytes = 0;
+
+    if ((texture->residency != TEXTURE_RESIDENCY_GPU_ONLY)
+            || (texture->flavor != TEXTURE_FLAVOR_2D)
+            || !(texture->load_state.flags & LOADABLE_FLAG_LOADED)
+            || texture->decoding.buffer) {
+        return;
+    }
+
+    if (texture->baked.mapped) {
+        bytes = texture->baked.length;
+        texture_baked_unmap(texture->baked.mapped, texture->baked.length);
+        texture_memory.cpu_bytes -= texture->baked.length;
+        texture->baked.mapped = nullptr;
+        texture->baked.length = 0;
+    } else if (texture->specific.image_for_2D
+            && (texture->source.buffer || texture->baked.path)) {
+        bytes = surface_bytes(texture->specific.image_for_2D);
+        texture_attach_image(texture, &texture->specific.image_for_2D,
+                nullptr);
+    } else {
+        return;
+    }
+
+    texture->released_bytes = bytes;
+    texture_memory.released_bytes += bytes;
+}
+
+/**
+ * @brief Brings back the pixels of a 2D texture that released them, mapping
+ * its baked texture file again or else decoding its image again. If neither
+ * can be done, the texture is left plain white.
+ *
+ * @param[inout] texture
+ */
+static void texture_restore_pixels(struct texture *texture)
+{
+    SDL_RWops *mem_rw = nullptr;
+
+    if ((texture->flavor != TEXTURE_FLAVOR_2D) || texture->baked.mapped
+            || texture->specific.image_for_2D) {
+        return;
+    }
+
+    if (texture->baked.path && texture_map_baked(texture)) {
+        return;
+    }
+
+    if (texture->source.buffer) {
+        mem_rw = SDL_RWFromConstMem(texture->source.buffer,
+                texture->source.length);
+        texture_attach_image(texture, &texture->specific.image_for_2D,
+                IMG_Load_RW(mem_rw, 0));
+        SDL_RWclose(mem_rw);
+    }
+
+    if (!texture->specific.image_for_2D) {
+        fprintf(stderr, "could not decode texture again : %s\n",
+                IMG_GetError());
+        texture_2D_default(texture);
+    }
+}
+
+/**
+ * @brief Maps the baked texture file of a texture, if it can be used.
+ *
+ * @param[inout] texture
+ * @return bool
+ */
+static bool texture_map_baked(struct texture *texture)
+{
+    if (!texture_baked_map(texture->baked.path, texture->baked.source_hash,
+                texture->baked.compression, &texture->baked.mapped,
+                &texture->baked.length)) {
+        return false;
+    }
+
+    texture_memory.cpu_bytes += texture->baked.length;
+    texture_memory.released_bytes -= texture->released_bytes;
+    texture->released_bytes = 0;
+
+    return true;
+}
+
+/**
+ * @brief Forgets the baked texture file of a texture, unmapping it.
+ *
+ * @param[inout] texture
+ */
+static void texture_drop_baked(struct texture *texture)
+{
+    struct allocator alloc = make_system_allocator();
+
+    if (texture->baked.mapped) {
+        texture_baked_unmap(texture->baked.mapped, texture->baked.length);
+        texture_memory.cpu_bytes -= texture->baked.length;
+    }
+    if (texture->baked.path) {
+        alloc.free(alloc, texture->baked.path);
+    }
+
+    texture->baked.path = nullptr;
+    texture->baked.source_hash = 0;
+    texture->baked.compression = TEXTURE_COMPRESSION_NONE;
+    texture->baked.mapped = nullptr;
+    texture->baked.length = 0;
+}
+
+/**
+ * @brief Measures the pixels of a SDL surface, in bytes.
+ *
+ * @param[in] s Measured surface, can be null.
+ * @return size_t
+ */
+static size_t surface_bytes(const SDL_Surface *s)
+{
+    if (!s) {
+        return 0;
+    }
+
+    return (size_t) s->pitch * (size_t) s->h;
+}
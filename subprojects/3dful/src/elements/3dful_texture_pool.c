@@ -0,0 +1,558 @@
+/**
+ * @file 3dful_texture_pool.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the pools grouping 2D textures in array textures.
+ *
+ * Textures of the same format and size share the array texture of a page,
+ * one per layer. Small textures of the same format are packed together in the
+ * layers of an atlas page, on shelves of textures of the same height ; each
+ * one is aligned on its size so their mip levels never mix. Materials
+ * sampling textures of the same page bind the same texture object, and the
+ * shaders read each texture in its layer and rectangle.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "3dful_core.h"
+
+#include <ustd/array.h>
+
+#include "texture_processing/3dful_texture_processing.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+static struct texture_pool_page *texture_pool_page_create(
+        const struct texture_shape *shape, bool atlas);
+static void texture_pool_page_delete(struct texture_pool_page *page);
+static bool texture_pool_page_place(struct texture_pool_page *page,
+        const struct texture_shape *shape, struct texture *texture);
+static void texture_pool_page_update(struct texture_pool_page *page);
+static void texture_pool_page_drop_storage(struct texture_pool_page *page);
+static void texture_pool_settle(struct texture_pool_page *page,
+        struct texture *texture);
+
+static bool texture_pool_fits_atlas(const struct texture_shape *shape);
+static u32 align_up(u32 value, u32 alignment);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Creates an empty texture pool.
+ *
+ * @param[out] pool Object receiving the pool.
+ */
+void texture_pool_create(struct texture_pool *pool)
+{
+    struct allocator alloc = make_system_allocator();
+
+    *pool = (struct texture_pool) {
+            .pages = array_create(alloc, sizeof(*pool->pages), 4),
+    };
+}
+
+/**
+ * @brief Destroys a texture pool and the array textures of its pages. The
+ * textures left in it are not touched, and must be unloaded beforehand.
+ *
+ * @param[inout] pool Destroyed pool.
+ */
+void texture_pool_delete(struct texture_pool *pool)
+{
+    struct allocator alloc = make_system_allocator();
+
+    for (size_t i = 0 ; i < array_length(pool->pages) ; i++) {
+        texture_pool_page_delete(pool->pages[i]);
+    }
+    array_destroy(alloc, (ARRAY_ANY *) &pool->pages);
+}
+
+/**
+ * @brief Adds a 2D texture to the page of a pool sharing its format, and its
+ * size if it is too large to be packed with others. The texture samples the
+ * array texture of the page once it is loaded, or once the pool is flushed if
+ * it is already. Changing the image of the texture takes it out of its page.
+ * Returns false if the texture cannot be pooled, as it is not a 2D texture
+ * with its pixels decoded.
+ *
+ * @param[inout] pool Pool receiving the texture.
+ * @param[inout] texture Pooled texture.
+ * @return bool
+ */
+bool texture_pool_add(struct texture_pool *pool, struct texture *texture)
+{
+    struct allocator alloc = make_system_allocator();
+    struct texture_pool_page *page = nullptr;
+    struct texture_shape shape = { 0 };
+    bool atlas = false;
+
+    if (texture->pooled.page) {
+        return true;
+    }
+
+    if (!texture_describe(texture, &shape)) {
+        return false;
+    }
+    atlas = texture_pool_fits_atlas(&shape);
+
+    for (size_t i = 0 ; i < array_length(pool->pages) ; i++) {
+        struct texture_pool_page *candidate = pool->pages[i];
+
+        if ((candidate->atlas != atlas)
+                || (candidate->internal_format != shape.internal_format)
+                || (!atlas && ((candidate->width != shape.width)
+                        || (candidate->height != shape.height)))) {
+            continue;
+        }
+        if (texture_pool_page_place(candidate, &shape, texture)) {
+            page = candidate;
+            break;
+        }
+    }
+
+    if (!page) {
+        page = texture_pool_page_create(&shape, atlas);
+        if (!page) {
+            return false;
+        }
+        array_ensure_capacity(alloc, (ARRAY_ANY *) &pool->pages, 1);
+        array_push(pool->pages, &page);
+        texture_pool_page_place(page, &shape, texture);
+    }
+
+    array_ensure_capacity(alloc, (ARRAY_ANY *) &page->textures, 1);
+    array_push(page->textures, &texture);
+    texture->pooled.page = page;
+    texture->pooled.width = shape.width;
+    texture->pooled.height = shape.height;
+    texture->pooled.uploaded = false;
+    texture->pooled.resident = false;
+    page->stale = true;
+
+    return true;
+}
+
+/**
+ * @brief Sends the textures added to a pool to the array textures of their
+ * pages, if some of them are loaded, so these loaded textures sample the
+ * array textures from now on. Must be called from the thread owning the
+ * OpenGL context.
+ *
+ * @param[inout] pool Flushed pool.
+ */
+void texture_pool_flush(struct texture_pool *pool)
+{
+    for (size_t i = 0 ; i < array_length(pool->pages) ; i++) {
+        struct texture_pool_page *page = pool->pages[i];
+        bool in_use = false;
+
+        if (!page->stale) {
+            continue;
+        }
+
+        for (size_t j = 0 ; j < array_length(page->textures) ; j++) {
+            in_use = in_use || (page->textures[j]->load_state.flags
+                    & LOADABLE_FLAG_LOADED);
+        }
+        if (in_use) {
+            texture_pool_page_update(page);
+        }
+    }
+}
+
+/**
+ * @brief Makes a pooled texture being loaded sample the array texture of its
+ * page, sending the page to the GPU if needed.
+ *
+ * @param[inout] texture Loaded texture.
+ */
+void texture_pool_use(struct texture *texture)
+{
+    struct texture_pool_page *page = texture->pooled.page;
+
+    if (page->stale || !page->gpu_side.name) {
+        texture_pool_page_update(page);
+    }
+
+    if (!texture->pooled.resident) {
+        texture->pooled.resident = true;
+        page->gpu_side.nb_users += 1;
+    }
+    texture_pool_settle(page, texture);
+}
+
+/**
+ * @brief Stops a pooled texture being unloaded from sampling the array
+ * texture of its page, which is released once no texture samples it.
+ *
+ * @param[inout] texture Unloaded texture.
+ */
+void texture_pool_unuse(struct texture *texture)
+{
+    struct texture_pool_page *page = texture->pooled.page;
+
+    if (!texture->pooled.resident) {
+        return;
+    }
+
+    texture->pooled.resident = false;
+    page->gpu_side.nb_users -= 1;
+
+    if (page->gpu_side.nb_users == 0) {
+        texture_pool_page_drop_storage(page);
+    }
+}
+
+/**
+ * @brief Takes a texture out of its pool page, if it is in one. A loaded
+ * texture is left without a texture object, and must be given its own.
+ *
+ * @param[inout] texture Texture leaving its page.
+ */
+void texture_pool_leave(struct texture *texture)
+{
+    struct texture_pool_page *page = texture->pooled.page;
+    const f32 no_rect[4] = { 0.f, 0.f, 1.f, 1.f };
+
+    if (!page) {
+        return;
+    }
+
+    if (texture->pooled.resident) {
+        texture_pool_unuse(texture);
+        texture_settle(texture, 0, 0, no_rect, 0);
+    }
+
+    for (size_t i = 0 ; i < array_length(page->textures) ; i++) {
+        if (page->textures[i] == texture) {
+            array_remove_swapback(page->textures, i);
+            break;
+        }
+    }
+
+    // the space left is only taken back once the page is empty
+    if (array_length(page->textures) == 0) {
+        array_clear(page->shelves);
+        page->layers_nb = 0;
+        page->stale = false;
+    }
+
+    texture->pooled = (struct texture_pool_placement) { 0 };
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Creates an empty page for textures of some shape. Atlas pages have
+ * enough mip levels for their smallest textures, compressed blocks included.
+ *
+ * @param[in] shape Shape of the textures of the page.
+ * @param[in] atlas Whether the textures are packed in the layers.
+ * @return struct texture_pool_page *
+ */
+static struct texture_pool_page *texture_pool_page_create(
+        const struct texture_shape *shape, bool atlas)
+{
+    struct allocator alloc = make_system_allocator();
+    struct texture_pool_page *page = nullptr;
+    u32 levels_nb = 1;
+    u32 smallest = TEXTURE_POOL_ATLAS_ITEM_MIN;
+
+    page = alloc.malloc(alloc, sizeof(*page));
+    if (!page) {
+        return nullptr;
+    }
+
+    if (atlas) {
+        // compressed levels cannot go below a block
+        while ((smallest >> levels_nb) >= (shape->compressed ? 4u : 1u)) {
+            levels_nb += 1;
+        }
+    } else {
+        while (((shape->width >> levels_nb) > 0)
+                || ((shape->height >> levels_nb) > 0)) {
+            levels_nb += 1;
+        }
+    }
+
+    *page = (struct texture_pool_page) {
+            .internal_format = shape->internal_format,
+            .format = shape->format,
+            .width = atlas ? TEXTURE_POOL_ATLAS_SIDE : shape->width,
+            .height = atlas ? TEXTURE_POOL_ATLAS_SIDE : shape->height,
+            .levels_nb = levels_nb,
+            .compressed = shape->compressed,
+            .atlas = atlas,
+            .textures = array_create(alloc, sizeof(*page->textures), 8),
+            .shelves = array_create(alloc, sizeof(*page->shelves), 8),
+    };
+
+    return page;
+}
+
+/**
+ * @brief Destroys a page and its array texture, taking its textures out.
+ *
+ * @param[inout] page Destroyed page.
+ */
+static void texture_pool_page_delete(struct texture_pool_page *page)
+{
+    struct allocator alloc = make_system_allocator();
+
+    for (size_t i = 0 ; i < array_length(page->textures) ; i++) {
+        page->textures[i]->pooled = (struct texture_pool_placement) { 0 };
+    }
+    texture_pool_page_drop_storage(page);
+
+    array_destroy(alloc, (ARRAY_ANY *) &page->textures);
+    array_destroy(alloc, (ARRAY_ANY *) &page->shelves);
+    alloc.free(alloc, page);
+}
+
+/**
+ * @brief Finds room for a texture in a page : the first layer no texture
+ * takes for pages of whole layers, or else the first shelf of the same height
+ * with room left, or a new shelf on top of the last layer, or in a new layer.
+ * Returns false if the page is full.
+ *
+ * @param[inout] page Page receiving the texture.
+ * @param[in] shape Shape of the texture.
+ * @param[inout] texture Placed texture.
+ * @return bool
+ */
+static bool texture_pool_page_place(struct texture_pool_page *page,
+        const struct texture_shape *shape, struct texture *texture)
+{
+    struct allocator alloc = make_system_allocator();
+    struct texture_pool_shelf shelf = { 0 };
+    u32 top = 0;
+
+    if (!page->atlas) {
+        for (u32 layer = 0 ; layer < TEXTURE_POOL_LAYERS_MAX ; layer++) {
+            bool taken = false;
+
+            for (size_t i = 0 ; i < array_length(page->textures) ; i++) {
+                taken = taken || (page->textures[i]->pooled.layer == layer);
+            }
+            if (!taken) {
+                texture->pooled.layer = layer;
+                texture->pooled.x = 0;
+                texture->pooled.y = 0;
+                if (layer >= page->layers_nb) {
+                    page->layers_nb = layer + 1;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (size_t i = 0 ; i < array_length(page->shelves) ; i++) {
+        u32 x = align_up(page->shelves[i].x, shape->width);
+
+        if ((page->shelves[i].height != shape->height)
+                || (x + shape->width > TEXTURE_POOL_ATLAS_SIDE)) {
+            continue;
+        }
+        texture->pooled.layer = page->shelves[i].layer;
+        texture->pooled.x = x;
+        texture->pooled.y = page->shelves[i].y;
+        page->shelves[i].x = x + shape->width;
+        return true;
+    }
+
+    shelf.layer = (page->layers_nb > 0) ? (page->layers_nb - 1) : 0;
+    for (size_t i = 0 ; i < array_length(page->shelves) ; i++) {
+        if ((page->shelves[i].layer == shelf.layer)
+                && (page->shelves[i].y + page->shelves[i].height > top)) {
+            top = page->shelves[i].y + page->shelves[i].height;
+        }
+    }
+    shelf.y = align_up(top, shape->height);
+
+    if ((page->layers_nb == 0)
+            || (shelf.y + shape->height > TEXTURE_POOL_ATLAS_SIDE)) {
+        if (page->layers_nb >= TEXTURE_POOL_LAYERS_MAX) {
+            return false;
+        }
+        shelf.layer = page->layers_nb;
+        shelf.y = 0;
+        page->layers_nb += 1;
+    }
+    shelf.height = shape->height;
+    shelf.x = shape->width;
+
+    array_ensure_capacity(alloc, (ARRAY_ANY *) &page->shelves, 1);
+    array_push(page->shelves, &shelf);
+
+    texture->pooled.layer = shelf.layer;
+    texture->pooled.x = 0;
+    texture->pooled.y = shelf.y;
+
+    return true;
+}
+
+/**
+ * @brief Sends the textures of a page not sent yet to its array texture,
+ * creating it again with all textures if it lacks layers. The loaded textures
+ * of the page then sample it, dropping their own texture object if they had
+ * one.
+ *
+ * @param[inout] page Updated page.
+ */
+static void texture_pool_page_update(struct texture_pool_page *page)
+{
+    bool generate = false;
+
+    if (!page->gpu_side.name || (page->gpu_side.layers_nb < page->layers_nb)) {
+        texture_pool_page_drop_storage(page);
+
+        glGenTextures(1, &page->gpu_side.name);
+        gl_state_bind_texture(0, GL_TEXTURE_2D_ARRAY, page->gpu_side.name);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei) page->levels_nb,
+                page->internal_format, (GLsizei) page->width,
+                (GLsizei) page->height, (GLsizei) page->layers_nb);
+        page->gpu_side.layers_nb = page->layers_nb;
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    } else {
+        gl_state_bind_texture(0, GL_TEXTURE_2D_ARRAY, page->gpu_side.name);
+    }
+
+    for (size_t i = 0 ; i < array_length(page->textures) ; i++) {
+        struct texture *texture = page->textures[i];
+
+        if (texture->pooled.uploaded) {
+            continue;
+        }
+        generate = !texture_upload_to_layer(texture, texture->pooled.layer,
+                texture->pooled.x, texture->pooled.y, page->levels_nb)
+                || generate;
+        texture->pooled.uploaded = true;
+    }
+
+    // images come without their mip levels
+    if (generate && !page->compressed) {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    gl_state_bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+    for (size_t i = 0 ; i < array_length(page->textures) ; i++) {
+        struct texture *texture = page->textures[i];
+
+        if (!(texture->load_state.flags & LOADABLE_FLAG_LOADED)) {
+            continue;
+        }
+
+        if (!texture->pooled.resident) {
+            gl_state_forget_texture(texture->gpu_side.name);
+            glDeleteTextures(1, &texture->gpu_side.name);
+            texture->pooled.resident = true;
+            page->gpu_side.nb_users += 1;
+        }
+        texture_pool_settle(page, texture);
+    }
+
+    page->stale = false;
+}
+
+/**
+ * @brief Deletes the array texture of a page, its textures to be sent again
+ * the next time it is needed.
+ *
+ * @param[inout] page Page losing its array texture.
+ */
+static void texture_pool_page_drop_storage(struct texture_pool_page *page)
+{
+    if (!page->gpu_side.name) {
+        return;
+    }
+
+    gl_state_forget_texture(page->gpu_side.name);
+    glDeleteTextures(1, &page->gpu_side.name);
+    page->gpu_side.name = 0;
+    page->gpu_side.layers_nb = 0;
+
+    for (size_t i = 0 ; i < array_length(page->textures) ; i++) {
+        page->textures[i]->pooled.uploaded = false;
+    }
+}
+
+/**
+ * @brief Points a texture to where it lies in the array texture of its page,
+ * counting the memory taken by its region of the page.
+ *
+ * @param[in] page Page of the texture.
+ * @param[inout] texture Resident texture.
+ */
+static void texture_pool_settle(struct texture_pool_page *page,
+        struct texture *texture)
+{
+    f32 rect[4] = {
+            (f32) texture->pooled.x / (f32) page->width,
+            (f32) texture->pooled.y / (f32) page->height,
+            (f32) texture->pooled.width / (f32) page->width,
+            (f32) texture->pooled.height / (f32) page->height,
+    };
+    size_t bytes = 0;
+
+    for (u32 i = 0 ; i < page->levels_nb ; i++) {
+        u32 width = texture->pooled.width >> i;
+        u32 height = texture->pooled.height >> i;
+
+        width = (width > 0) ? width : 1u;
+        height = (height > 0) ? height : 1u;
+
+        if (page->compressed) {
+            bytes += etc2_compressed_length(width, height,
+                    page->format == GL_RGBA);
+        } else {
+            bytes += (size_t) width * (size_t) height
+                    * ((page->format == GL_RGB) ? 3u : 4u);
+        }
+    }
+
+    texture_settle(texture, page->gpu_side.name, texture->pooled.layer, rect,
+            bytes);
+}
+
+/**
+ * @brief Tells if a texture is small enough to be packed with others in the
+ * layers of an atlas page, its sides being powers of two.
+ *
+ * @param[in] shape Shape of the texture.
+ * @return bool
+ */
+static bool texture_pool_fits_atlas(const struct texture_shape *shape)
+{
+    return (shape->width >= TEXTURE_POOL_ATLAS_ITEM_MIN)
+            && (shape->width <= TEXTURE_POOL_ATLAS_ITEM_MAX)
+            && (shape->height >= TEXTURE_POOL_ATLAS_ITEM_MIN)
+            && (shape->height <= TEXTURE_POOL_ATLAS_ITEM_MAX)
+            && ((shape->width & (shape->width - 1)) == 0)
+            && ((shape->height & (shape->height - 1)) == 0);
+}
+
+/**
+ * @brief Rounds a value up to a multiple of a power of two.
+ *
+ * @param[in] value Rounded value.
+ * @param[in] alignment Power of two.
+ * @return u32
+ */
+static u32 align_up(u32 value, u32 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
@@ -0,0 +1,189 @@
+/**
+ * @file 3dful_geometry_binary.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the binary geometry format, holding the vertices
+ * and faces exactly as they are laid out in memory, to be loaded without any
+ * parsing.
+ *
+ * The file is a header, followed by all vertices, then all faces. It is only
+ * meant to be read back by the program that wrote it.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "3ful_geometry_parsing.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ustd/array.h>
+
+/** Bytes found at the start of binary geometry files. */
+#define GEOMETRY_BINARY_MAGIC { '3', 'D', 'F', 'G' }
+/** Version of the format, changed when the layout of the data changes, and
+    when the same source is parsed into different vertices and faces, so
+    older files are built again.
+    2 : triangulation of quads and n-gons. */
+#define GEOMETRY_BINARY_VERSION (2u)
+
+/**
+ * @brief Header found at the start of binary geometry files.
+ */
+struct geometry_binary_header {
+    char magic[4];
+    u32 version;
+    /** Hash of the data the geometry was built from. */
+    u64 source_hash;
+
+    /** Sizes of the structures, to reject files written by other builds. */
+    u32 vertex_size, face_size;
+    u32 vertices_nb, faces_nb;
+
+    u32 smooth;
+    u32 padding;
+    struct geometry_bounds bounds;
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Loads a geometry from a binary geometry file, if it exists and was
+ * built from the data described by some hash. The file is mapped in memory and
+ * its vertices and faces replace the contents of the geometry.
+ * Returns false, leaving the geometry untouched, if the file cannot be used.
+ *
+ * @param[inout] geometry Modified geometry.
+ * @param[in] path Path to the binary geometry file.
+ * @param[in] source_hash Hash of the data the geometry should come from.
+ * @return bool
+ */
+bool geometry_binary(struct geometry *geometry, const char *path,
+        u64 source_hash)
+{
+    struct geometry_binary_header header = { 0 };
+    struct stat file_stat = { 0 };
+    const byte *mapped = nullptr;
+    size_t expected_length = 0;
+    i32 fd = -1;
+    bool valid = false;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    if ((fstat(fd, &file_stat) != 0)
+            || ((size_t) file_stat.st_size < sizeof(header))) {
+        close(fd);
+        return false;
+    }
+
+    mapped = mmap(nullptr, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE,
+            fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    memcpy(&header, mapped, sizeof(header));
+    expected_length = sizeof(header)
+            + ((size_t) header.vertices_nb * sizeof(struct vertex))
+            + ((size_t) header.faces_nb * sizeof(struct face));
+
+    valid = (memcmp(header.magic, (char[]) GEOMETRY_BINARY_MAGIC,
+                    sizeof(header.magic)) == 0)
+            && (header.version == GEOMETRY_BINARY_VERSION)
+            && (header.source_hash == source_hash)
+            && (header.vertex_size == sizeof(struct vertex))
+            && (header.face_size == sizeof(struct face))
+            && ((size_t) file_stat.st_size == expected_length);
+
+    if (valid) {
+        array_clear(geometry->vertices);
+        array_clear(geometry->faces);
+        array_clear(geometry->lod_faces);
+        geometry->lods_nb = 0;
+        array_clear(geometry->meshlets);
+
+        array_ensure_capacity(make_system_allocator(),
+                (ARRAY_ANY *) &geometry->vertices, header.vertices_nb);
+        array_append_mem(geometry->vertices, mapped + sizeof(header),
+                header.vertices_nb);
+        array_ensure_capacity(make_system_allocator(),
+                (ARRAY_ANY *) &geometry->faces, header.faces_nb);
+        array_append_mem(geometry->faces, mapped + sizeof(header)
+                + ((size_t) header.vertices_nb * sizeof(struct vertex)),
+                header.faces_nb);
+
+        geometry->bounds = header.bounds;
+        geometry_set_smoothing(geometry, header.smooth);
+    }
+
+    munmap((void *) mapped, (size_t) file_stat.st_size);
+
+    return valid;
+}
+
+/**
+ * @brief Writes the vertices and faces of a geometry to a binary geometry
+ * file, tagged with the hash of the data the geometry was built from.
+ * The file is written next to its destination, and then moved in place so
+ * it is never seen half-written. Returns false if the file cannot be written.
+ *
+ * @param[in] geometry Written geometry.
+ * @param[in] path Path to the binary geometry file.
+ * @param[in] source_hash Hash of the data the geometry was built from.
+ * @return bool
+ */
+bool geometry_binary_write(const struct geometry *geometry, const char *path,
+        u64 source_hash)
+{
+    struct geometry_binary_header header = {
+            .magic = GEOMETRY_BINARY_MAGIC,
+            .version = GEOMETRY_BINARY_VERSION,
+            .source_hash = source_hash,
+            .vertex_size = sizeof(struct vertex),
+            .face_size = sizeof(struct face),
+            .vertices_nb = (u32) array_length(geometry->vertices),
+            .faces_nb = (u32) array_length(geometry->faces),
+            .smooth = geometry->render_flags.smooth,
+            .bounds = geometry->bounds,
+    };
+    char temporary_path[512] = { 0 };
+    FILE *file = nullptr;
+    bool written = false;
+
+    if ((size_t) snprintf(temporary_path, sizeof(temporary_path), "%s.tmp",
+                path) >= sizeof(temporary_path)) {
+        return false;
+    }
+
+    file = fopen(temporary_path, "wb");
+    if (!file) {
+        fprintf(stderr, "could not write geometry to %s\n", path);
+        return false;
+    }
+
+    written = (fwrite(&header, sizeof(header), 1, file) == 1)
+            && (fwrite(geometry->vertices, sizeof(*geometry->vertices),
+                    header.vertices_nb, file) == header.vertices_nb)
+            && (fwrite(geometry->faces, sizeof(*geometry->faces),
+                    header.faces_nb, file) == header.faces_nb);
+    written = (fclose(file) == 0) && written;
+
+    if (!written || (rename(temporary_path, path) != 0)) {
+        fprintf(stderr, "could not write geometry to %s\n", path);
+        remove(temporary_path);
+        return false;
+    }
+
+    return true;
+}
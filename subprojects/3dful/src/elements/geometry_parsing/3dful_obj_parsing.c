@@ -11,62 +11,129 @@
 #include "3ful_geometry_parsing.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <ustd/array.h>
 
 /**
- * @brief Private state of the parser.
+ * @brief Private state of the parser : the line being read.
  */
-struct parser_state {
-    const ARRAY(byte) buffer_array;
-    size_t buffer_idx;
-    u32 line, column;
+struct parser_line {
+    const byte *start;
+    const byte *cursor;
+    const byte *end;
+    u32 number;
+    /** True if negative indices are left to be resolved by the merge. */
+    bool deferred;
+    /** Indices of the face point being read, relative to the range. */
+    u16 relative_mask;
 };
 
-static void parser_state_advance(struct parser_state *state);
+/**
+ * @brief Face using negative indices, resolved against the data of its range
+ * instead of the whole file. Each bit of the mask is set for one index, at
+ * (corner * 3) + (0 for v, 1 for vt, 2 for vn).
+ */
+struct parser_relative_face {
+    u32 face;
+    u32 line;
+    u16 mask;
+};
+
+/**
+ * @brief Point of a polygon, before it is split into triangles. The bits of
+ * the relative mask are set for indices resolved against the range's counts
+ * (1 for v, 2 for vt, 4 for vn).
+ */
+struct parser_face_point {
+    u32 v, vt, vn;
+    u16 relative_mask;
+};
+
+/**
+ * @brief Lines of the file parsed in one go, possibly concurrently with other
+ * ranges. The data is merged in the final parser object afterwards.
+ */
+struct parser_range {
+    const byte *start;
+    const byte *end;
+
+    struct wavefront_obj obj;
+    ARRAY(struct parser_relative_face) relative_faces;
+    /** Set if some line set the smoothing of the model. */
+    bool smooth_set;
+
+    /** Lines read, including the one that failed. */
+    u32 lines;
+    bool failed;
+    u32 failed_column;
+    /** Last line with an unknown smoothing value, zero if none. */
+    u32 smoothing_warning;
+};
+
+/**
+ * @brief Slot of the table used to weld the corners of faces sharing the same
+ * position, UV and normal into a single vertex.
+ */
+struct weld_slot {
+    u32 v_idx, vt_idx, vn_idx;
+    u32 vertex;
+};
+
+/** Marks a slot of the weld table not yet referencing a vertex. */
+#define WELD_SLOT_EMPTY (0xFFFFFFFFu)
+
+/** Most digits read into a number's mantissa without overflowing it. */
+#define PARSER_FAST_DIGITS_MAX (18u)
+/** Most digits read into an index without overflowing it. */
+#define PARSER_INDEX_DIGITS_MAX (9u)
+/** Most points of a polygon held on the stack, larger ones use the heap. */
+#define PARSER_POLYGON_POINTS_SMALL (32u)
+
+/** Fewest bytes read by each range when the file is parsed in parallel. */
+#define PARSER_RANGE_LENGTH_MIN (1u << 20)
+/** Most ranges a file is split into. */
+#define PARSER_RANGES_MAX (64u)
+
+static u32 weld_hash(u32 v_idx, u32 vt_idx, u32 vn_idx);
 
 // -----------------------------------------------------------------------------
 // UTILITY FUNCTIONS -----------------------------------------------------------
-static i32 accept(struct parser_state *state, char *alternatives, size_t nb,
-        char *c_out);
-static i32 expect(struct parser_state *state, char *alternatives, size_t nb,
-        char *c_out);
-static i32 lookup(struct parser_state *state, char *alternatives, size_t nb,
-        char *c_out);
-
-static void skip_whitespace(struct parser_state *state);
+static void parser_reserve(ARRAY_ANY *array);
+static void skip_whitespace(struct parser_line *line);
+static bool parser_keyword(struct parser_line *line, const char *keyword);
 // -----------------------------------------------------------------------------
 
 // -----------------------------------------------------------------------------
 // PARSING ROUTINES ------------------------------------------------------------
-static i32 wavefront_parse_comment(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_end_line(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_end_of_obj(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-
-static i32 wavefront_parse_obj_name(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_obj_smoothing(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_vertex(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_vertex_pos(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_vertex_normal(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_vertex_texture(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_face(struct parser_state *state,
-        struct wavefront_obj *out_obj);
-static i32 wavefront_parse_face_point(struct parser_state *state,
-        i32 read_idx[3]);
-
-static i32 wavefront_parse_value(struct parser_state *state, f32 *out_value);
-static i32 wavefront_parse_value_int(struct parser_state *state,
-        i32 *out_value);
-static i32 wavefront_parse_value_uint(struct parser_state *state,
+static void wavefront_parse_range(struct parser_range *range, bool deferred);
+static void wavefront_parse_range_task(void *data);
+static bool wavefront_merge_range(struct wavefront_obj *obj,
+        struct parser_range *range, u32 line_offset);
+static u32 *wavefront_relative_index(struct wavefront_obj_face *face,
+        size_t bit);
+static void wavefront_report_range(const struct parser_range *range,
+        u32 line_offset);
+
+static bool wavefront_parse_line(struct parser_line *line,
+        struct parser_range *range);
+static bool wavefront_parse_smoothing(struct parser_line *line,
+        struct parser_range *range);
+static bool wavefront_parse_vector(struct parser_line *line, f32 *out_values,
+        size_t nb);
+static bool wavefront_parse_face(struct parser_line *line,
+        struct parser_range *range);
+static void wavefront_push_polygon(struct parser_line *line,
+        struct parser_range *range, const struct parser_face_point *points,
+        size_t points_nb);
+static bool wavefront_parse_face_point(struct parser_line *line,
+        const struct wavefront_obj *obj, struct parser_face_point *out_point);
+static bool wavefront_parse_index(struct parser_line *line, size_t count,
+        u16 relative_bit, u32 *out_index);
+
+static bool wavefront_parse_value(struct parser_line *line, f32 *out_value);
+static bool wavefront_parse_value_int(struct parser_line *line,
         i32 *out_value);
 
 // -----------------------------------------------------------------------------
@@ -110,44 +177,87 @@ void wavefront_obj_delete(struct wavefront_obj *obj)
 
 /**
  * @brief Parses an .obj file, stored in a buffer. The parser object is cleared
- * before reading the buffer.
- *
- * @warning The buffer is expected to have been created with ustd/array.h.
+ * before reading the buffer. The buffer is read in place, line by line.
+ * Large buffers are split on line boundaries into ranges parsed by the worker
+ * threads, then merged back in order.
  *
  * @param[inout] obj Parser object.
  * @param[in] buffer Parsed buffer.
+ * @param[in] length Length of the buffer, in bytes.
  */
-void wavefront_obj_parse(struct wavefront_obj *obj, const byte *buffer)
+void wavefront_obj_parse(struct wavefront_obj *obj, const byte *buffer,
+        size_t length)
 {
+    const byte *end = buffer + length;
+    struct parser_range ranges[PARSER_RANGES_MAX] = { 0 };
+    size_t ranges_nb = 0;
+    size_t range_length = 0;
+    struct worker_group group = { 0 };
+    u32 line_offset = 0;
+    bool stopped = false;
+
     array_clear(obj->f_array);
     array_clear(obj->v_array);
     array_clear(obj->vn_array);
     array_clear(obj->vt_array);
     obj->smooth = 0;
 
-    struct parser_state state = { .buffer_array = buffer, 0 };
-
-    while (!wavefront_parse_end_of_obj(&state, obj)) {
-        skip_whitespace(&state);
-
-        if (wavefront_parse_end_line(&state, obj)) {
-            // NOP
-        } else if (wavefront_parse_comment(&state, obj)) {
-            // NOP
-        } else if (wavefront_parse_obj_name(&state, obj)) {
-            // NOP
-        } else if (wavefront_parse_obj_smoothing(&state, obj)) {
-            // NOP
-        } else if (wavefront_parse_vertex(&state, obj)) {
-            // NOP
-        } else if (wavefront_parse_face(&state, obj)) {
-            // NOP
+    if (length >= (2 * PARSER_RANGE_LENGTH_MIN)) {
+        ranges_nb = 2 * (workers_count() + 1);
+        ranges_nb = (ranges_nb < PARSER_RANGES_MAX)
+                ? ranges_nb : PARSER_RANGES_MAX;
+        ranges_nb = (ranges_nb < (length / PARSER_RANGE_LENGTH_MIN))
+                ? ranges_nb : (length / PARSER_RANGE_LENGTH_MIN);
+    }
+
+    // small files, or no other thread to help
+    if (ranges_nb <= 2) {
+        ranges[0] = (struct parser_range) {
+                .start = buffer,
+                .end = end,
+                .obj = *obj,
+        };
+        wavefront_parse_range(&ranges[0], false);
+        *obj = ranges[0].obj;
+        wavefront_report_range(&ranges[0], 0);
+        return;
+    }
+
+    range_length = length / ranges_nb;
+    for (size_t i = 0 ; i < ranges_nb ; i++) {
+        ranges[i].start = (i == 0) ? buffer : ranges[i-1].end;
+        ranges[i].end = ranges[i].start + range_length;
+
+        if ((i == (ranges_nb - 1)) || (ranges[i].end >= end)) {
+            ranges[i].end = end;
         } else {
-            fprintf(stderr, "at line %d:%d ; parsing error. The resulting "
-                    "geometry may be malformed.\n", state.line+1,
-                    state.column+1);
-            break;
+            ranges[i].end = memchr(ranges[i].end, '\n',
+                    (size_t) (end - ranges[i].end));
+            ranges[i].end = ranges[i].end ? ranges[i].end + 1 : end;
+        }
+
+        wavefront_obj_create(&ranges[i].obj);
+        ranges[i].relative_faces = array_create(make_system_allocator(),
+                sizeof(*ranges[i].relative_faces), 16);
+        workers_push(&group, &wavefront_parse_range_task, &ranges[i]);
+
+        if (ranges[i].end == end) {
+            ranges_nb = i + 1;
+        }
+    }
+
+    workers_wait(&group);
+
+    // ranges after a parsing error are dropped, as if the file stopped there
+    for (size_t i = 0 ; i < ranges_nb ; i++) {
+        if (!stopped) {
+            stopped = !wavefront_merge_range(obj, &ranges[i], line_offset);
+            line_offset += ranges[i].lines;
         }
+
+        wavefront_obj_delete(&ranges[i].obj);
+        array_destroy(make_system_allocator(),
+                (ARRAY_ANY *) &ranges[i].relative_faces);
     }
 }
 
@@ -155,6 +265,8 @@ void wavefront_obj_parse(struct wavefront_obj *obj, const byte *buffer)
  * @brief Builds a geometry object from the data contained within a parser
  * object. The geometry is not cleared ; the contents of the parsed data is
  * appended to the contents already present.
+ * Face corners referencing the same (position, UV, normal) triple are welded
+ * into a single vertex, so the faces share their vertices through indices.
  *
  * @param[in] obj Parser object.
  * @param[inout] geometry Target geometry object.
@@ -165,11 +277,44 @@ void wavefront_obj_to(const struct wavefront_obj *obj,
     u32 idx_face = 0;
     struct wavefront_obj_face face = { };
     u32 face_generated_indices[3] = { 0 };
+    ARRAY(struct weld_slot) weld_table = nullptr;
+    size_t weld_mask = 0;
+
+    // open addressing, kept under half full
+    weld_mask = 1;
+    while (weld_mask < (array_length(obj->f_array) * 3 * 2)) {
+        weld_mask <<= 1;
+    }
+    weld_table = array_create(make_system_allocator(), sizeof(*weld_table),
+            weld_mask);
+    for (size_t i = 0 ; i < weld_mask ; i++) {
+        array_push(weld_table, &(struct weld_slot) {
+                .vertex = WELD_SLOT_EMPTY });
+    }
+    weld_mask -= 1;
+
+    array_ensure_capacity(make_system_allocator(),
+            (void **) &geometry->faces, array_length(obj->f_array));
 
     for (size_t i = 0 ; i < array_length(obj->f_array) ; i++) {
 
         face = obj->f_array[i];
         for (size_t j = 0 ; j < 3 ; j++) {
+            size_t slot = weld_hash(face.v_idx[j], face.vt_idx[j],
+                    face.vn_idx[j]) & weld_mask;
+
+            while ((weld_table[slot].vertex != WELD_SLOT_EMPTY)
+                    && ((weld_table[slot].v_idx  != face.v_idx[j])
+                     || (weld_table[slot].vt_idx != face.vt_idx[j])
+                     || (weld_table[slot].vn_idx != face.vn_idx[j]))) {
+                slot = (slot + 1) & weld_mask;
+            }
+
+            if (weld_table[slot].vertex != WELD_SLOT_EMPTY) {
+                face_generated_indices[j] = weld_table[slot].vertex;
+                continue;
+            }
+
             geometry_push_vertex(geometry, &face_generated_indices[j]);
 
             geometry_vertex_pos(geometry, face_generated_indices[j],
@@ -178,12 +323,21 @@ void wavefront_obj_to(const struct wavefront_obj *obj,
                     obj->vn_array[face.vn_idx[j]]);
             geometry_vertex_uv(geometry, face_generated_indices[j],
                     obj->vt_array[face.vt_idx[j]]);
+
+            weld_table[slot] = (struct weld_slot) {
+                    .v_idx = face.v_idx[j],
+                    .vt_idx = face.vt_idx[j],
+                    .vn_idx = face.vn_idx[j],
+                    .vertex = face_generated_indices[j],
+            };
         }
 
         geometry_push_face(geometry, &idx_face);
         geometry_face_indices(geometry, idx_face, face_generated_indices);
     }
 
+    array_destroy(make_system_allocator(), (ARRAY_ANY *) &weld_table);
+
     geometry_set_smoothing(geometry, obj->smooth);
 }
 
@@ -222,333 +376,594 @@ void wavefront_obj_dump(struct wavefront_obj *obj, FILE *file)
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_end_line(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+/**
+ * @brief Parses the lines of a range, until its end or the first line that
+ * could not be understood.
+ *
+ * @param[inout] range Parsed range, receiving the data of its lines.
+ * @param[in] deferred Set if negative indices are resolved later, by the
+ * merge of the range.
+ */
+static void wavefront_parse_range(struct parser_range *range, bool deferred)
 {
-    (void) out_obj;
+    const byte *next = range->start;
+    struct parser_line line = { .deferred = deferred };
+
+    while (next < range->end) {
+        line.start = next;
+        line.cursor = next;
+        line.end = memchr(next, '\n', (size_t) (range->end - next));
+        if (!line.end) {
+            line.end = range->end;
+        }
+        line.number += 1;
+        next = line.end + 1;
 
-    return accept(state, (char []) { '\n' }, 1, NULL);
+        if (!wavefront_parse_line(&line, range)) {
+            range->failed = true;
+            range->failed_column = (u32) (line.cursor - line.start) + 1;
+            break;
+        }
+    }
+
+    range->lines = line.number;
 }
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
+/**
+ * @brief Parses a range from a worker thread.
+ *
+ * @param[inout] data Parsed range.
+ */
+static void wavefront_parse_range_task(void *data)
+{
+    wavefront_parse_range(data, true);
+}
 
-static i32 wavefront_parse_comment(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+/**
+ * @brief Appends the data of a range to the parser object. The indices of
+ * faces already are global, except for negative indices that were resolved
+ * against the data of the range alone : they are shifted by the data of the
+ * previous ranges. Returns false if parsing stopped in this range.
+ *
+ * @param[inout] obj Parser object, holding the data of the previous ranges.
+ * @param[inout] range Merged range.
+ * @param[in] line_offset Number of lines in the previous ranges.
+ * @return bool
+ */
+static bool wavefront_merge_range(struct wavefront_obj *obj,
+        struct parser_range *range, u32 line_offset)
 {
-    (void) out_obj;
+    u32 offsets[3] = {
+            (u32) array_length(obj->v_array),
+            (u32) array_length(obj->vt_array),
+            (u32) array_length(obj->vn_array),
+    };
+    struct parser_relative_face relative = { 0 };
+    u32 *index = nullptr;
+    bool reaches_before = false;
+
+    for (size_t i = 0 ; i < array_length(range->relative_faces) ; i++) {
+        relative = range->relative_faces[i];
+        for (size_t bit = 0 ; bit < 9 ; bit++) {
+            if (relative.mask & (1u << bit)) {
+                index = wavefront_relative_index(
+                        range->obj.f_array + relative.face, bit);
+                reaches_before = reaches_before || (((i32) *index < 0)
+                        && ((u32) -(i32) *index > offsets[bit % 3]));
+            }
+        }
+    }
 
-    // detect comment character
-    if (!accept(state, (char []) { '#' }, 1, NULL)) {
-        return 0;
+    // rare : some index reaches before the start of the file, the range is
+    // parsed again to stop at the same place a single pass would
+    if (reaches_before) {
+        struct parser_range single_pass = {
+                .start = range->start,
+                .end = range->end,
+                .obj = *obj,
+        };
+        wavefront_parse_range(&single_pass, false);
+        *obj = single_pass.obj;
+        wavefront_report_range(&single_pass, line_offset);
+        return !single_pass.failed;
     }
 
-    while (!lookup(state, (char []) { '\n' }, 1, NULL)) {
-        parser_state_advance(state);
+    for (size_t i = 0 ; i < array_length(range->relative_faces) ; i++) {
+        relative = range->relative_faces[i];
+        for (size_t bit = 0 ; bit < 9 ; bit++) {
+            if (relative.mask & (1u << bit)) {
+                index = wavefront_relative_index(
+                        range->obj.f_array + relative.face, bit);
+                *index += offsets[bit % 3];
+            }
+        }
     }
-    return 1;
-}
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
+    array_ensure_capacity(make_system_allocator(), (ARRAY_ANY *) &obj->v_array,
+            array_length(range->obj.v_array));
+    array_append_mem(obj->v_array, range->obj.v_array,
+            array_length(range->obj.v_array));
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &obj->vt_array, array_length(range->obj.vt_array));
+    array_append_mem(obj->vt_array, range->obj.vt_array,
+            array_length(range->obj.vt_array));
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &obj->vn_array, array_length(range->obj.vn_array));
+    array_append_mem(obj->vn_array, range->obj.vn_array,
+            array_length(range->obj.vn_array));
+    array_ensure_capacity(make_system_allocator(), (ARRAY_ANY *) &obj->f_array,
+            array_length(range->obj.f_array));
+    array_append_mem(obj->f_array, range->obj.f_array,
+            array_length(range->obj.f_array));
+
+    if (range->smooth_set) {
+        obj->smooth = range->obj.smooth;
+    }
+
+    wavefront_report_range(range, line_offset);
+
+    return !range->failed;
+}
 
-static i32 wavefront_parse_obj_name(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+/**
+ * @brief Finds the index of a face flagged by one bit of a relative mask.
+ *
+ * @param[in] face Face holding the index.
+ * @param[in] bit Bit of the mask, (corner * 3) + (0 for v, 1 for vt, 2 for vn).
+ * @return u32 *
+ */
+static u32 *wavefront_relative_index(struct wavefront_obj_face *face,
+        size_t bit)
 {
-    (void) out_obj;
+    switch (bit % 3) {
+        case 0:
+            return face->v_idx + (bit / 3);
+        case 1:
+            return face->vt_idx + (bit / 3);
+        default:
+            return face->vn_idx + (bit / 3);
+    }
+}
 
-    // detect 'o' starting letter
-    if (!accept(state, (char []) { 'o' }, 1, NULL)) {
-        return 0;
+/**
+ * @brief Reports the problems met while parsing a range.
+ *
+ * @param[in] range Parsed range.
+ * @param[in] line_offset Number of lines in the previous ranges.
+ */
+static void wavefront_report_range(const struct parser_range *range,
+        u32 line_offset)
+{
+    if (range->smoothing_warning) {
+        fprintf(stderr, "at line %d ; expected one of : 0 1\n",
+                line_offset + range->smoothing_warning);
     }
 
-    while (!lookup(state, (char []) { '\n' }, 1, NULL)) {
-        parser_state_advance(state);
+    if (range->failed) {
+        fprintf(stderr, "at line %d:%d ; parsing error. The resulting "
+                "geometry may be malformed.\n", line_offset + range->lines,
+                range->failed_column);
     }
-    return 1;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_obj_smoothing(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+/**
+ * @brief Parses one line of the file, dispatching on its first keyword.
+ * Returns false if the line could not be understood.
+ *
+ * @param[inout] line Parsed line.
+ * @param[inout] range Range receiving the line's data.
+ * @return bool
+ */
+static bool wavefront_parse_line(struct parser_line *line,
+        struct parser_range *range)
 {
-    (void) out_obj;
-    char is_smooth = '0';
+    struct wavefront_obj *out_obj = &range->obj;
+    f32 values[3] = { 0 };
 
-    // detect 'o' starting letter
-    if (!accept(state, (char []) { 's' }, 1, NULL)) {
-        return 0;
+    // windows line endings
+    if ((line->end > line->cursor) && (line->end[-1] == '\r')) {
+        line->end -= 1;
     }
 
-    skip_whitespace(state);
+    skip_whitespace(line);
 
-    if (expect(state, (char []) { '0', '1' }, 2, &is_smooth)) {
-        out_obj->smooth = (is_smooth == '1');
+    if ((line->cursor == line->end) || (*line->cursor == '#')) {
+        return true;
     }
 
-    return 1;
-}
+    if (parser_keyword(line, "v")) {
+        if (!wavefront_parse_vector(line, values, 3)) return false;
+        parser_reserve((ARRAY_ANY *) &out_obj->v_array);
+        array_push(out_obj->v_array,
+                &(struct vector3) { values[0], values[1], values[2] });
+        return true;
+    }
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
+    if (parser_keyword(line, "vn")) {
+        if (!wavefront_parse_vector(line, values, 3)) return false;
+        parser_reserve((ARRAY_ANY *) &out_obj->vn_array);
+        array_push(out_obj->vn_array,
+                &(struct vector3) { values[0], values[1], values[2] });
+        return true;
+    }
 
-static i32 wavefront_parse_vertex(struct parser_state *state,
-        struct wavefront_obj *out_obj)
-{
-    skip_whitespace(state);
+    if (parser_keyword(line, "vt")) {
+        if (!wavefront_parse_vector(line, values, 2)) return false;
+        parser_reserve((ARRAY_ANY *) &out_obj->vt_array);
+        array_push(out_obj->vt_array,
+                &(struct vector2) { values[0], values[1] });
+        return true;
+    }
 
-    if (!accept(state, (char []) { 'v' }, 1, NULL)) {
-        return 0;
+    if (parser_keyword(line, "f")) {
+        return wavefront_parse_face(line, range);
     }
 
-    if (accept(state, (char []) { 'n' }, 1, NULL)) {
-        return wavefront_parse_vertex_normal(state, out_obj);
+    if (parser_keyword(line, "s")) {
+        return wavefront_parse_smoothing(line, range);
     }
 
-    if (accept(state, (char []) { 't' }, 1, NULL)) {
-        return wavefront_parse_vertex_texture(state, out_obj);
+    // names, groups and materials are not used
+    if (parser_keyword(line, "o") || parser_keyword(line, "g")
+            || parser_keyword(line, "mtllib")
+            || parser_keyword(line, "usemtl")) {
+        return true;
     }
 
-    return wavefront_parse_vertex_pos(state, out_obj);
+    return false;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_vertex_pos(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+static bool wavefront_parse_smoothing(struct parser_line *line,
+        struct parser_range *range)
 {
-    vector3 pos = { 0 };
-
-    skip_whitespace(state);
+    skip_whitespace(line);
 
-    if (wavefront_parse_value(state, &pos.x)
-            && wavefront_parse_value(state, &pos.y)
-            && wavefront_parse_value(state, &pos.z)) {
-
-        array_ensure_capacity(make_system_allocator(),
-                (void **) &out_obj->v_array, 1);
-        array_push(out_obj->v_array, &pos);
+    if (parser_keyword(line, "1") || parser_keyword(line, "on")) {
+        range->obj.smooth = true;
+        range->smooth_set = true;
+        return true;
+    }
 
-        return 1;
+    if (parser_keyword(line, "0") || parser_keyword(line, "off")) {
+        range->obj.smooth = false;
+        range->smooth_set = true;
+        return true;
     }
 
-    return 0;
+    range->smoothing_warning = line->number;
+    return true;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_vertex_normal(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+static bool wavefront_parse_vector(struct parser_line *line, f32 *out_values,
+        size_t nb)
 {
-    vector3 normal = { 0 };
-
-    skip_whitespace(state);
-
-    if (wavefront_parse_value(state, &normal.x)
-            && wavefront_parse_value(state, &normal.y)
-            && wavefront_parse_value(state, &normal.z)) {
-
-        array_ensure_capacity(make_system_allocator(),
-                (void **) &out_obj->vn_array, 1);
-        array_push(out_obj->vn_array, &normal);
-        return 1;
+    for (size_t i = 0 ; i < nb ; i++) {
+        if (!wavefront_parse_value(line, out_values + i)) {
+            return false;
+        }
     }
 
-    return 0;
-
+    return true;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_vertex_texture(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+/**
+ * @brief Parses a face made of three points or more. Polygons are split into
+ * triangles sharing their first point, which is enough for the convex
+ * polygons modeling tools export.
+ *
+ * @param[inout] line
+ * @param[inout] range Range receiving the triangles.
+ * @return bool
+ */
+static bool wavefront_parse_face(struct parser_line *line,
+        struct parser_range *range)
 {
-    vector3 uv = { 0 };
+    struct parser_face_point small_points[PARSER_POLYGON_POINTS_SMALL];
+    ARRAY(struct parser_face_point) large_points = nullptr;
+    struct parser_face_point *points = small_points;
+    size_t points_nb = 0;
+    bool parsed = true;
+
+    skip_whitespace(line);
+    while (parsed && (line->cursor != line->end)) {
+        // rare : huge polygons
+        if (points_nb == PARSER_POLYGON_POINTS_SMALL) {
+            large_points = array_create(make_system_allocator(),
+                    sizeof(*large_points), 2 * PARSER_POLYGON_POINTS_SMALL);
+            array_append_mem(large_points, small_points, points_nb);
+        }
+        if (large_points) {
+            parser_reserve((ARRAY_ANY *) &large_points);
+            array_push(large_points, &(struct parser_face_point) { 0 });
+            points = large_points;
+        }
 
-    skip_whitespace(state);
+        line->relative_mask = 0;
+        parsed = wavefront_parse_face_point(line, &range->obj,
+                points + points_nb);
+        points[points_nb].relative_mask = line->relative_mask;
+        points_nb += 1;
 
-    if (wavefront_parse_value(state, &uv.x)
-            && wavefront_parse_value(state, &uv.y)) {
+        if (parsed) {
+            skip_whitespace(line);
+        }
+    }
 
-        array_ensure_capacity(make_system_allocator(),
-                (void **) &out_obj->vt_array, 1);
-        array_push(out_obj->vt_array, &uv);
-        return 1;
+    parsed = parsed && (points_nb >= 3);
+    if (parsed) {
+        wavefront_push_polygon(line, range, points, points_nb);
     }
 
-    return 0;
-}
+    if (large_points) {
+        array_destroy(make_system_allocator(), (ARRAY_ANY *) &large_points);
+    }
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
+    return parsed;
+}
 
-static i32 wavefront_parse_face(struct parser_state *state,
-        struct wavefront_obj *out_obj)
+/**
+ * @brief Splits a polygon into a fan of triangles pushed to the range's faces.
+ *
+ * @param[in] line Line the polygon was read from.
+ * @param[inout] range Range receiving the triangles.
+ * @param[in] points Points of the polygon, in order.
+ * @param[in] points_nb Number of points, at least three.
+ */
+static void wavefront_push_polygon(struct parser_line *line,
+        struct parser_range *range, const struct parser_face_point *points,
+        size_t points_nb)
 {
     struct wavefront_obj_face face = { 0 };
-    i32 face_data[3][3] = { 0 };
+    const struct parser_face_point *corners[3] = { points };
+    u16 relative_mask = 0;
 
-    if (!accept(state, (char []) { 'f' }, 1, NULL)) {
-        return 0;
-    }
+    for (size_t i = 1 ; (i + 1) < points_nb ; i++) {
+        corners[1] = points + i;
+        corners[2] = points + i + 1;
 
-    if (!(wavefront_parse_face_point(state, face_data[0])
-            && wavefront_parse_face_point(state, face_data[1])
-            && wavefront_parse_face_point(state, face_data[2]))) {
-        return 0;
-    }
+        relative_mask = 0;
+        for (size_t j = 0 ; j < 3 ; j++) {
+            face.v_idx[j]  = corners[j]->v;
+            face.vt_idx[j] = corners[j]->vt;
+            face.vn_idx[j] = corners[j]->vn;
+            relative_mask |= (u16) (corners[j]->relative_mask << (j * 3));
+        }
 
-    for (size_t i = 0 ; i < 3 ; i++) {
-        face.v_idx[i] = face_data[i][0] - 1;
-        if (face_data[i][1] > 0) face.vt_idx[i] = face_data[i][1] - 1;
-        if (face_data[i][2] > 0) face.vn_idx[i] = face_data[i][2] - 1;
-    }
+        if (relative_mask) {
+            parser_reserve((ARRAY_ANY *) &range->relative_faces);
+            array_push(range->relative_faces, &(struct parser_relative_face) {
+                    .face = (u32) array_length(range->obj.f_array),
+                    .line = line->number,
+                    .mask = relative_mask,
+            });
+        }
 
-    array_ensure_capacity(make_system_allocator(),
-            (void **) &out_obj->f_array, 1);
-    array_push(out_obj->f_array, &face);
-    return 1;
+        parser_reserve((ARRAY_ANY *) &range->obj.f_array);
+        array_push(range->obj.f_array, &face);
+    }
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_face_point(struct parser_state *state,
-        i32 read_idx[3])
+/**
+ * @brief Parses a face point : v, v/vt, v//vn or v/vt/vn. Missing indices are
+ * set to zero.
+ *
+ * @param[inout] line
+ * @param[in] obj Parser object, to resolve relative indices.
+ * @param[out] out_point
+ * @return bool
+ */
+static bool wavefront_parse_face_point(struct parser_line *line,
+        const struct wavefront_obj *obj, struct parser_face_point *out_point)
 {
-    skip_whitespace(state);
+    *out_point = (struct parser_face_point) { 0 };
 
-    read_idx[0] = 0;
-    read_idx[1] = 0;
-    read_idx[2] = 0;
+    skip_whitespace(line);
 
-    if (!wavefront_parse_value_uint(state, &read_idx[0])) {
-        return 0;
+    if (!wavefront_parse_index(line, array_length(obj->v_array), 1u,
+                &out_point->v)) {
+        return false;
     }
 
-    if (!accept(state, (char []) { '/' }, 1, NULL)) {
-        return 1;
+    if ((line->cursor == line->end) || (*line->cursor != '/')) {
+        return true;
     }
+    line->cursor += 1;
 
-    if (!accept(state, (char []) { '/' }, 1, NULL)) {
-        wavefront_parse_value_uint(state, &read_idx[1]);
-        if (accept(state, (char []) { '/' }, 1, NULL)) {
-            return wavefront_parse_value_uint(state, &read_idx[2]);
-        } else {
-            return 1;
+    if ((line->cursor < line->end) && (*line->cursor != '/')) {
+        if (!wavefront_parse_index(line, array_length(obj->vt_array), 2u,
+                    &out_point->vt)) {
+            return false;
         }
     }
 
-    return wavefront_parse_value_int(state, &read_idx[2]);
-}
+    if ((line->cursor == line->end) || (*line->cursor != '/')) {
+        return true;
+    }
+    line->cursor += 1;
 
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
+    return wavefront_parse_index(line, array_length(obj->vn_array), 4u,
+            &out_point->vn);
+}
 
-static i32 wavefront_parse_value(struct parser_state *state, f32 *out_value)
+/**
+ * @brief Parses an index of the file, and makes it zero-based. Negative
+ * indices are relative to the end of the data read so far. When the line is
+ * part of a range parsed on its own, they are relative to the end of the data
+ * of the range, and flagged to be fixed when the range is merged.
+ *
+ * @param[inout] line
+ * @param[in] count Number of elements the index can reference.
+ * @param[in] relative_bit Bit flagging the index as relative to the range.
+ * @param[out] out_index
+ * @return bool
+ */
+static bool wavefront_parse_index(struct parser_line *line, size_t count,
+        u16 relative_bit, u32 *out_index)
 {
-    i32 parsed_value = 0;
-    f32 int_part = 0.f;
-    f32 frac_part = 0.f;
-    f32 sign = 1.f;
-    size_t frac_part_start = 0;
-    size_t frac_part_length = 0;
-
-    skip_whitespace(state);
-
-    if (accept(state, (char[]) { '-' }, 1, NULL)) {
-        sign = -1.f;
-    }
-
-    if (!wavefront_parse_value_uint(state, &parsed_value)) {
-        return 0;
-    }
-    int_part = parsed_value;
+    i32 value = 0;
 
-    if (accept(state, (char[]) { '.' }, 1, NULL)) {
-        frac_part_start = state->buffer_idx;
-        wavefront_parse_value_uint(state, &parsed_value);
-        frac_part_length = state->buffer_idx - frac_part_start;
-        frac_part = (f32) parsed_value;
+    if (!wavefront_parse_value_int(line, &value) || (value == 0)) {
+        return false;
     }
 
-    for (size_t i = 0 ; i < frac_part_length ; i++) {
-        frac_part /= 10.f;
+    if (value > 0) {
+        *out_index = (u32) (value - 1);
+    } else if (line->deferred) {
+        // may wrap around, until the merge adds the previous ranges' counts
+        *out_index = (u32) count - (u32) -value;
+        line->relative_mask |= relative_bit;
+    } else if ((size_t) -value <= count) {
+        *out_index = (u32) (count - (size_t) -value);
+    } else {
+        return false;
     }
-
-    *out_value = sign * (int_part + frac_part);
-
-    return 1;
+    return true;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_value_int(struct parser_state *state, i32 *out_value)
+/**
+ * @brief Parses a decimal number, with an optional exponent. Numbers with few
+ * enough digits are computed directly, others go through strtof().
+ *
+ * @param[inout] line
+ * @param[out] out_value
+ * @return bool
+ */
+static bool wavefront_parse_value(struct parser_line *line, f32 *out_value)
 {
-    i32 value = 0;
-    i32 sign = 1;
-    i32 valid = 0;
-    char read_c = '+';
+    static const double powers_of_ten[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+            1e22,
+    };
+    const byte *start = nullptr;
+    bool negative = false;
+    u64 mantissa = 0;
+    size_t digits = 0;
+    i32 exponent = 0;
+    i32 written_exponent = 0;
+    bool exponent_negative = false;
+    double value = 0.;
+
+    skip_whitespace(line);
+    start = line->cursor;
+
+    if ((line->cursor < line->end)
+            && ((*line->cursor == '-') || (*line->cursor == '+'))) {
+        negative = (*line->cursor == '-');
+        line->cursor += 1;
+    }
+
+    while ((line->cursor < line->end)
+            && (*line->cursor >= '0') && (*line->cursor <= '9')) {
+        mantissa = (mantissa * 10) + (u64) (*line->cursor - '0');
+        digits += 1;
+        line->cursor += 1;
+    }
+
+    if ((line->cursor < line->end) && (*line->cursor == '.')) {
+        line->cursor += 1;
+        while ((line->cursor < line->end)
+                && (*line->cursor >= '0') && (*line->cursor <= '9')) {
+            mantissa = (mantissa * 10) + (u64) (*line->cursor - '0');
+            digits += 1;
+            exponent -= 1;
+            line->cursor += 1;
+        }
+    }
 
-    skip_whitespace(state);
+    if (digits == 0) {
+        line->cursor = start;
+        return false;
+    }
 
-    if (lookup(state, (char[]) { '+', '-' }, 2, &read_c)) {
-        if (read_c == '-') sign = -1;
-        parser_state_advance(state);
+    if ((line->cursor < line->end)
+            && ((*line->cursor == 'e') || (*line->cursor == 'E'))) {
+        line->cursor += 1;
+        if ((line->cursor < line->end)
+                && ((*line->cursor == '-') || (*line->cursor == '+'))) {
+            exponent_negative = (*line->cursor == '-');
+            line->cursor += 1;
+        }
+        while ((line->cursor < line->end)
+                && (*line->cursor >= '0') && (*line->cursor <= '9')) {
+            if (written_exponent < 10000) {
+                written_exponent = (written_exponent * 10)
+                        + (*line->cursor - '0');
+            }
+            line->cursor += 1;
+        }
+        exponent += exponent_negative ? -written_exponent : written_exponent;
     }
 
-    valid = wavefront_parse_value_uint(state, &value);
-    if (valid) {
-        *out_value = sign * value;
+    if ((digits <= PARSER_FAST_DIGITS_MAX)
+            && (exponent >= -(i32) (COUNT_OF(powers_of_ten) - 1))
+            && (exponent <= (i32) (COUNT_OF(powers_of_ten) - 1))) {
+        value = (double) mantissa;
+        value = (exponent < 0) ? value / powers_of_ten[-exponent]
+                               : value * powers_of_ten[exponent];
+    } else {
+        // rare : many digits or a large exponent
+        char copy[64] = { 0 };
+        size_t length = (size_t) (line->cursor - start);
+
+        length = (length < (sizeof(copy) - 1)) ? length : sizeof(copy) - 1;
+        memcpy(copy, start, length);
+        value = strtod(copy, nullptr);
+        negative = false;
     }
 
-    return valid;
+    *out_value = (f32) (negative ? -value : value);
+    return true;
 }
 
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-static i32 wavefront_parse_value_uint(struct parser_state *state,
+static bool wavefront_parse_value_int(struct parser_line *line,
         i32 *out_value)
 {
     i32 value = 0;
-    i32 valid = 0;
-    char read_c = '\0';
+    bool negative = false;
+    const byte *start = nullptr;
 
-    if (!expect(state, (char[])
-            { '0','1','2','3','4','5','6','7','8','9', }, 10, &read_c)) {
-        return 0;
+    if ((line->cursor < line->end)
+            && ((*line->cursor == '-') || (*line->cursor == '+'))) {
+        negative = (*line->cursor == '-');
+        line->cursor += 1;
     }
 
-    do {
-        valid = 1;
-        value *= 10;
-        value += read_c - '0';
-    } while (accept(state, (char[])
-            { '0','1','2','3','4','5','6','7','8','9', }, 10, &read_c));
-
-    if (valid) {
-        *out_value = value;
+    start = line->cursor;
+    while ((line->cursor < line->end)
+            && (*line->cursor >= '0') && (*line->cursor <= '9')
+            && ((line->cursor - start) < (ptrdiff_t) PARSER_INDEX_DIGITS_MAX)) {
+        value = (value * 10) + (*line->cursor - '0');
+        line->cursor += 1;
     }
 
-    return valid;
-}
-
-// -----------------------------------------------------------------------------
-// -----------------------------------------------------------------------------
-
-static i32 wavefront_parse_end_of_obj(struct parser_state *state,
-        struct wavefront_obj *out_obj)
-{
-    (void) out_obj;
+    if (line->cursor == start) {
+        return false;
+    }
 
-    return ((state->buffer_idx+1) >= array_length(state->buffer_array));
+    *out_value = negative ? -value : value;
+    return true;
 }
 
 // -----------------------------------------------------------------------------
@@ -556,101 +971,60 @@ static i32 wavefront_parse_end_of_obj(struct parser_state *state,
 // -----------------------------------------------------------------------------
 
 /**
- * @brief Parser utility to read a character among a list of possibilities.
- * If a match is found, 1 is returned and the character is read. Otherwise,
- * nothing happens and the function returns 0.
+ * @brief Makes room for at least one more element in an array, doubling its
+ * capacity when it is full.
  *
- * @param[inout] state Current parser state.
- * @param[in] alternatives List of characters (there must be at least nb
- * characters in the list).
- * @param[in] nb Number of characters.
- * @param[out] c_out Optional pointer willed with the read character.
- * @return i32
+ * @param[inout] array
  */
-static i32 accept(struct parser_state *state, char *alternatives, size_t nb,
-        char *c_out)
+static void parser_reserve(ARRAY_ANY *array)
 {
-    if (lookup(state, alternatives, nb, c_out)) {
-        parser_state_advance(state);
-        return 1;
-    }
+    size_t length = array_length(*array);
 
-    return 0;
+    if (length == array_capacity(*array)) {
+        array_ensure_capacity(make_system_allocator(), array,
+                (length > 0) ? length : 1);
+    }
 }
 
 /**
- * @brief Parser utility to read a character among a list of possibilities.
- * If a match is found, 1 is returned and the character is read. Otherwise,
- * an error is porduced.
+ * @brief Advances the line until a character other than a whitespace (space
+ * or tab) is found.
  *
- * @param[inout] state Current parser state.
- * @param[in] alternatives List of characters (there must be at least nb
- * characters in the list).
- * @param[in] nb Number of characters.
- * @param[out] c_out Optional pointer willed with the read character.
- * @return i32
+ * @param[inout] line
  */
-static i32 expect(struct parser_state *state, char *alternatives, size_t nb,
-        char *c_out)
+static void skip_whitespace(struct parser_line *line)
 {
-    if (accept(state, alternatives, nb, c_out)) {
-        return 1;
-    }
-
-    fprintf(stderr, "at line %d:%d ; ", state->line+1, state->column+1);
-
-    fprintf(stderr, "expected ");
-    if (nb == 0) {
-        fprintf(stderr, "end of stream");
-    } else {
-        fprintf(stderr, "one of : ");
-        for (size_t i = 0 ; i < nb ; i++) {
-            fprintf(stderr, "%c ", alternatives[i]);
-        }
-    }
-
-    fprintf(stderr, "\nbut found : ");
-    if (state->buffer_idx >= array_length(state->buffer_array)) {
-        fprintf(stderr, "end of stream.\n");
-    } else {
-        fprintf(stderr, "%c\n", state->buffer_array[state->buffer_idx]);
+    while ((line->cursor < line->end)
+            && ((*line->cursor == ' ') || (*line->cursor == '\t'))) {
+        line->cursor += 1;
     }
-
-    return 0;
 }
 
 /**
- * @brief Parser utility to read a character among a list of possibilities.
- * If a match is found, 1 is returned, and nothing else happens. Otherwise,
- * the function returns 0.
+ * @brief Reads a keyword if the line continues with it, followed by a
+ * whitespace or the end of the line.
  *
- * @param[inout] state Current parser state.
- * @param[in] alternatives List of characters (there must be at least nb
- * characters in the list).
- * @param[in] nb Number of characters.
- * @param[out] c_out Optional pointer willed with the read character.
- * @return i32
+ * @param[inout] line
+ * @param[in] keyword Expected keyword.
+ * @return bool
  */
-static i32 lookup(struct parser_state *state, char *alternatives, size_t nb,
-        char *c_out)
+static bool parser_keyword(struct parser_line *line, const char *keyword)
 {
-    i32 found = 0;
-    size_t alt_idx = 0;
+    size_t length = strlen(keyword);
 
-    if (state->buffer_idx >= array_length(state->buffer_array)) {
-        return 0;
+    if (((size_t) (line->end - line->cursor) < length)
+            || (memcmp(line->cursor, keyword, length) != 0)) {
+        return false;
     }
 
-    while (!found && (alt_idx < nb)) {
-        found = state->buffer_array[state->buffer_idx] == alternatives[alt_idx];
-        alt_idx += 1;
+    if ((line->cursor + length < line->end)
+            && (line->cursor[length] != ' ')
+            && (line->cursor[length] != '\t')) {
+        return false;
     }
 
-    if (c_out) {
-        *c_out = state->buffer_array[state->buffer_idx];
-    }
-
-    return found;
+    line->cursor += length;
+    return true;
 }
 
 // -----------------------------------------------------------------------------
@@ -658,33 +1032,21 @@ static i32 lookup(struct parser_state *state, char *alternatives, size_t nb,
 // -----------------------------------------------------------------------------
 
 /**
- * @brief Advances the parser state one character.
+ * @brief Mixes the indices of a face corner into a hash used to find it in the
+ * weld table.
  *
- * @param[inout] state
+ * @param[in] v_idx Position index.
+ * @param[in] vt_idx UV index.
+ * @param[in] vn_idx Normal index.
+ * @return u32
  */
-static void parser_state_advance(struct parser_state *state)
+static u32 weld_hash(u32 v_idx, u32 vt_idx, u32 vn_idx)
 {
-    if (state->buffer_idx >= array_length(state->buffer_array)) {
-        return;
-    }
-
-    if (state->buffer_array[state->buffer_idx] == '\n') {
-        state->column = 0;
-        state->line  += 1;
-    } else {
-        state->column += 1;
-    }
+    u32 hash = 2166136261u;
 
-    state->buffer_idx += 1;
-}
+    hash = (hash ^ v_idx)  * 16777619u;
+    hash = (hash ^ vt_idx) * 16777619u;
+    hash = (hash ^ vn_idx) * 16777619u;
 
-/**
- * @brief Advances the parser state until a character other than a whitespace
- * (space or tab) is found.
- *
- * @param[inout] state
- */
-static void skip_whitespace(struct parser_state *state)
-{
-    while (accept(state, (char[]) { ' ', '\t' }, 2, NULL));
+    return hash ^ (hash >> 15);
 }
@@ -51,8 +51,8 @@ void wavefront_obj_create(struct wavefront_obj *obj);
 // Releases memory from a parsing object.
 void wavefront_obj_delete(struct wavefront_obj *obj);
 // Loads an obj file (already in a buffer) to a parsing object.
-void wavefront_obj_parse(struct wavefront_obj *obj,
-        const ARRAY(byte) buffer_array);
+void wavefront_obj_parse(struct wavefront_obj *obj, const byte *buffer,
+        size_t length);
 // Builds a geometry from parsed data.
 void wavefront_obj_to(const struct wavefront_obj *obj,
         struct geometry *geometry);
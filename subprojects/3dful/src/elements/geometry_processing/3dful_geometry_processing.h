@@ -0,0 +1,46 @@
+/**
+ * @file 3dful_geometry_processing.h
+ * @author Gabriel Bédat
+ * @brief Provides passes reworking the data of geometries, without changing
+ * how they look, so they are cheaper to render.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef GEOMETRY_PROCESSING_3DFUL_H__
+#define GEOMETRY_PROCESSING_3DFUL_H__
+
+#include "../3dful_core.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Number of entries of the simulated post-transform vertex cache. */
+#define VERTEX_CACHE_SIZE (32u)
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// Reorders faces so that consecutive faces share vertices (Forsyth).
+void vertex_cache_optimize(struct face *faces, size_t faces_nb,
+        size_t vertices_nb);
+// Reorders vertices in the order faces first reference them.
+void vertex_fetch_optimize(struct vertex *vertices, size_t vertices_nb,
+        struct face *faces, size_t faces_nb);
+// Measures how well faces reuse a FIFO post-transform cache.
+struct geometry_cache_stats vertex_cache_measure(const struct face *faces,
+        size_t faces_nb, size_t vertices_nb);
+
+// Simplifies faces into a chain of coarser levels of detail (quadric error).
+size_t lod_chain_build(const struct vertex *vertices, size_t vertices_nb,
+        const struct face *faces, size_t faces_nb, size_t levels_nb,
+        ARRAY(struct face) *out_faces, struct geometry_lod *out_lods);
+// Splits faces into meshlets, reordering them so each meshlet is a range.
+size_t meshlets_build(const struct vertex *vertices, size_t vertices_nb,
+        struct face *faces, size_t faces_nb,
+        ARRAY(struct geometry_meshlet) *out_meshlets);
+
+#endif
@@ -0,0 +1,325 @@
+/**
+ * @file 3dful_meshlets.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the partitioning of geometries into meshlets.
+ *
+ * Meshlets are grown greedily : starting from the first face not yet taken,
+ * in the current order of the faces, a meshlet takes in the neighbouring face
+ * sharing the most vertices with it, until it runs out of vertices or faces.
+ * Each meshlet is then bounded by a sphere, and by a cone holding the normals
+ * of its faces so it can be dropped when it faces away from the camera.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "3dful_geometry_processing.h"
+
+#include <math.h>
+
+#include <ustd/array.h>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+static void meshlet_compute_bounds(const struct vertex *vertices,
+        const struct face *faces, struct geometry_meshlet *meshlet);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Splits faces into meshlets of at most GEOMETRY_MESHLET_VERTICES_MAX
+ * vertices and GEOMETRY_MESHLET_FACES_MAX faces. The faces are reordered so
+ * each meshlet is a range of them, and the meshlets are appended to an array.
+ * Returns the number of meshlets built.
+ *
+ * @param[in] vertices Vertices referenced by the faces.
+ * @param[in] vertices_nb Number of vertices.
+ * @param[inout] faces Faces split and reordered.
+ * @param[in] faces_nb Number of faces.
+ * @param[inout] out_meshlets Array receiving the meshlets.
+ * @return size_t
+ */
+size_t meshlets_build(const struct vertex *vertices, size_t vertices_nb,
+        struct face *faces, size_t faces_nb,
+        ARRAY(struct geometry_meshlet) *out_meshlets)
+{
+    struct allocator alloc = make_system_allocator();
+    u32 *adjacency_start = nullptr;
+    u32 *adjacency = nullptr;
+    u32 *vertex_meshlet = nullptr;
+    u8 *scores = nullptr;
+    bool *taken = nullptr;
+    struct face *sorted = nullptr;
+    u32 *candidates = nullptr;
+    size_t candidates_nb = 0;
+    size_t sorted_nb = 0;
+    size_t seed = 0;
+    size_t built_nb = 0;
+
+    if ((faces_nb == 0) || (vertices_nb == 0)) {
+        return 0;
+    }
+
+    adjacency_start = alloc.malloc(alloc,
+            (vertices_nb + 1) * sizeof(*adjacency_start));
+    adjacency = alloc.malloc(alloc, faces_nb * 3 * sizeof(*adjacency));
+    vertex_meshlet = alloc.malloc(alloc, vertices_nb * sizeof(*vertex_meshlet));
+    scores = alloc.malloc(alloc, faces_nb * sizeof(*scores));
+    taken = alloc.malloc(alloc, faces_nb * sizeof(*taken));
+    sorted = alloc.malloc(alloc, faces_nb * sizeof(*sorted));
+    // faces around the meshlet, each listed once per meshlet at most
+    candidates = alloc.malloc(alloc, faces_nb * sizeof(*candidates));
+
+    if (!adjacency_start || !adjacency || !vertex_meshlet || !scores || !taken
+            || !sorted || !candidates) {
+        goto cleanup;
+    }
+
+    // faces around each vertex
+    for (size_t i = 0 ; i <= vertices_nb ; i++) {
+        adjacency_start[i] = 0;
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            adjacency_start[faces[i].idx_vert[j] + 1] += 1;
+        }
+    }
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        adjacency_start[i + 1] += adjacency_start[i];
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            adjacency[adjacency_start[faces[i].idx_vert[j]]++] = (u32) i;
+        }
+    }
+    for (size_t i = vertices_nb ; i > 0 ; i--) {
+        adjacency_start[i] = adjacency_start[i - 1];
+    }
+    adjacency_start[0] = 0;
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        vertex_meshlet[i] = 0;
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        scores[i] = 0;
+        taken[i] = false;
+    }
+
+    while (sorted_nb < faces_nb) {
+        // vertices of the current meshlet are marked with its number, plus one
+        u32 mark = (u32) built_nb + 1;
+        struct geometry_meshlet meshlet = { .first_face = (u32) sorted_nb };
+        size_t meshlet_vertices_nb = 0;
+        size_t next = 0;
+        size_t best = 0;
+        size_t kept_nb = 0;
+
+        while (taken[seed]) {
+            seed += 1;
+        }
+        next = seed;
+
+        while (true) {
+            taken[next] = true;
+            sorted[sorted_nb++] = faces[next];
+            meshlet.faces_nb += 1;
+
+            // the faces around the new vertices share one more vertex with
+            // the meshlet
+            for (size_t j = 0 ; j < 3 ; j++) {
+                u32 vertex = faces[next].idx_vert[j];
+
+                if (vertex_meshlet[vertex] == mark) {
+                    continue;
+                }
+                vertex_meshlet[vertex] = mark;
+                meshlet_vertices_nb += 1;
+
+                for (u32 k = adjacency_start[vertex] ;
+                        k < adjacency_start[vertex + 1] ; k++) {
+                    u32 face = adjacency[k];
+
+                    if (taken[face]) {
+                        continue;
+                    }
+                    if (scores[face] == 0) {
+                        candidates[candidates_nb++] = face;
+                    }
+                    scores[face] += 1;
+                }
+            }
+
+            if (meshlet.faces_nb >= GEOMETRY_MESHLET_FACES_MAX) {
+                break;
+            }
+
+            // picks the candidate adding the fewest vertices, dropping the
+            // ones taken in the meantime
+            best = faces_nb;
+            kept_nb = 0;
+            for (size_t i = 0 ; i < candidates_nb ; i++) {
+                u32 face = candidates[i];
+                size_t added_nb = 0;
+
+                if (taken[face]) {
+                    scores[face] = 0;
+                    continue;
+                }
+                candidates[kept_nb++] = face;
+
+                for (size_t j = 0 ; j < 3 ; j++) {
+                    added_nb += (vertex_meshlet[faces[face].idx_vert[j]]
+                            != mark);
+                }
+                if ((meshlet_vertices_nb + added_nb
+                            <= GEOMETRY_MESHLET_VERTICES_MAX)
+                        && ((best == faces_nb)
+                                || (scores[face] > scores[best]))) {
+                    best = face;
+                }
+            }
+            candidates_nb = kept_nb;
+
+            if (best == faces_nb) {
+                break;
+            }
+            next = best;
+        }
+
+        for (size_t i = 0 ; i < candidates_nb ; i++) {
+            scores[candidates[i]] = 0;
+        }
+        candidates_nb = 0;
+
+        meshlet_compute_bounds(vertices, sorted + meshlet.first_face,
+                &meshlet);
+        array_ensure_capacity(alloc, (ARRAY_ANY *) out_meshlets, 1);
+        array_push(*out_meshlets, &meshlet);
+        built_nb += 1;
+    }
+
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        faces[i] = sorted[i];
+    }
+
+cleanup:
+    if (adjacency_start) alloc.free(alloc, adjacency_start);
+    if (adjacency) alloc.free(alloc, adjacency);
+    if (vertex_meshlet) alloc.free(alloc, vertex_meshlet);
+    if (scores) alloc.free(alloc, scores);
+    if (taken) alloc.free(alloc, taken);
+    if (sorted) alloc.free(alloc, sorted);
+    if (candidates) alloc.free(alloc, candidates);
+
+    return built_nb;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Computes the bounding sphere of a meshlet, around the center of its
+ * box, and the cone holding the normals of its faces. Meshlets whose normals
+ * spread over more than a half-sphere get a cutoff that never culls them.
+ *
+ * @param[in] vertices Vertices referenced by the faces.
+ * @param[in] faces Faces of the meshlet.
+ * @param[inout] meshlet Meshlet with its number of faces set.
+ */
+static void meshlet_compute_bounds(const struct vertex *vertices,
+        const struct face *faces, struct geometry_meshlet *meshlet)
+{
+    struct vector3 min = vertices[faces[0].idx_vert[0]].pos;
+    struct vector3 max = min;
+    struct vector3 normals[GEOMETRY_MESHLET_FACES_MAX] = { 0 };
+    struct vector3 axis = { 0 };
+    f32 radius_sq = 0.f;
+    f32 length = 0.f;
+    f32 min_dot = 1.f;
+
+    for (size_t i = 0 ; i < meshlet->faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            struct vector3 p = vertices[faces[i].idx_vert[j]].pos;
+
+            min.x = fminf(min.x, p.x);
+            min.y = fminf(min.y, p.y);
+            min.z = fminf(min.z, p.z);
+            max.x = fmaxf(max.x, p.x);
+            max.y = fmaxf(max.y, p.y);
+            max.z = fmaxf(max.z, p.z);
+        }
+    }
+
+    meshlet->center = (struct vector3) {
+            (min.x + max.x) * .5f,
+            (min.y + max.y) * .5f,
+            (min.z + max.z) * .5f,
+    };
+
+    for (size_t i = 0 ; i < meshlet->faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            struct vector3 p = vertices[faces[i].idx_vert[j]].pos;
+            f32 dx = p.x - meshlet->center.x;
+            f32 dy = p.y - meshlet->center.y;
+            f32 dz = p.z - meshlet->center.z;
+
+            radius_sq = fmaxf(radius_sq, (dx * dx) + (dy * dy) + (dz * dz));
+        }
+    }
+    meshlet->radius = sqrtf(radius_sq);
+
+    // the axis is the mean of the faces' normals, and the cone opens as much
+    // as needed to hold all of them
+    for (size_t i = 0 ; i < meshlet->faces_nb ; i++) {
+        struct vector3 p0 = vertices[faces[i].idx_vert[0]].pos;
+        struct vector3 p1 = vertices[faces[i].idx_vert[1]].pos;
+        struct vector3 p2 = vertices[faces[i].idx_vert[2]].pos;
+        struct vector3 e1 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+        struct vector3 e2 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+        struct vector3 n = {
+                (e1.y * e2.z) - (e1.z * e2.y),
+                (e1.z * e2.x) - (e1.x * e2.z),
+                (e1.x * e2.y) - (e1.y * e2.x),
+        };
+
+        length = sqrtf((n.x * n.x) + (n.y * n.y) + (n.z * n.z));
+        if (length > 0.f) {
+            normals[i] = (struct vector3) {
+                    n.x / length, n.y / length, n.z / length };
+        }
+        axis.x += normals[i].x;
+        axis.y += normals[i].y;
+        axis.z += normals[i].z;
+    }
+
+    length = sqrtf((axis.x * axis.x) + (axis.y * axis.y) + (axis.z * axis.z));
+    if (length <= 0.f) {
+        meshlet->cone_axis = (struct vector3) { 0.f, 0.f, 1.f };
+        meshlet->cone_cutoff = 1.f;
+        return;
+    }
+    meshlet->cone_axis = (struct vector3) {
+            axis.x / length, axis.y / length, axis.z / length };
+
+    for (size_t i = 0 ; i < meshlet->faces_nb ; i++) {
+        f32 dot = (normals[i].x * meshlet->cone_axis.x)
+                + (normals[i].y * meshlet->cone_axis.y)
+                + (normals[i].z * meshlet->cone_axis.z);
+
+        // degenerate faces cannot be seen either way
+        if ((normals[i].x != 0.f) || (normals[i].y != 0.f)
+                || (normals[i].z != 0.f)) {
+            min_dot = fminf(min_dot, dot);
+        }
+    }
+
+    // sine of the cone's half-angle : the cosine of the angle the view
+    // direction must keep with the axis, negated
+    meshlet->cone_cutoff = (min_dot <= 0.f) ? 1.f
+            : sqrtf(1.f - (min_dot * min_dot));
+}
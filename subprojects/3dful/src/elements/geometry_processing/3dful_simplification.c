@@ -0,0 +1,770 @@
+/**
+ * @file 3dful_simplification.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the simplification of geometries into coarser
+ * levels of detail.
+ *
+ * Edges are collapsed by increasing quadric error (Garland & Heckbert) : each
+ * position accumulates the planes of the faces around it, and the cost of
+ * moving a position onto another is its mean squared distance to those planes.
+ * Vertices are only ever collapsed onto existing vertices, so every level of
+ * detail shares the vertices of the full geometry and only needs its own
+ * indices.
+ * Vertices sharing a position, split by different normals or UVs, collapse
+ * together : each one moves onto the vertex of the target position with the
+ * closest attributes. Positions on open borders, or whose vertices have
+ * different UVs, never move, to keep silhouettes and textures intact.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "3dful_geometry_processing.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <ustd/array.h>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Levels reducing less than this ratio of the previous level's faces end the
+ * chain : the geometry cannot be simplified further. */
+#define SIMPLIFY_MIN_REDUCTION (.9f)
+
+/** Cosine of the largest turn a collapse can give to the faces it moves. */
+#define SIMPLIFY_MAX_TURN_COSINE (.25f)
+
+/**
+ * @brief Sum of squared distances to a set of planes, as a symmetric matrix.
+ */
+struct simplify_quadric {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double weight;
+};
+
+/**
+ * @brief Candidate collapse of a vertex onto another.
+ */
+struct simplify_collapse {
+    u32 from, to;
+    f32 cost;
+};
+
+/**
+ * @brief Vertex sorted by position, to find vertices sharing their position.
+ */
+struct simplify_position {
+    struct vector3 pos;
+    u32 vertex;
+};
+
+/**
+ * @brief Vertices grouped by position. A group is named after its first
+ * vertex, and quadrics, locks and collapses work on groups.
+ */
+struct simplify_groups {
+    /** Group of each vertex. */
+    u32 *of_vertex;
+    /** Vertices of all groups, one group after the other. */
+    u32 *members;
+    /** Start of the members of each group, indexed by group, plus the end. */
+    u32 *members_start;
+};
+
+static bool simplify_group_vertices(const struct vertex *vertices,
+        size_t vertices_nb, struct simplify_groups *groups);
+static void simplify_lock_groups(const struct vertex *vertices,
+        size_t vertices_nb, const struct face *faces, size_t faces_nb,
+        const struct simplify_groups *groups, bool *out_locked);
+static size_t simplify_pass(const struct vertex *vertices, size_t vertices_nb,
+        struct face *faces, size_t faces_nb, size_t target_nb,
+        const struct simplify_groups *groups,
+        struct simplify_quadric *quadrics, const bool *locked, f32 *max_cost);
+static bool simplify_flips(const struct vertex *vertices,
+        const struct face *faces, const u32 *group_of_vertex,
+        const u32 *adjacency, u32 adjacency_start, u32 adjacency_end,
+        u32 from, u32 to);
+static u32 simplify_twin(const struct vertex *vertices,
+        const struct simplify_groups *groups, u32 vertex, u32 group);
+
+static void simplify_quadric_add_plane(struct simplify_quadric *quadric,
+        const double plane[4]);
+static void simplify_quadric_add(struct simplify_quadric *quadric,
+        const struct simplify_quadric *other);
+static f32 simplify_quadric_cost(const struct simplify_quadric *a,
+        const struct simplify_quadric *b, struct vector3 pos);
+
+static i32 simplify_position_compare(const void *lhs, const void *rhs);
+static i32 simplify_edge_compare(const void *lhs, const void *rhs);
+static i32 simplify_collapse_compare(const void *lhs, const void *rhs);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Simplifies faces into a chain of coarser levels of detail, each with
+ * about half the faces of the previous one. The faces of the new levels are
+ * appended to an array, and each level is described by its range in the
+ * array and the error it introduces, in model space.
+ * Returns the number of levels built, which can be less than requested when
+ * the faces cannot be simplified further.
+ *
+ * @param[in] vertices Vertices shared by all levels.
+ * @param[in] vertices_nb Number of vertices.
+ * @param[in] faces Faces of the full geometry.
+ * @param[in] faces_nb Number of faces.
+ * @param[in] levels_nb Number of levels to build, beyond the full geometry.
+ * @param[inout] out_faces Array receiving the faces of the new levels.
+ * @param[out] out_lods At least levels_nb levels, filled with the new levels.
+ * @return size_t
+ */
+size_t lod_chain_build(const struct vertex *vertices, size_t vertices_nb,
+        const struct face *faces, size_t faces_nb, size_t levels_nb,
+        ARRAY(struct face) *out_faces, struct geometry_lod *out_lods)
+{
+    struct allocator alloc = make_system_allocator();
+    struct simplify_groups groups = { 0 };
+    struct simplify_quadric *quadrics = nullptr;
+    bool *locked = nullptr;
+    struct face *current = nullptr;
+    size_t current_nb = faces_nb;
+    size_t built_nb = 0;
+    f32 max_cost = 0.f;
+
+    if ((faces_nb == 0) || (vertices_nb == 0) || (levels_nb == 0)) {
+        return 0;
+    }
+
+    quadrics = alloc.malloc(alloc, vertices_nb * sizeof(*quadrics));
+    locked = alloc.malloc(alloc, vertices_nb * sizeof(*locked));
+    current = alloc.malloc(alloc, faces_nb * sizeof(*current));
+    groups.of_vertex = alloc.malloc(alloc,
+            vertices_nb * sizeof(*groups.of_vertex));
+    groups.members = alloc.malloc(alloc,
+            vertices_nb * sizeof(*groups.members));
+    groups.members_start = alloc.malloc(alloc,
+            (vertices_nb + 1) * sizeof(*groups.members_start));
+
+    if (!quadrics || !locked || !current || !groups.of_vertex
+            || !groups.members || !groups.members_start
+            || !simplify_group_vertices(vertices, vertices_nb, &groups)) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        quadrics[i] = (struct simplify_quadric) { 0 };
+    }
+
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        struct vector3 p0 = vertices[faces[i].idx_vert[0]].pos;
+        struct vector3 p1 = vertices[faces[i].idx_vert[1]].pos;
+        struct vector3 p2 = vertices[faces[i].idx_vert[2]].pos;
+        double e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+        double e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+        double plane[4] = {
+                (e1[1] * e2[2]) - (e1[2] * e2[1]),
+                (e1[2] * e2[0]) - (e1[0] * e2[2]),
+                (e1[0] * e2[1]) - (e1[1] * e2[0]),
+                0.,
+        };
+        double length = sqrt((plane[0] * plane[0]) + (plane[1] * plane[1])
+                + (plane[2] * plane[2]));
+
+        current[i] = faces[i];
+
+        if (length <= 0.) {
+            continue;
+        }
+
+        plane[0] /= length;
+        plane[1] /= length;
+        plane[2] /= length;
+        plane[3] = -((plane[0] * p0.x) + (plane[1] * p0.y)
+                + (plane[2] * p0.z));
+
+        for (size_t j = 0 ; j < 3 ; j++) {
+            simplify_quadric_add_plane(
+                    quadrics + groups.of_vertex[faces[i].idx_vert[j]], plane);
+        }
+    }
+
+    simplify_lock_groups(vertices, vertices_nb, faces, faces_nb, &groups,
+            locked);
+
+    for (size_t level = 0 ; level < levels_nb ; level++) {
+        size_t previous_nb = current_nb;
+        size_t target_nb = current_nb / 2;
+
+        while (current_nb > target_nb) {
+            size_t simplified_nb = simplify_pass(vertices, vertices_nb,
+                    current, current_nb, target_nb, &groups, quadrics, locked,
+                    &max_cost);
+
+            if (simplified_nb == current_nb) {
+                break;
+            }
+            current_nb = simplified_nb;
+        }
+
+        if ((current_nb == 0)
+                || (current_nb > (size_t) ((f32) previous_nb
+                        * SIMPLIFY_MIN_REDUCTION))) {
+            break;
+        }
+
+        out_lods[level] = (struct geometry_lod) {
+                .first_face = (u32) array_length(*out_faces),
+                .faces_nb = (u32) current_nb,
+                .error = sqrtf(max_cost),
+        };
+
+        array_ensure_capacity(alloc, (ARRAY_ANY *) out_faces, current_nb);
+        array_append_mem(*out_faces, current, current_nb);
+        vertex_cache_optimize(*out_faces + out_lods[level].first_face,
+                current_nb, vertices_nb);
+
+        built_nb += 1;
+    }
+
+cleanup:
+    if (quadrics) alloc.free(alloc, quadrics);
+    if (locked) alloc.free(alloc, locked);
+    if (current) alloc.free(alloc, current);
+    if (groups.of_vertex) alloc.free(alloc, groups.of_vertex);
+    if (groups.members) alloc.free(alloc, groups.members);
+    if (groups.members_start) alloc.free(alloc, groups.members_start);
+
+    return built_nb;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Groups the vertices sharing their position. Returns false, with
+ * nothing grouped, if memory runs out.
+ *
+ * @param[in] vertices
+ * @param[in] vertices_nb
+ * @param[out] groups Groups with arrays allocated for vertices_nb vertices.
+ * @return bool
+ */
+static bool simplify_group_vertices(const struct vertex *vertices,
+        size_t vertices_nb, struct simplify_groups *groups)
+{
+    struct allocator alloc = make_system_allocator();
+    struct simplify_position *positions = nullptr;
+
+    positions = alloc.malloc(alloc, vertices_nb * sizeof(*positions));
+    if (!positions) {
+        return false;
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        positions[i] = (struct simplify_position) { vertices[i].pos, (u32) i };
+        groups->members_start[i] = 0;
+    }
+    groups->members_start[vertices_nb] = 0;
+
+    qsort(positions, vertices_nb, sizeof(*positions),
+            &simplify_position_compare);
+
+    // the first vertex of a run of equal positions names the group
+    for (size_t i = 0 ; i < vertices_nb ; ) {
+        size_t same = 1;
+        u32 group = positions[i].vertex;
+
+        while (((i + same) < vertices_nb) && (simplify_position_compare(
+                    positions + i, positions + i + same) == 0)) {
+            if (positions[i + same].vertex < group) {
+                group = positions[i + same].vertex;
+            }
+            same += 1;
+        }
+        for (size_t j = i ; j < (i + same) ; j++) {
+            groups->of_vertex[positions[j].vertex] = group;
+        }
+        groups->members_start[group + 1] = (u32) same;
+        i += same;
+    }
+
+    for (size_t i = 1 ; i <= vertices_nb ; i++) {
+        groups->members_start[i] += groups->members_start[i - 1];
+    }
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        u32 group = groups->of_vertex[i];
+
+        groups->members[groups->members_start[group]] = (u32) i;
+        groups->members_start[group] += 1;
+    }
+    for (size_t i = vertices_nb ; i > 0 ; i--) {
+        groups->members_start[i] = groups->members_start[i - 1];
+    }
+    groups->members_start[0] = 0;
+
+    alloc.free(alloc, positions);
+
+    return true;
+}
+
+/**
+ * @brief Finds the groups of vertices that must not move : positions whose
+ * vertices have different UVs (texture seams), and positions on edges used by
+ * a single face (open borders). Vertices only split by their normals can move.
+ *
+ * @param[in] vertices
+ * @param[in] vertices_nb
+ * @param[in] faces
+ * @param[in] faces_nb
+ * @param[in] groups Vertices grouped by position.
+ * @param[out] out_locked One flag per group.
+ */
+static void simplify_lock_groups(const struct vertex *vertices,
+        size_t vertices_nb, const struct face *faces, size_t faces_nb,
+        const struct simplify_groups *groups, bool *out_locked)
+{
+    struct allocator alloc = make_system_allocator();
+    u64 *edges = nullptr;
+    size_t edges_nb = faces_nb * 3;
+
+    edges = alloc.malloc(alloc, edges_nb * sizeof(*edges));
+
+    if (!edges) {
+        // nothing can move
+        for (size_t i = 0 ; i < vertices_nb ; i++) {
+            out_locked[i] = true;
+        }
+        return;
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        struct vector2 uv = vertices[groups->members[
+                groups->members_start[i]]].uv;
+
+        out_locked[i] = false;
+        for (u32 j = groups->members_start[i] ;
+                j < groups->members_start[i + 1] ; j++) {
+            struct vector2 other = vertices[groups->members[j]].uv;
+
+            out_locked[i] = out_locked[i]
+                    || (other.x != uv.x) || (other.y != uv.y);
+        }
+    }
+
+    // undirected edges between positions, as (smallest group, largest group)
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u64 a = groups->of_vertex[faces[i].idx_vert[j]];
+            u64 b = groups->of_vertex[faces[i].idx_vert[(j + 1) % 3]];
+
+            edges[(i * 3) + j] = (a < b) ? ((a << 32) | b) : ((b << 32) | a);
+        }
+    }
+
+    qsort(edges, edges_nb, sizeof(*edges), &simplify_edge_compare);
+    for (size_t i = 0 ; i < edges_nb ; ) {
+        size_t same = 1;
+
+        while (((i + same) < edges_nb) && (edges[i + same] == edges[i])) {
+            same += 1;
+        }
+        if (same == 1) {
+            out_locked[edges[i] >> 32] = true;
+            out_locked[edges[i] & 0xFFFFFFFFu] = true;
+        }
+        i += same;
+    }
+
+    alloc.free(alloc, edges);
+}
+
+/**
+ * @brief Collapses the cheapest edges of some faces, a position being moved at
+ * most once and its neighborhood being left alone for the rest of the pass.
+ * Collapses stop when the faces would go under some target.
+ * The faces are rewritten in place, without the faces collapsed away. Returns
+ * the new number of faces.
+ *
+ * @param[in] vertices
+ * @param[in] vertices_nb
+ * @param[inout] faces Simplified faces.
+ * @param[in] faces_nb Number of faces.
+ * @param[in] target_nb Number of faces the pass aims for.
+ * @param[in] groups Vertices grouped by position.
+ * @param[inout] quadrics Quadrics of the groups, merged by collapses.
+ * @param[in] locked Flags of groups that cannot move.
+ * @param[inout] max_cost Highest cost of the collapses done so far.
+ * @return size_t
+ */
+static size_t simplify_pass(const struct vertex *vertices, size_t vertices_nb,
+        struct face *faces, size_t faces_nb, size_t target_nb,
+        const struct simplify_groups *groups,
+        struct simplify_quadric *quadrics, const bool *locked, f32 *max_cost)
+{
+    struct allocator alloc = make_system_allocator();
+    struct simplify_collapse *collapses = nullptr;
+    size_t collapses_nb = 0;
+    u32 *remap = nullptr;
+    bool *touched = nullptr;
+    u32 *adjacency_start = nullptr;
+    u32 *adjacency = nullptr;
+    size_t removed_nb = 0;
+    size_t kept_nb = faces_nb;
+
+    collapses = alloc.malloc(alloc, faces_nb * 3 * sizeof(*collapses));
+    remap = alloc.malloc(alloc, vertices_nb * sizeof(*remap));
+    touched = alloc.malloc(alloc, vertices_nb * sizeof(*touched));
+    adjacency_start = alloc.malloc(alloc,
+            (vertices_nb + 1) * sizeof(*adjacency_start));
+    adjacency = alloc.malloc(alloc, faces_nb * 3 * sizeof(*adjacency));
+
+    if (!collapses || !remap || !touched || !adjacency_start || !adjacency) {
+        goto cleanup;
+    }
+
+    // faces using each group, packed one group after the other
+    for (size_t i = 0 ; i <= vertices_nb ; i++) {
+        adjacency_start[i] = 0;
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            adjacency_start[groups->of_vertex[faces[i].idx_vert[j]] + 1] += 1;
+        }
+    }
+    for (size_t i = 1 ; i <= vertices_nb ; i++) {
+        adjacency_start[i] += adjacency_start[i - 1];
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u32 group = groups->of_vertex[faces[i].idx_vert[j]];
+            adjacency[adjacency_start[group]] = (u32) i;
+            adjacency_start[group] += 1;
+        }
+    }
+    for (size_t i = vertices_nb ; i > 0 ; i--) {
+        adjacency_start[i] = adjacency_start[i - 1];
+    }
+    adjacency_start[0] = 0;
+
+    // cheapest direction of each edge
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u32 a = groups->of_vertex[faces[i].idx_vert[j]];
+            u32 b = groups->of_vertex[faces[i].idx_vert[(j + 1) % 3]];
+            f32 cost_ab = INFINITY;
+            f32 cost_ba = INFINITY;
+
+            if (a == b) {
+                continue;
+            }
+
+            // groups are named after one of their vertices, at their position
+            cost_ab = locked[a] ? INFINITY
+                    : simplify_quadric_cost(quadrics + a, quadrics + b,
+                            vertices[b].pos);
+            cost_ba = locked[b] ? INFINITY
+                    : simplify_quadric_cost(quadrics + b, quadrics + a,
+                            vertices[a].pos);
+
+            if (isinf(cost_ab) && isinf(cost_ba)) {
+                continue;
+            }
+
+            collapses[collapses_nb] = (cost_ab <= cost_ba)
+                    ? (struct simplify_collapse) { a, b, cost_ab }
+                    : (struct simplify_collapse) { b, a, cost_ba };
+            collapses_nb += 1;
+        }
+    }
+
+    qsort(collapses, collapses_nb, sizeof(*collapses),
+            &simplify_collapse_compare);
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        remap[i] = (u32) i;
+        touched[i] = false;
+    }
+
+    for (size_t i = 0 ; i < collapses_nb ; i++) {
+        struct simplify_collapse collapse = collapses[i];
+
+        // each collapse removes about two faces
+        if ((faces_nb - removed_nb) <= target_nb) {
+            break;
+        }
+
+        if (touched[collapse.from] || touched[collapse.to]
+                || simplify_flips(vertices, faces, groups->of_vertex,
+                        adjacency, adjacency_start[collapse.from],
+                        adjacency_start[collapse.from + 1], collapse.from,
+                        collapse.to)) {
+            continue;
+        }
+
+        remap[collapse.from] = collapse.to;
+        simplify_quadric_add(quadrics + collapse.to, quadrics + collapse.from);
+        *max_cost = fmaxf(*max_cost, collapse.cost);
+        removed_nb += 2;
+
+        for (u32 j = adjacency_start[collapse.from] ;
+                j < adjacency_start[collapse.from + 1] ; j++) {
+            for (size_t k = 0 ; k < 3 ; k++) {
+                touched[groups->of_vertex[faces[adjacency[j]].idx_vert[k]]]
+                        = true;
+            }
+        }
+    }
+
+    // rewrite faces, dropping the ones collapsed to a line
+    kept_nb = 0;
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        struct face face = faces[i];
+        u32 face_groups[3] = { 0 };
+
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u32 group = groups->of_vertex[face.idx_vert[j]];
+
+            face_groups[j] = remap[group];
+            if (face_groups[j] != group) {
+                face.idx_vert[j] = simplify_twin(vertices, groups,
+                        face.idx_vert[j], face_groups[j]);
+            }
+        }
+
+        if ((face_groups[0] == face_groups[1])
+                || (face_groups[1] == face_groups[2])
+                || (face_groups[2] == face_groups[0])) {
+            continue;
+        }
+
+        faces[kept_nb] = face;
+        kept_nb += 1;
+    }
+
+cleanup:
+    if (collapses) alloc.free(alloc, collapses);
+    if (remap) alloc.free(alloc, remap);
+    if (touched) alloc.free(alloc, touched);
+    if (adjacency_start) alloc.free(alloc, adjacency_start);
+    if (adjacency) alloc.free(alloc, adjacency);
+
+    return kept_nb;
+}
+
+/**
+ * @brief Tells if moving a position onto another would turn some face around
+ * it too much, or upside down.
+ *
+ * @param[in] vertices
+ * @param[in] faces
+ * @param[in] group_of_vertex Group of each vertex.
+ * @param[in] adjacency Faces using each group.
+ * @param[in] adjacency_start Start of the faces using the moved group.
+ * @param[in] adjacency_end End of the faces using the moved group.
+ * @param[in] from Moved group.
+ * @param[in] to Group it is moved onto.
+ * @return bool
+ */
+static bool simplify_flips(const struct vertex *vertices,
+        const struct face *faces, const u32 *group_of_vertex,
+        const u32 *adjacency, u32 adjacency_start, u32 adjacency_end,
+        u32 from, u32 to)
+{
+    for (u32 i = adjacency_start ; i < adjacency_end ; i++) {
+        const struct face *face = faces + adjacency[i];
+        struct vector3 before[3] = { 0 };
+        struct vector3 after[3] = { 0 };
+        f32 n_before[3] = { 0 };
+        f32 n_after[3] = { 0 };
+        bool collapsed = false;
+
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u32 group = group_of_vertex[face->idx_vert[j]];
+
+            before[j] = vertices[face->idx_vert[j]].pos;
+            after[j] = (group == from) ? vertices[to].pos : before[j];
+            collapsed = collapsed || (group == to);
+        }
+
+        // faces using both vertices disappear
+        if (collapsed) {
+            continue;
+        }
+
+        for (size_t j = 0 ; j < 2 ; j++) {
+            struct vector3 *p = (j == 0) ? before : after;
+            f32 *n = (j == 0) ? n_before : n_after;
+            f32 e1[3] = { p[1].x - p[0].x, p[1].y - p[0].y, p[1].z - p[0].z };
+            f32 e2[3] = { p[2].x - p[0].x, p[2].y - p[0].y, p[2].z - p[0].z };
+
+            n[0] = (e1[1] * e2[2]) - (e1[2] * e2[1]);
+            n[1] = (e1[2] * e2[0]) - (e1[0] * e2[2]);
+            n[2] = (e1[0] * e2[1]) - (e1[1] * e2[0]);
+        }
+
+        // rejects turns of more than about 75 degrees, not only flips, so no
+        // sliver is left to flip on a later collapse
+        if (((n_before[0] * n_after[0]) + (n_before[1] * n_after[1])
+                + (n_before[2] * n_after[2]))
+                < (SIMPLIFY_MAX_TURN_COSINE * sqrtf(
+                    ((n_before[0] * n_before[0]) + (n_before[1] * n_before[1])
+                        + (n_before[2] * n_before[2]))
+                    * ((n_after[0] * n_after[0]) + (n_after[1] * n_after[1])
+                        + (n_after[2] * n_after[2]))))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Picks the vertex of a group a collapsed vertex is moved onto : the
+ * one with the same UV if any, then with the closest normal.
+ *
+ * @param[in] vertices
+ * @param[in] groups Vertices grouped by position.
+ * @param[in] vertex Moved vertex.
+ * @param[in] group Group it is moved onto.
+ * @return u32
+ */
+static u32 simplify_twin(const struct vertex *vertices,
+        const struct simplify_groups *groups, u32 vertex, u32 group)
+{
+    const struct vertex *moved = vertices + vertex;
+    u32 best = group;
+    f32 best_score = -INFINITY;
+
+    for (u32 i = groups->members_start[group] ;
+            i < groups->members_start[group + 1] ; i++) {
+        const struct vertex *twin = vertices + groups->members[i];
+        f32 score = (moved->normal.x * twin->normal.x)
+                + (moved->normal.y * twin->normal.y)
+                + (moved->normal.z * twin->normal.z);
+
+        // normals are unit vectors, a matching UV outweighs any of them
+        if ((moved->uv.x == twin->uv.x) && (moved->uv.y == twin->uv.y)) {
+            score += 4.f;
+        }
+        if (score > best_score) {
+            best = groups->members[i];
+            best_score = score;
+        }
+    }
+
+    return best;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Adds the squared distance to a plane to a quadric.
+ *
+ * @param[inout] quadric
+ * @param[in] plane Unit normal and offset of the plane.
+ */
+static void simplify_quadric_add_plane(struct simplify_quadric *quadric,
+        const double plane[4])
+{
+    quadric->a2 += plane[0] * plane[0];
+    quadric->ab += plane[0] * plane[1];
+    quadric->ac += plane[0] * plane[2];
+    quadric->ad += plane[0] * plane[3];
+    quadric->b2 += plane[1] * plane[1];
+    quadric->bc += plane[1] * plane[2];
+    quadric->bd += plane[1] * plane[3];
+    quadric->c2 += plane[2] * plane[2];
+    quadric->cd += plane[2] * plane[3];
+    quadric->d2 += plane[3] * plane[3];
+    quadric->weight += 1.;
+}
+
+/**
+ * @brief Merges a quadric into another.
+ *
+ * @param[inout] quadric
+ * @param[in] other
+ */
+static void simplify_quadric_add(struct simplify_quadric *quadric,
+        const struct simplify_quadric *other)
+{
+    quadric->a2 += other->a2;
+    quadric->ab += other->ab;
+    quadric->ac += other->ac;
+    quadric->ad += other->ad;
+    quadric->b2 += other->b2;
+    quadric->bc += other->bc;
+    quadric->bd += other->bd;
+    quadric->c2 += other->c2;
+    quadric->cd += other->cd;
+    quadric->d2 += other->d2;
+    quadric->weight += other->weight;
+}
+
+/**
+ * @brief Evaluates the mean squared distance of a position to the planes of
+ * two quadrics.
+ *
+ * @param[in] a
+ * @param[in] b
+ * @param[in] pos
+ * @return f32
+ */
+static f32 simplify_quadric_cost(const struct simplify_quadric *a,
+        const struct simplify_quadric *b, struct vector3 pos)
+{
+    double x = pos.x;
+    double y = pos.y;
+    double z = pos.z;
+    double weight = a->weight + b->weight;
+    double cost = 0.;
+
+    cost = ((a->a2 + b->a2) * x * x)
+            + ((a->b2 + b->b2) * y * y)
+            + ((a->c2 + b->c2) * z * z)
+            + (2. * (a->ab + b->ab) * x * y)
+            + (2. * (a->ac + b->ac) * x * z)
+            + (2. * (a->bc + b->bc) * y * z)
+            + (2. * (a->ad + b->ad) * x)
+            + (2. * (a->bd + b->bd) * y)
+            + (2. * (a->cd + b->cd) * z)
+            + (a->d2 + b->d2);
+
+    return (weight > 0.) ? (f32) fabs(cost / weight) : 0.f;
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+static i32 simplify_position_compare(const void *lhs, const void *rhs)
+{
+    const struct vector3 *a = &((const struct simplify_position *) lhs)->pos;
+    const struct vector3 *b = &((const struct simplify_position *) rhs)->pos;
+
+    if (a->x != b->x) return (a->x < b->x) ? -1 : 1;
+    if (a->y != b->y) return (a->y < b->y) ? -1 : 1;
+    if (a->z != b->z) return (a->z < b->z) ? -1 : 1;
+    return 0;
+}
+
+static i32 simplify_edge_compare(const void *lhs, const void *rhs)
+{
+    u64 a = *(const u64 *) lhs;
+    u64 b = *(const u64 *) rhs;
+
+    return (a > b) - (a < b);
+}
+
+static i32 simplify_collapse_compare(const void *lhs, const void *rhs)
+{
+    f32 a = ((const struct simplify_collapse *) lhs)->cost;
+    f32 b = ((const struct simplify_collapse *) rhs)->cost;
+
+    return (a > b) - (a < b);
+}
@@ -0,0 +1,357 @@
+/**
+ * @file 3dful_vertex_cache.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the passes reordering faces and vertices of a
+ * geometry for better use of the GPU's vertex caches.
+ *
+ * The faces are reordered with Tom Forsyth's "Linear-Speed Vertex Cache
+ * Optimisation" : faces are greedily picked by a score favoring vertices
+ * recently used, and vertices with few faces left to draw.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "3dful_geometry_processing.h"
+
+#include <math.h>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Marks a vertex out of the simulated cache, or a missing face. */
+#define VERTEX_CACHE_NONE (0xFFFFFFFFu)
+
+/** Score of the vertices of the last face added. */
+#define VERTEX_CACHE_LAST_FACE_SCORE (.75f)
+/** How fast the score of a vertex drops while it goes down the cache. */
+#define VERTEX_CACHE_DECAY_POWER (1.5f)
+/** Weight of the bonus given to vertices with few faces left. */
+#define VERTEX_CACHE_VALENCE_SCALE (2.f)
+/** How fast the bonus given to vertices with few faces left drops. */
+#define VERTEX_CACHE_VALENCE_POWER (.5f)
+
+/**
+ * @brief State of the face reordering, per vertex.
+ */
+struct vertex_cache_vertex {
+    u32 adjacency_start;
+    u32 faces_left;
+    u32 cache_pos;
+    f32 score;
+};
+
+static f32 vertex_cache_score(u32 cache_pos, u32 faces_left);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Reorders faces so that consecutive faces share as many vertices as
+ * possible, which lets the GPU reuse the vertices it already transformed.
+ * Faces keep their winding.
+ *
+ * @param[inout] faces Reordered faces.
+ * @param[in] faces_nb Number of faces.
+ * @param[in] vertices_nb Number of vertices referenced by the faces.
+ */
+void vertex_cache_optimize(struct face *faces, size_t faces_nb,
+        size_t vertices_nb)
+{
+    struct allocator alloc = make_system_allocator();
+    struct vertex_cache_vertex *vertices = nullptr;
+    u32 *adjacency = nullptr;
+    f32 *face_scores = nullptr;
+    bool *face_added = nullptr;
+    struct face *sorted = nullptr;
+    u32 cache[VERTEX_CACHE_SIZE + 3] = { 0 };
+    u32 new_cache[VERTEX_CACHE_SIZE + 3] = { 0 };
+    size_t cache_length = 0;
+    size_t best_face = VERTEX_CACHE_NONE;
+    size_t cursor = 0;
+
+    if ((faces_nb == 0) || (vertices_nb == 0)) {
+        return;
+    }
+
+    vertices = alloc.malloc(alloc, vertices_nb * sizeof(*vertices));
+    adjacency = alloc.malloc(alloc, faces_nb * 3 * sizeof(*adjacency));
+    face_scores = alloc.malloc(alloc, faces_nb * sizeof(*face_scores));
+    face_added = alloc.malloc(alloc, faces_nb * sizeof(*face_added));
+    sorted = alloc.malloc(alloc, faces_nb * sizeof(*sorted));
+
+    if (!vertices || !adjacency || !face_scores || !face_added || !sorted) {
+        goto cleanup;
+    }
+
+    // faces using each vertex, packed one vertex after the other
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        vertices[i] = (struct vertex_cache_vertex) {
+                .cache_pos = VERTEX_CACHE_NONE };
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            vertices[faces[i].idx_vert[j]].faces_left += 1;
+        }
+    }
+    for (size_t i = 1 ; i < vertices_nb ; i++) {
+        vertices[i].adjacency_start = vertices[i-1].adjacency_start
+                + vertices[i-1].faces_left;
+    }
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        vertices[i].faces_left = 0;
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            struct vertex_cache_vertex *v = vertices + faces[i].idx_vert[j];
+            adjacency[v->adjacency_start + v->faces_left] = (u32) i;
+            v->faces_left += 1;
+        }
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        vertices[i].score = vertex_cache_score(VERTEX_CACHE_NONE,
+                vertices[i].faces_left);
+    }
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        face_added[i] = false;
+        face_scores[i] = vertices[faces[i].idx_vert[0]].score
+                + vertices[faces[i].idx_vert[1]].score
+                + vertices[faces[i].idx_vert[2]].score;
+        if ((best_face == VERTEX_CACHE_NONE)
+                || (face_scores[i] > face_scores[best_face])) {
+            best_face = i;
+        }
+    }
+
+    for (size_t out = 0 ; out < faces_nb ; out++) {
+        size_t new_cache_length = 0;
+        f32 best_score = -1.f;
+
+        // nothing left around the cache : take the next face in order
+        if (best_face == VERTEX_CACHE_NONE) {
+            while (face_added[cursor]) {
+                cursor += 1;
+            }
+            best_face = cursor;
+        }
+
+        sorted[out] = faces[best_face];
+        face_added[best_face] = true;
+
+        // the face is no longer left to draw for its vertices
+        for (size_t j = 0 ; j < 3 ; j++) {
+            struct vertex_cache_vertex *v =
+                    vertices + faces[best_face].idx_vert[j];
+            u32 *v_faces = adjacency + v->adjacency_start;
+
+            for (size_t k = 0 ; k < v->faces_left ; k++) {
+                if (v_faces[k] == best_face) {
+                    v_faces[k] = v_faces[v->faces_left - 1];
+                    break;
+                }
+            }
+            v->faces_left -= 1;
+            new_cache[new_cache_length++] = faces[best_face].idx_vert[j];
+        }
+
+        // the face's vertices go on top of the cache
+        for (size_t i = 0 ; i < cache_length ; i++) {
+            if ((cache[i] != faces[best_face].idx_vert[0])
+                    && (cache[i] != faces[best_face].idx_vert[1])
+                    && (cache[i] != faces[best_face].idx_vert[2])) {
+                new_cache[new_cache_length++] = cache[i];
+            }
+        }
+
+        // rescore vertices that moved in (or out of) the cache, and their
+        // faces
+        best_face = VERTEX_CACHE_NONE;
+        for (size_t i = 0 ; i < new_cache_length ; i++) {
+            struct vertex_cache_vertex *v = vertices + new_cache[i];
+
+            v->cache_pos = (i < VERTEX_CACHE_SIZE) ? (u32) i
+                    : VERTEX_CACHE_NONE;
+            v->score = vertex_cache_score(v->cache_pos, v->faces_left);
+        }
+        for (size_t i = 0 ; i < new_cache_length ; i++) {
+            struct vertex_cache_vertex *v = vertices + new_cache[i];
+
+            for (size_t k = 0 ; k < v->faces_left ; k++) {
+                u32 face = adjacency[v->adjacency_start + k];
+
+                face_scores[face] = vertices[faces[face].idx_vert[0]].score
+                        + vertices[faces[face].idx_vert[1]].score
+                        + vertices[faces[face].idx_vert[2]].score;
+                if (face_scores[face] > best_score) {
+                    best_score = face_scores[face];
+                    best_face = face;
+                }
+            }
+        }
+
+        cache_length = (new_cache_length < VERTEX_CACHE_SIZE)
+                ? new_cache_length : VERTEX_CACHE_SIZE;
+        for (size_t i = 0 ; i < cache_length ; i++) {
+            cache[i] = new_cache[i];
+        }
+    }
+
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        faces[i] = sorted[i];
+    }
+
+cleanup:
+    if (vertices) alloc.free(alloc, vertices);
+    if (adjacency) alloc.free(alloc, adjacency);
+    if (face_scores) alloc.free(alloc, face_scores);
+    if (face_added) alloc.free(alloc, face_added);
+    if (sorted) alloc.free(alloc, sorted);
+}
+
+/**
+ * @brief Reorders vertices in the order the faces first reference them, so
+ * the GPU fetches them from memory mostly in sequence. Faces are updated to
+ * the new vertex indices. Vertices not referenced by any face are kept at the
+ * end.
+ *
+ * @param[inout] vertices Reordered vertices.
+ * @param[in] vertices_nb Number of vertices.
+ * @param[inout] faces Faces referencing the vertices.
+ * @param[in] faces_nb Number of faces.
+ */
+void vertex_fetch_optimize(struct vertex *vertices, size_t vertices_nb,
+        struct face *faces, size_t faces_nb)
+{
+    struct allocator alloc = make_system_allocator();
+    u32 *remap = nullptr;
+    struct vertex *sorted = nullptr;
+    u32 next = 0;
+
+    if (vertices_nb == 0) {
+        return;
+    }
+
+    remap = alloc.malloc(alloc, vertices_nb * sizeof(*remap));
+    sorted = alloc.malloc(alloc, vertices_nb * sizeof(*sorted));
+
+    if (!remap || !sorted) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        remap[i] = VERTEX_CACHE_NONE;
+    }
+
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u32 *idx = faces[i].idx_vert + j;
+
+            if (remap[*idx] == VERTEX_CACHE_NONE) {
+                remap[*idx] = next++;
+            }
+            *idx = remap[*idx];
+        }
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        if (remap[i] == VERTEX_CACHE_NONE) {
+            remap[i] = next++;
+        }
+        sorted[remap[i]] = vertices[i];
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        vertices[i] = sorted[i];
+    }
+
+cleanup:
+    if (remap) alloc.free(alloc, remap);
+    if (sorted) alloc.free(alloc, sorted);
+}
+
+/**
+ * @brief Simulates a FIFO post-transform cache of VERTEX_CACHE_SIZE entries
+ * going through some faces, and counts the vertices it has to transform.
+ *
+ * @param[in] faces Measured faces.
+ * @param[in] faces_nb Number of faces.
+ * @param[in] vertices_nb Number of vertices referenced by the faces.
+ * @return struct geometry_cache_stats
+ */
+struct geometry_cache_stats vertex_cache_measure(const struct face *faces,
+        size_t faces_nb, size_t vertices_nb)
+{
+    struct allocator alloc = make_system_allocator();
+    u32 *inserted_at = nullptr;
+    u32 misses = 0;
+
+    if ((faces_nb == 0) || (vertices_nb == 0)) {
+        return (struct geometry_cache_stats) { 0 };
+    }
+
+    // miss count when the vertex entered the cache, 0 for never
+    inserted_at = alloc.malloc(alloc, vertices_nb * sizeof(*inserted_at));
+    if (!inserted_at) {
+        return (struct geometry_cache_stats) { 0 };
+    }
+
+    for (size_t i = 0 ; i < vertices_nb ; i++) {
+        inserted_at[i] = 0;
+    }
+
+    for (size_t i = 0 ; i < faces_nb ; i++) {
+        for (size_t j = 0 ; j < 3 ; j++) {
+            u32 idx = faces[i].idx_vert[j];
+
+            if ((inserted_at[idx] == 0)
+                    || ((misses + 1 - inserted_at[idx]) > VERTEX_CACHE_SIZE)) {
+                misses += 1;
+                inserted_at[idx] = misses;
+            }
+        }
+    }
+
+    alloc.free(alloc, inserted_at);
+
+    return (struct geometry_cache_stats) {
+            .acmr = (f32) misses / (f32) faces_nb,
+            .atvr = (f32) misses / (f32) vertices_nb,
+    };
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Computes the score of a vertex, from its position in the simulated
+ * cache and the number of faces still using it.
+ *
+ * @param[in] cache_pos Position in the cache, VERTEX_CACHE_NONE if out.
+ * @param[in] faces_left Faces using the vertex not yet reordered.
+ * @return f32
+ */
+static f32 vertex_cache_score(u32 cache_pos, u32 faces_left)
+{
+    f32 score = 0.f;
+
+    if (faces_left == 0) {
+        return -1.f;
+    }
+
+    if (cache_pos < 3) {
+        score = VERTEX_CACHE_LAST_FACE_SCORE;
+    } else if (cache_pos < VERTEX_CACHE_SIZE) {
+        score = powf(1.f - ((f32) (cache_pos - 3)
+                        / (f32) (VERTEX_CACHE_SIZE - 3)),
+                VERTEX_CACHE_DECAY_POWER);
+    }
+
+    score += VERTEX_CACHE_VALENCE_SCALE
+            * powf((f32) faces_left, -VERTEX_CACHE_VALENCE_POWER);
+
+    return score;
+}
@@ -0,0 +1,702 @@
+/**
+ * @file 3dful_etc2.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the compression of images to ETC2 / EAC blocks,
+ * the compressed formats every GLES3 implementation can sample.
+ *
+ * Each block of 4 by 4 pixels is tried in the individual and differential
+ * modes ETC2 inherits from ETC1, with its halves side by side and stacked,
+ * and in the planar mode of ETC2 ; the try closest to the pixels is kept.
+ * The T and H modes of ETC2 are not tried. Alpha is compressed apart, in an
+ * EAC block placed before the colors.
+ * Images are cut in bands of blocks compressed by the worker threads. Unlike
+ * frustum culling, the fitting has no SSE / AVX2 kernels : it only runs when
+ * a texture is baked, once, and its loops stop early on the error so far.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "3dful_texture_processing.h"
+
+#include <math.h>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Most bands of blocks an image is cut in to be compressed. */
+#define ETC2_BANDS_MAX (32u)
+
+/**
+ * @brief Rows of blocks of an image compressed by one task.
+ */
+struct etc2_band {
+    const byte *pixels;
+    u32 width, height;
+    u32 channels;
+    enum texture_compression compression;
+    u32 first_row, rows_nb;
+    byte *out;
+};
+
+/**
+ * @brief Half of a block encoded with a base color and a table of
+ * intensity modifiers.
+ */
+struct etc2_half {
+    /** Base color, on 8 bits per channel. */
+    i32 color[3];
+    u32 table;
+    u8 indices[8];
+    u32 error;
+};
+
+static void etc2_compress_band_task(void *data);
+static void etc2_compress_block(const byte block[16][4], bool alpha,
+        enum texture_compression compression, byte *out);
+static u32 etc2_try_halves(const byte block[16][4], bool flip,
+        enum texture_compression compression, u64 *out_bits);
+static void etc2_fit_half(const byte block[16][4], const u8 pixels[8],
+        const i32 quantized[3], u32 bits, struct etc2_half *out_half);
+static u32 etc2_try_planar(const byte block[16][4], u64 *out_bits);
+static u64 etc2_encode_alpha(const byte block[16][4],
+        enum texture_compression compression);
+static u32 etc2_fit_alpha(const byte block[16][4], i32 base, i32 multiplier,
+        u32 table, u64 *out_indices);
+static void etc2_store(u64 bits, byte *out);
+static i32 etc2_extend(i32 value, u32 bits);
+static i32 etc2_clamp(i32 value);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Intensity modifiers of the ETC1 modes, small and large. */
+static const i32 etc2_modifiers[8][2] = {
+        {  2,   8 }, {  5,  17 }, {  9,  29 }, { 13,  42 },
+        { 18,  60 }, { 24,  80 }, { 33, 106 }, { 47, 183 },
+};
+
+/** Alpha modifiers of EAC blocks. */
+static const i32 etc2_alpha_modifiers[16][8] = {
+        { -3, -6,  -9, -15, 2, 5, 8, 14 },
+        { -3, -7, -10, -13, 2, 6, 9, 12 },
+        { -2, -5,  -8, -13, 1, 4, 7, 12 },
+        { -2, -4,  -6, -13, 1, 3, 5, 12 },
+        { -3, -6,  -8, -12, 2, 5, 7, 11 },
+        { -3, -7,  -9, -11, 2, 6, 8, 10 },
+        { -4, -7,  -8, -11, 3, 6, 7, 10 },
+        { -3, -5,  -8, -11, 2, 4, 7, 10 },
+        { -2, -6,  -8, -10, 1, 5, 7,  9 },
+        { -2, -5,  -8, -10, 1, 4, 7,  9 },
+        { -2, -4,  -8, -10, 1, 3, 7,  9 },
+        { -2, -5,  -7, -10, 1, 4, 6,  9 },
+        { -3, -4,  -7, -10, 2, 3, 6,  9 },
+        { -1, -2,  -3, -10, 0, 1, 2,  9 },
+        { -4, -6,  -8,  -9, 3, 5, 7,  8 },
+        { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Computes the length of an image compressed to ETC2 blocks.
+ *
+ * @param[in] width Width of the image, in pixels.
+ * @param[in] height Height of the image, in pixels.
+ * @param[in] alpha Whether the blocks hold alpha (ETC2 RGBA8 EAC) or not
+ * (ETC2 RGB8).
+ * @return size_t
+ */
+size_t etc2_compressed_length(u32 width, u32 height, bool alpha)
+{
+    return (size_t) ((width + 3) / 4) * (size_t) ((height + 3) / 4)
+            * (alpha ? 16u : 8u);
+}
+
+/**
+ * @brief Compresses an image to ETC2 RGB8 blocks, or to ETC2 RGBA8 EAC blocks
+ * if it has an alpha channel. Blocks going past the edges of the image repeat
+ * its last row and column.
+ *
+ * @param[in] pixels Pixels of the image, rows tightly packed.
+ * @param[in] width Width of the image, in pixels.
+ * @param[in] height Height of the image, in pixels.
+ * @param[in] channels 3 for RGB pixels, 4 for RGBA pixels.
+ * @param[in] compression Preset trading speed for quality.
+ * @param[out] out Receives etc2_compressed_length() bytes of blocks.
+ */
+void etc2_compress(const byte *pixels, u32 width, u32 height, u32 channels,
+        enum texture_compression compression, byte *out)
+{
+    struct etc2_band bands[ETC2_BANDS_MAX] = { 0 };
+    struct worker_group group = { 0 };
+    u32 rows_nb = (height + 3) / 4;
+    size_t bands_nb = 1;
+
+    if ((width == 0) || (height == 0)) {
+        return;
+    }
+
+    if (rows_nb > 1) {
+        bands_nb = 2 * (workers_count() + 1);
+        bands_nb = (bands_nb < ETC2_BANDS_MAX) ? bands_nb : ETC2_BANDS_MAX;
+        bands_nb = (bands_nb < rows_nb) ? bands_nb : rows_nb;
+    }
+
+    for (size_t i = 0 ; i < bands_nb ; i++) {
+        u32 first_row = (u32) ((rows_nb * i) / bands_nb);
+
+        bands[i] = (struct etc2_band) {
+                .pixels = pixels,
+                .width = width,
+                .height = height,
+                .channels = channels,
+                .compression = compression,
+                .first_row = first_row,
+                .rows_nb = (u32) ((rows_nb * (i + 1)) / bands_nb) - first_row,
+                .out = out,
+        };
+    }
+
+    // small images, or no other thread to help
+    if (bands_nb == 1) {
+        etc2_compress_band_task(bands);
+        return;
+    }
+
+    for (size_t i = 0 ; i < bands_nb ; i++) {
+        workers_push(&group, &etc2_compress_band_task, bands + i);
+    }
+    workers_wait(&group);
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Compresses the blocks of a band of an image.
+ *
+ * @param[inout] data Compressed band (struct etc2_band).
+ */
+static void etc2_compress_band_task(void *data)
+{
+    struct etc2_band *band = data;
+    bool alpha = (band->channels == 4);
+    u32 columns_nb = (band->width + 3) / 4;
+    size_t block_length = alpha ? 16u : 8u;
+    byte block[16][4] = { 0 };
+
+    for (u32 row = band->first_row ;
+            row < band->first_row + band->rows_nb ; row++) {
+        for (u32 column = 0 ; column < columns_nb ; column++) {
+            for (u32 p = 0 ; p < 16 ; p++) {
+                u32 x = (column * 4) + (p % 4);
+                u32 y = (row * 4) + (p / 4);
+                const byte *pixel = nullptr;
+
+                x = (x < band->width) ? x : (band->width - 1);
+                y = (y < band->height) ? y : (band->height - 1);
+                pixel = band->pixels
+                        + (((size_t) y * band->width + x) * band->channels);
+
+                block[p][0] = pixel[0];
+                block[p][1] = pixel[1];
+                block[p][2] = pixel[2];
+                block[p][3] = alpha ? pixel[3] : 0xff;
+            }
+
+            etc2_compress_block(block, alpha, band->compression,
+                    band->out + (((size_t) row * columns_nb + column)
+                            * block_length));
+        }
+    }
+}
+
+/**
+ * @brief Compresses a block of 4 by 4 pixels, keeping the mode closest to its
+ * colors. Fast compression leaves out the planar mode, and the best one
+ * searches around the average colors of the halves of the block.
+ *
+ * @param[in] block Pixels of the block, row after row.
+ * @param[in] alpha Whether an EAC alpha block is written first.
+ * @param[in] compression Preset trading speed for quality.
+ * @param[out] out Receives the block.
+ */
+static void etc2_compress_block(const byte block[16][4], bool alpha,
+        enum texture_compression compression, byte *out)
+{
+    u64 best_bits = 0;
+    u64 bits = 0;
+    u32 best_error = UINT32_MAX;
+    u32 error = 0;
+
+    if (alpha) {
+        etc2_store(etc2_encode_alpha(block, compression), out);
+        out += 8;
+    }
+
+    for (u32 flip = 0 ; flip < 2 ; flip++) {
+        error = etc2_try_halves(block, (flip == 1), compression, &bits);
+        if (error < best_error) {
+            best_error = error;
+            best_bits = bits;
+        }
+    }
+
+    if (compression != TEXTURE_COMPRESSION_FAST) {
+        error = etc2_try_planar(block, &bits);
+        if (error < best_error) {
+            best_error = error;
+            best_bits = bits;
+        }
+    }
+
+    etc2_store(best_bits, out);
+}
+
+/**
+ * @brief Encodes a block as two halves, side by side or stacked, in the
+ * differential mode if their colors are close enough and else in the
+ * individual mode. Returns the squared error of the encoding.
+ *
+ * @param[in] block Pixels of the block, row after row.
+ * @param[in] flip Whether the halves are stacked instead of side by side.
+ * @param[in] compression Preset trading speed for quality.
+ * @param[out] out_bits Receives the encoded block.
+ * @return u32
+ */
+static u32 etc2_try_halves(const byte block[16][4], bool flip,
+        enum texture_compression compression, u64 *out_bits)
+{
+    u8 halves[2][8] = { 0 };
+    size_t halves_nb[2] = { 0 };
+    f32 average[2][3] = { 0 };
+    i32 quantized[2][2][3] = { 0 };
+    struct etc2_half fit[2][2] = { 0 };
+    bool differential = true;
+    size_t mode = 0;
+    u64 bits = 0;
+
+    for (u8 p = 0 ; p < 16 ; p++) {
+        size_t half = flip ? ((p / 4) >= 2) : ((p % 4) >= 2);
+
+        halves[half][halves_nb[half]++] = p;
+        for (size_t c = 0 ; c < 3 ; c++) {
+            average[half][c] += (f32) block[p][c] / 8.f;
+        }
+    }
+
+    // mode 0 is differential (5 bits colors), mode 1 individual (4 bits)
+    for (size_t h = 0 ; h < 2 ; h++) {
+        for (size_t c = 0 ; c < 3 ; c++) {
+            quantized[0][h][c] = (i32) roundf(average[h][c] * 31.f / 255.f);
+            quantized[1][h][c] = (i32) roundf(average[h][c] * 15.f / 255.f);
+        }
+    }
+    for (size_t c = 0 ; c < 3 ; c++) {
+        i32 delta = quantized[0][1][c] - quantized[0][0][c];
+
+        differential = differential && (delta >= -4) && (delta <= 3);
+    }
+
+    for (size_t h = 0 ; h < 2 ; h++) {
+        if (differential) {
+            etc2_fit_half(block, halves[h], quantized[0][h], 5, &fit[0][h]);
+        }
+        etc2_fit_half(block, halves[h], quantized[1][h], 4, &fit[1][h]);
+    }
+    mode = (!differential || ((fit[1][0].error + fit[1][1].error)
+                    < (fit[0][0].error + fit[0][1].error))) ? 1 : 0;
+
+    // searches around the average colors, the two halves of a differential
+    // encoding staying close enough to each other whichever one moves
+    if (compression == TEXTURE_COMPRESSION_BEST) {
+        i32 max = (mode == 0) ? 31 : 15;
+        u32 bits_nb = (mode == 0) ? 5 : 4;
+
+        for (size_t h = 0 ; h < 2 ; h++) {
+            i32 center[3] = {
+                    quantized[mode][h][0],
+                    quantized[mode][h][1],
+                    quantized[mode][h][2],
+            };
+
+            for (i32 around = 0 ; around < 27 ; around++) {
+                i32 candidate[3] = {
+                        center[0] + (around % 3) - 1,
+                        center[1] + ((around / 3) % 3) - 1,
+                        center[2] + (around / 9) - 1,
+                };
+                struct etc2_half tried = { 0 };
+                bool valid = true;
+
+                for (size_t c = 0 ; c < 3 ; c++) {
+                    i32 delta = (h == 0)
+                            ? (quantized[mode][1][c] - candidate[c])
+                            : (candidate[c] - quantized[mode][0][c]);
+
+                    valid = valid && (candidate[c] >= 0)
+                            && (candidate[c] <= max);
+                    if (mode == 0) {
+                        valid = valid && (delta >= -4) && (delta <= 3);
+                    }
+                }
+                if (!valid) {
+                    continue;
+                }
+
+                etc2_fit_half(block, halves[h], candidate, bits_nb, &tried);
+                if (tried.error < fit[mode][h].error) {
+                    fit[mode][h] = tried;
+                    quantized[mode][h][0] = candidate[0];
+                    quantized[mode][h][1] = candidate[1];
+                    quantized[mode][h][2] = candidate[2];
+                }
+            }
+        }
+    }
+
+    for (size_t c = 0 ; c < 3 ; c++) {
+        if (mode == 0) {
+            bits |= (u64) quantized[0][0][c] << (59 - (8 * c));
+            bits |= (u64) ((quantized[0][1][c] - quantized[0][0][c]) & 0x7)
+                    << (56 - (8 * c));
+        } else {
+            bits |= (u64) quantized[1][0][c] << (60 - (8 * c));
+            bits |= (u64) quantized[1][1][c] << (56 - (8 * c));
+        }
+    }
+    bits |= (u64) fit[mode][0].table << 37;
+    bits |= (u64) fit[mode][1].table << 34;
+    bits |= (u64) (mode == 0) << 33;
+    bits |= (u64) flip << 32;
+
+    // indices are stored column after column, their high bits first
+    for (size_t h = 0 ; h < 2 ; h++) {
+        for (size_t i = 0 ; i < 8 ; i++) {
+            u32 p = halves[h][i];
+            u32 j = ((p % 4) * 4) + (p / 4);
+
+            bits |= (u64) (fit[mode][h].indices[i] >> 1) << (16 + j);
+            bits |= (u64) (fit[mode][h].indices[i] & 1) << j;
+        }
+    }
+
+    *out_bits = bits;
+
+    return fit[mode][0].error + fit[mode][1].error;
+}
+
+/**
+ * @brief Picks the table of modifiers, and the modifier of each pixel, that
+ * best encode half of a block around a base color.
+ *
+ * @param[in] block Pixels of the block, row after row.
+ * @param[in] pixels Pixels of the half.
+ * @param[in] quantized Base color, quantized.
+ * @param[in] bits Bits per channel of the quantized base color.
+ * @param[out] out_half Receives the encoding.
+ */
+static void etc2_fit_half(const byte block[16][4], const u8 pixels[8],
+        const i32 quantized[3], u32 bits, struct etc2_half *out_half)
+{
+    struct etc2_half tried = { 0 };
+
+    out_half->error = UINT32_MAX;
+
+    for (size_t c = 0 ; c < 3 ; c++) {
+        tried.color[c] = etc2_extend(quantized[c], bits);
+    }
+
+    for (u32 table = 0 ; table < 8 ; table++) {
+        tried.table = table;
+        tried.error = 0;
+
+        for (size_t i = 0 ; (i < 8) && (tried.error < out_half->error) ;
+                i++) {
+            const byte *pixel = block[pixels[i]];
+            u32 best = UINT32_MAX;
+
+            // index bits : high for negative modifiers, low for large ones
+            for (u8 index = 0 ; index < 4 ; index++) {
+                i32 modifier = etc2_modifiers[table][index & 1]
+                        * ((index & 2) ? -1 : 1);
+                u32 error = 0;
+
+                for (size_t c = 0 ; c < 3 ; c++) {
+                    i32 d = etc2_clamp(tried.color[c] + modifier) - pixel[c];
+
+                    error += (u32) (d * d);
+                }
+                if (error < best) {
+                    best = error;
+                    tried.indices[i] = index;
+                }
+            }
+            tried.error += best;
+        }
+
+        if (tried.error < out_half->error) {
+            *out_half = tried;
+        }
+    }
+}
+
+/**
+ * @brief Encodes a block in the planar mode of ETC2, fitting a plane to each
+ * channel of its pixels. Returns the squared error of the encoding.
+ *
+ * @param[in] block Pixels of the block, row after row.
+ * @param[out] out_bits Receives the encoded block.
+ * @return u32
+ */
+static u32 etc2_try_planar(const byte block[16][4], u64 *out_bits)
+{
+    // colors at the origin, at four pixels to the right and four pixels down
+    i32 origin[3] = { 0 };
+    i32 horizontal[3] = { 0 };
+    i32 vertical[3] = { 0 };
+    u64 bits = 0;
+    u32 error = 0;
+    bool found = false;
+
+    for (size_t c = 0 ; c < 3 ; c++) {
+        i32 max = (c == 1) ? 127 : 63;
+        u32 bits_nb = (c == 1) ? 7 : 6;
+        f32 mean = 0.f;
+        f32 slope_x = 0.f;
+        f32 slope_y = 0.f;
+        f32 at_origin = 0.f;
+        i32 o = 0;
+        i32 h = 0;
+        i32 v = 0;
+
+        for (size_t p = 0 ; p < 16 ; p++) {
+            mean += (f32) block[p][c] / 16.f;
+            slope_x += ((f32) (p % 4) - 1.5f) * (f32) block[p][c] / 20.f;
+            slope_y += ((f32) (p / 4) - 1.5f) * (f32) block[p][c] / 20.f;
+        }
+        at_origin = mean - (1.5f * (slope_x + slope_y));
+
+        origin[c] = (i32) roundf(at_origin * (f32) max / 255.f);
+        horizontal[c] = (i32) roundf((at_origin + (4.f * slope_x))
+                * (f32) max / 255.f);
+        vertical[c] = (i32) roundf((at_origin + (4.f * slope_y))
+                * (f32) max / 255.f);
+
+        origin[c] = (origin[c] < 0) ? 0 : ((origin[c] > max) ? max : origin[c]);
+        horizontal[c] = (horizontal[c] < 0) ? 0
+                : ((horizontal[c] > max) ? max : horizontal[c]);
+        vertical[c] = (vertical[c] < 0) ? 0
+                : ((vertical[c] > max) ? max : vertical[c]);
+
+        o = etc2_extend(origin[c], bits_nb);
+        h = etc2_extend(horizontal[c], bits_nb);
+        v = etc2_extend(vertical[c], bits_nb);
+        for (size_t p = 0 ; p < 16 ; p++) {
+            i32 x = (i32) (p % 4);
+            i32 y = (i32) (p / 4);
+            i32 d = etc2_clamp(((x * (h - o)) + (y * (v - o)) + (4 * o) + 2)
+                    >> 2) - block[p][c];
+
+            error += (u32) (d * d);
+        }
+    }
+
+    bits |= (u64) origin[0] << 57;
+    bits |= (u64) (origin[1] >> 6) << 56;
+    bits |= (u64) (origin[1] & 0x3f) << 49;
+    bits |= (u64) (origin[2] >> 5) << 48;
+    bits |= (u64) ((origin[2] >> 3) & 0x3) << 43;
+    bits |= (u64) (origin[2] & 0x7) << 39;
+    bits |= (u64) (horizontal[0] >> 1) << 34;
+    bits |= (u64) 1 << 33;
+    bits |= (u64) (horizontal[0] & 1) << 32;
+    bits |= (u64) horizontal[1] << 25;
+    bits |= (u64) horizontal[2] << 19;
+    bits |= (u64) vertical[0] << 13;
+    bits |= (u64) vertical[1] << 6;
+    bits |= (u64) vertical[2];
+
+    // the planar mode is told apart by the red and green channels of a
+    // differential block staying in range while the blue one overflows ; the
+    // unused bits are set so they do
+    for (u32 unused = 0 ; (unused < 64) && !found ; unused++) {
+        u64 tried = bits
+                | ((u64) (unused & 1) << 63)
+                | ((u64) ((unused >> 1) & 1) << 55)
+                | ((u64) ((unused >> 2) & 0x7) << 45)
+                | ((u64) ((unused >> 5) & 1) << 42);
+        i32 sums[3] = { 0 };
+
+        for (size_t c = 0 ; c < 3 ; c++) {
+            i32 base = (i32) ((tried >> (59 - (8 * c))) & 0x1f);
+            i32 delta = (i32) ((tried >> (56 - (8 * c))) & 0x7);
+
+            sums[c] = base + ((delta >= 4) ? (delta - 8) : delta);
+        }
+
+        found = (sums[0] >= 0) && (sums[0] <= 31)
+                && (sums[1] >= 0) && (sums[1] <= 31)
+                && ((sums[2] < 0) || (sums[2] > 31));
+        if (found) {
+            bits = tried;
+        }
+    }
+
+    if (!found) {
+        return UINT32_MAX;
+    }
+
+    *out_bits = bits;
+
+    return error;
+}
+
+/**
+ * @brief Encodes the alpha of a block in an EAC block, trying every table of
+ * modifiers with the multiplier spanning the alpha of the block. The best
+ * compression also tries the neighbouring multipliers and base values.
+ *
+ * @param[in] block Pixels of the block, row after row.
+ * @param[in] compression Preset trading speed for quality.
+ * @return u64
+ */
+static u64 etc2_encode_alpha(const byte block[16][4],
+        enum texture_compression compression)
+{
+    i32 min = 255;
+    i32 max = 0;
+    u64 best_bits = 0;
+    u32 best_error = UINT32_MAX;
+    i32 spread = (compression == TEXTURE_COMPRESSION_BEST) ? 1 : 0;
+
+    for (size_t p = 0 ; p < 16 ; p++) {
+        min = (block[p][3] < min) ? block[p][3] : min;
+        max = (block[p][3] > max) ? block[p][3] : max;
+    }
+
+    // a single modifier of table 13 is zero
+    if (min == max) {
+        best_bits = ((u64) min << 56) | ((u64) 1 << 52) | ((u64) 13 << 48);
+        for (size_t j = 0 ; j < 16 ; j++) {
+            best_bits |= (u64) 4 << (45 - (3 * j));
+        }
+        return best_bits;
+    }
+
+    for (u32 table = 0 ; table < 16 ; table++) {
+        i32 low = etc2_alpha_modifiers[table][3];
+        i32 high = etc2_alpha_modifiers[table][7];
+        i32 multiplier = (i32) lroundf((f32) (max - min) / (f32) (high - low));
+        i32 base = 0;
+
+        multiplier = (multiplier < 1) ? 1
+                : ((multiplier > 15) ? 15 : multiplier);
+        base = (i32) lroundf((f32) (max + min) * .5f
+                - ((f32) (high + low) * (f32) multiplier * .5f));
+
+        for (i32 dm = -spread ; dm <= spread ; dm++) {
+            for (i32 db = -2 * spread ; db <= 2 * spread ; db++) {
+                i32 m = multiplier + dm;
+                i32 b = etc2_clamp(base + db);
+                u64 indices = 0;
+                u32 error = 0;
+
+                if ((m < 1) || (m > 15)) {
+                    continue;
+                }
+
+                error = etc2_fit_alpha(block, b, m, table, &indices);
+                if (error < best_error) {
+                    best_error = error;
+                    best_bits = ((u64) b << 56) | ((u64) m << 52)
+                            | ((u64) table << 48) | indices;
+                }
+            }
+        }
+    }
+
+    return best_bits;
+}
+
+/**
+ * @brief Picks the modifier of each pixel of an EAC block, and returns the
+ * squared error of the encoding.
+ *
+ * @param[in] block Pixels of the block, row after row.
+ * @param[in] base Base alpha of the block.
+ * @param[in] multiplier Multiplier of the modifiers.
+ * @param[in] table Table of modifiers.
+ * @param[out] out_indices Receives the indices, in place in the EAC block.
+ * @return u32
+ */
+static u32 etc2_fit_alpha(const byte block[16][4], i32 base, i32 multiplier,
+        u32 table, u64 *out_indices)
+{
+    u64 indices = 0;
+    u32 error = 0;
+
+    for (u32 p = 0 ; p < 16 ; p++) {
+        u32 j = ((p % 4) * 4) + (p / 4);
+        u32 best = UINT32_MAX;
+        u64 best_index = 0;
+
+        for (u64 index = 0 ; index < 8 ; index++) {
+            i32 d = etc2_clamp(base + (etc2_alpha_modifiers[table][index]
+                    * multiplier)) - block[p][3];
+
+            if ((u32) (d * d) < best) {
+                best = (u32) (d * d);
+                best_index = index;
+            }
+        }
+
+        indices |= best_index << (45 - (3 * j));
+        error += best;
+    }
+
+    *out_indices = indices;
+
+    return error;
+}
+
+/**
+ * @brief Writes a 64 bits block, most significant byte first.
+ *
+ * @param[in] bits Block.
+ * @param[out] out Receives the 8 bytes of the block.
+ */
+static void etc2_store(u64 bits, byte *out)
+{
+    for (size_t i = 0 ; i < 8 ; i++) {
+        out[i] = (byte) (bits >> (56 - (8 * i)));
+    }
+}
+
+/**
+ * @brief Extends a quantized color channel to 8 bits, repeating its high bits
+ * in the low ones.
+ *
+ * @param[in] value Quantized channel.
+ * @param[in] bits Bits of the quantized channel.
+ * @return i32
+ */
+static i32 etc2_extend(i32 value, u32 bits)
+{
+    return (value << (8 - bits)) | (value >> ((2 * bits) - 8));
+}
+
+/**
+ * @brief Clamps a value to a byte.
+ *
+ * @param[in] value
+ * @return i32
+ */
+static i32 etc2_clamp(i32 value)
+{
+    return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
@@ -0,0 +1,425 @@
+/**
+ * @file 3dful_texture_baked.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the baked texture format, holding the pixels of a
+ * texture and all of its mip levels in the format they are sent to the GPU
+ * in, to be loaded without decoding any image or generating any mipmap.
+ *
+ * The file is a header, followed by each mip level from the largest to the
+ * smallest, with tightly packed rows or as ETC2 blocks. It is only meant to be
+ * read back by the program that wrote it.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "3dful_texture_processing.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Bytes found at the start of baked texture files. */
+#define TEXTURE_BAKED_MAGIC { '3', 'D', 'F', 'T' }
+/** Version of the format, changed when the layout of the data changes. */
+#define TEXTURE_BAKED_VERSION (2u)
+
+/**
+ * @brief Header found at the start of baked texture files.
+ */
+struct texture_baked_header {
+    char magic[4];
+    u32 version;
+    /** Hash of the data the texture was baked from. */
+    u64 source_hash;
+
+    /** Formats given to glTexImage2D(). */
+    u32 internal_format, format;
+    u32 width, height;
+    u32 channels;
+    u32 levels_nb;
+    /** Compression of the levels (enum texture_compression). */
+    u32 compression;
+};
+
+static void texture_baked_downsample(const byte *source, u32 width,
+        u32 height, u32 channels, byte *destination);
+static size_t texture_baked_level_length(
+        const struct texture_baked_header *header, u32 width, u32 height);
+static size_t texture_baked_length(const struct texture_baked_header *header);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Bakes an image to a baked texture file, tagged with the hash of the
+ * data the image was decoded from. Colors are stored as RGB, or RGBA if they
+ * are not opaque, and the mip levels are computed with a box filter, like
+ * glGenerateMipmap() does for the textures sent as they are decoded. Each
+ * level is then compressed to ETC2 blocks if asked to.
+ * The file is written next to its destination, and then moved in place so it
+ * is never seen half-written. Returns false if the file cannot be written.
+ *
+ * @param[in] image Baked image.
+ * @param[in] path Path to the baked texture file.
+ * @param[in] source_hash Hash of the data the image was decoded from.
+ * @param[in] compression Compression of the levels.
+ * @return bool
+ */
+bool texture_baked_write(SDL_Surface *image, const char *path,
+        u64 source_hash, enum texture_compression compression)
+{
+    struct allocator alloc = make_system_allocator();
+    struct texture_baked_header header = {
+            .magic = TEXTURE_BAKED_MAGIC,
+            .version = TEXTURE_BAKED_VERSION,
+            .source_hash = source_hash,
+            .compression = compression,
+    };
+    SDL_Surface *converted = nullptr;
+    SDL_Surface *source = image;
+    byte *pixels = nullptr;
+    byte *compressed = nullptr;
+    byte *level = nullptr;
+    byte *compressed_level = nullptr;
+    u32 width = 0;
+    u32 height = 0;
+    char temporary_path[512] = { 0 };
+    FILE *file = nullptr;
+    size_t length = 0;
+    bool opaque = true;
+    bool written = false;
+
+    if (!image || (image->w <= 0) || (image->h <= 0)) {
+        return false;
+    }
+
+    if ((size_t) snprintf(temporary_path, sizeof(temporary_path), "%s.tmp",
+                path) >= sizeof(temporary_path)) {
+        return false;
+    }
+
+    // palettes, grey levels and the many layouts of colors are brought back
+    // to RGBA
+    if (image->format->format != SDL_PIXELFORMAT_RGBA32) {
+        converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+        if (!converted) {
+            fprintf(stderr, "could not convert texture to bake : %s\n",
+                    SDL_GetError());
+            return false;
+        }
+        source = converted;
+    }
+
+    header.width = (u32) source->w;
+    header.height = (u32) source->h;
+    header.levels_nb = 1;
+    for (u32 w = header.width, h = header.height ;
+            ((w > 1) || (h > 1))
+                    && (header.levels_nb < TEXTURE_BAKED_LEVELS_MAX) ;
+            w = (w > 1) ? (w / 2) : 1, h = (h > 1) ? (h / 2) : 1) {
+        header.levels_nb += 1;
+    }
+
+    for (i32 y = 0 ; (y < source->h) && opaque ; y++) {
+        const byte *row = (const byte *) source->pixels
+                + ((size_t) y * (size_t) source->pitch);
+
+        for (i32 x = 0 ; (x < source->w) && opaque ; x++) {
+            opaque = (row[(x * 4) + 3] == 0xff);
+        }
+    }
+
+    header.channels = opaque ? 3 : 4;
+    if (compression != TEXTURE_COMPRESSION_NONE) {
+        header.internal_format = opaque ? GL_COMPRESSED_RGB8_ETC2
+                : GL_COMPRESSED_RGBA8_ETC2_EAC;
+    } else if (opaque) {
+        header.internal_format = GL_RGB8;
+        header.format = GL_RGB;
+    } else {
+        header.internal_format = GL_RGBA8;
+        header.format = GL_RGBA;
+    }
+
+    // the levels are first computed as they are, and compressed afterwards
+    header.compression = TEXTURE_COMPRESSION_NONE;
+    length = texture_baked_length(&header);
+    header.compression = compression;
+    pixels = alloc.malloc(alloc, length);
+    if (!pixels) {
+        goto cleanup;
+    }
+
+    // the first level is the image, with tightly packed rows
+    for (i32 y = 0 ; y < source->h ; y++) {
+        const byte *row = (const byte *) source->pixels
+                + ((size_t) y * (size_t) source->pitch);
+        byte *destination = pixels
+                + ((size_t) y * header.width * header.channels);
+
+        if (header.channels == 4) {
+            memcpy(destination, row, header.width * header.channels);
+            continue;
+        }
+        for (u32 x = 0 ; x < header.width ; x++) {
+            memcpy(destination + (x * header.channels), row + (x * 4),
+                    header.channels);
+        }
+    }
+
+    level = pixels;
+    width = header.width;
+    height = header.height;
+    for (u32 i = 1 ; i < header.levels_nb ; i++) {
+        byte *next = level + ((size_t) width * height * header.channels);
+
+        texture_baked_downsample(level, width, height, header.channels, next);
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+        level = next;
+    }
+
+    if (compression != TEXTURE_COMPRESSION_NONE) {
+        length = texture_baked_length(&header);
+        compressed = alloc.malloc(alloc, length);
+        if (!compressed) {
+            goto cleanup;
+        }
+
+        level = pixels;
+        compressed_level = compressed;
+        width = header.width;
+        height = header.height;
+        for (u32 i = 0 ; i < header.levels_nb ; i++) {
+            etc2_compress(level, width, height, header.channels, compression,
+                    compressed_level);
+            level += (size_t) width * height * header.channels;
+            compressed_level += texture_baked_level_length(&header, width,
+                    height);
+            width = (width > 1) ? (width / 2) : 1;
+            height = (height > 1) ? (height / 2) : 1;
+        }
+    }
+
+    file = fopen(temporary_path, "wb");
+    if (!file) {
+        fprintf(stderr, "could not write texture to %s\n", path);
+        goto cleanup;
+    }
+
+    written = (fwrite(&header, sizeof(header), 1, file) == 1)
+            && (fwrite(compressed ? compressed : pixels, 1, length, file)
+                    == length);
+    written = (fclose(file) == 0) && written;
+
+    if (!written || (rename(temporary_path, path) != 0)) {
+        fprintf(stderr, "could not write texture to %s\n", path);
+        remove(temporary_path);
+        written = false;
+    }
+
+cleanup:
+    if (pixels) alloc.free(alloc, pixels);
+    if (compressed) alloc.free(alloc, compressed);
+    SDL_FreeSurface(converted);
+
+    return written;
+}
+
+/**
+ * @brief Maps a baked texture file in memory, if it exists and was baked from
+ * the data described by some hash, with some compression. The mapping is read by
+ * texture_baked_read(), and released by texture_baked_unmap().
+ * Returns false if the file cannot be used.
+ *
+ * @param[in] path Path to the baked texture file.
+ * @param[in] source_hash Hash of the data the texture should come from.
+ * @param[in] compression Compression the levels should have.
+ * @param[out] out_mapped Filled with the mapped contents of the file.
+ * @param[out] out_length Filled with the length of the mapped contents.
+ * @return bool
+ */
+bool texture_baked_map(const char *path, u64 source_hash,
+        enum texture_compression compression, const byte **out_mapped,
+        size_t *out_length)
+{
+    struct texture_baked_header header = { 0 };
+    struct stat file_stat = { 0 };
+    const byte *mapped = nullptr;
+    i32 fd = -1;
+    bool valid = false;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    if ((fstat(fd, &file_stat) != 0)
+            || ((size_t) file_stat.st_size < sizeof(header))) {
+        close(fd);
+        return false;
+    }
+
+    mapped = mmap(nullptr, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE,
+            fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    memcpy(&header, mapped, sizeof(header));
+
+    valid = (memcmp(header.magic, (char[]) TEXTURE_BAKED_MAGIC,
+                    sizeof(header.magic)) == 0)
+            && (header.version == TEXTURE_BAKED_VERSION)
+            && (header.source_hash == source_hash)
+            && (header.compression == (u32) compression)
+            && (header.channels >= 3) && (header.channels <= 4)
+            && (header.levels_nb >= 1)
+            && (header.levels_nb <= TEXTURE_BAKED_LEVELS_MAX)
+            && ((size_t) file_stat.st_size == (sizeof(header)
+                    + texture_baked_length(&header)));
+
+    if (!valid) {
+        munmap((void *) mapped, (size_t) file_stat.st_size);
+        return false;
+    }
+
+    *out_mapped = mapped;
+    *out_length = (size_t) file_stat.st_size;
+
+    return true;
+}
+
+/**
+ * @brief Releases a baked texture file mapped by texture_baked_map().
+ *
+ * @param[in] mapped Mapped contents of the file.
+ * @param[in] length Length of the mapped contents.
+ */
+void texture_baked_unmap(const byte *mapped, size_t length)
+{
+    munmap((void *) mapped, length);
+}
+
+/**
+ * @brief Reads the formats and the mip levels of a baked texture file mapped
+ * by texture_baked_map(). The levels point in the mapped contents.
+ *
+ * @param[in] mapped Mapped contents of the file.
+ * @param[out] out_layout Filled with the formats and levels of the texture.
+ */
+void texture_baked_read(const byte *mapped,
+        struct texture_baked_layout *out_layout)
+{
+    struct texture_baked_header header = { 0 };
+    const byte *pixels = mapped + sizeof(header);
+    u32 width = 0;
+    u32 height = 0;
+
+    memcpy(&header, mapped, sizeof(header));
+
+    out_layout->internal_format = header.internal_format;
+    out_layout->format = header.format;
+    out_layout->compressed = (header.compression != TEXTURE_COMPRESSION_NONE);
+    out_layout->levels_nb = header.levels_nb;
+
+    width = header.width;
+    height = header.height;
+    for (size_t i = 0 ; i < header.levels_nb ; i++) {
+        out_layout->levels[i] = (struct texture_baked_level) {
+                .width = width,
+                .height = height,
+                .pixels = pixels,
+                .length = texture_baked_level_length(&header, width, height),
+        };
+        pixels += out_layout->levels[i].length;
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Computes a mip level from the previous one, each pixel averaging the
+ * two by two pixels it covers. Odd sizes repeat the last row or column.
+ *
+ * @param[in] source Pixels of the previous level.
+ * @param[in] width Width of the previous level.
+ * @param[in] height Height of the previous level.
+ * @param[in] channels Number of channels, in bytes per pixel.
+ * @param[out] destination Pixels of the computed level.
+ */
+static void texture_baked_downsample(const byte *source, u32 width,
+        u32 height, u32 channels, byte *destination)
+{
+    u32 next_width = (width > 1) ? (width / 2) : 1;
+    u32 next_height = (height > 1) ? (height / 2) : 1;
+
+    for (u32 y = 0 ; y < next_height ; y++) {
+        u32 y0 = (y * 2 < height) ? (y * 2) : (height - 1);
+        u32 y1 = (y * 2 + 1 < height) ? (y * 2 + 1) : (height - 1);
+
+        for (u32 x = 0 ; x < next_width ; x++) {
+            u32 x0 = (x * 2 < width) ? (x * 2) : (width - 1);
+            u32 x1 = (x * 2 + 1 < width) ? (x * 2 + 1) : (width - 1);
+            const byte *p00 = source + (((size_t) y0 * width + x0) * channels);
+            const byte *p01 = source + (((size_t) y0 * width + x1) * channels);
+            const byte *p10 = source + (((size_t) y1 * width + x0) * channels);
+            const byte *p11 = source + (((size_t) y1 * width + x1) * channels);
+            byte *out = destination
+                    + (((size_t) y * next_width + x) * channels);
+
+            for (u32 c = 0 ; c < channels ; c++) {
+                out[c] = (byte) ((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes the length of the pixels of a mip level of a texture.
+ *
+ * @param[in] header Header of the texture.
+ * @param[in] width Width of the level.
+ * @param[in] height Height of the level.
+ * @return size_t
+ */
+static size_t texture_baked_level_length(
+        const struct texture_baked_header *header, u32 width, u32 height)
+{
+    if (header->compression != TEXTURE_COMPRESSION_NONE) {
+        return etc2_compressed_length(width, height, (header->channels == 4));
+    }
+
+    return (size_t) width * height * header->channels;
+}
+
+/**
+ * @brief Computes the length of the pixels of all mip levels of a texture.
+ *
+ * @param[in] header Header of the texture.
+ * @return size_t
+ */
+static size_t texture_baked_length(const struct texture_baked_header *header)
+{
+    u32 width = header->width;
+    u32 height = header->height;
+    size_t length = 0;
+
+    for (u32 i = 0 ; i < header->levels_nb ; i++) {
+        length += texture_baked_level_length(header, width, height);
+        width = (width > 1) ? (width / 2) : 1;
+        height = (height > 1) ? (height / 2) : 1;
+    }
+
+    return length;
+}
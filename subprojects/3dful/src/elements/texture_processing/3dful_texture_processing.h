@@ -0,0 +1,70 @@
+/**
+ * @file 3dful_texture_processing.h
+ * @author Gabriel Bédat
+ * @brief Provides passes preparing the pixels of textures ahead of time, so
+ * they are sent to the GPU as they are.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef TEXTURE_PROCESSING_3DFUL_H__
+#define TEXTURE_PROCESSING_3DFUL_H__
+
+#include "../3dful_core.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Most mip levels of a baked texture, enough for 32768 pixels wide images. */
+#define TEXTURE_BAKED_LEVELS_MAX (16u)
+
+/**
+ * @brief Mip level of a baked texture, pointing in the mapped file.
+ */
+struct texture_baked_level {
+    u32 width, height;
+    const byte *pixels;
+    size_t length;
+};
+
+/**
+ * @brief Layout of the pixels of a baked texture, as given to OpenGL.
+ */
+struct texture_baked_layout {
+    GLenum internal_format;
+    GLenum format;
+    /** Whether the levels are compressed blocks, sent with
+        glCompressedTexImage2D(). */
+    bool compressed;
+    size_t levels_nb;
+    struct texture_baked_level levels[TEXTURE_BAKED_LEVELS_MAX];
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// Bakes an image with its mip chain in the format it is sent to the GPU in.
+bool texture_baked_write(SDL_Surface *image, const char *path,
+        u64 source_hash, enum texture_compression compression);
+// Maps a baked texture file in memory, if it was baked from some data.
+bool texture_baked_map(const char *path, u64 source_hash,
+        enum texture_compression compression, const byte **out_mapped,
+        size_t *out_length);
+// Releases a mapped baked texture file.
+void texture_baked_unmap(const byte *mapped, size_t length);
+// Reads the format and mip levels of a mapped baked texture file.
+void texture_baked_read(const byte *mapped,
+        struct texture_baked_layout *out_layout);
+
+// -----------------------------------------------------------------------------
+
+// Computes the length of an image compressed to ETC2 blocks.
+size_t etc2_compressed_length(u32 width, u32 height, bool alpha);
+// Compresses an image to ETC2 blocks, with EAC alpha if it has some.
+void etc2_compress(const byte *pixels, u32 width, u32 height, u32 channels,
+        enum texture_compression compression, byte *out);
+
+#endif
@@ -0,0 +1,473 @@
+/**
+ * @file 3dful_gl_state.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the OpenGL state shadow.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "3dful_gl_state.h"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/// Value of a tracked name or enum whose state in the context is not known.
+#define GL_STATE_UNKNOWN (0xFFFFFFFFu)
+
+/// Number of texture units tracked.
+#define GL_STATE_TEXTURE_UNITS (16u)
+/// Number of indexed uniform buffer binding points tracked.
+#define GL_STATE_UNIFORM_BINDINGS (16u)
+
+/**
+ * @brief Buffer targets whose binding is tracked.
+ */
+enum gl_state_buffer_target {
+    GL_STATE_BUFFER_ARRAY,
+    GL_STATE_BUFFER_ELEMENT_ARRAY,
+    GL_STATE_BUFFER_UNIFORM,
+
+    GL_STATE_BUFFER_TARGETS_NUMBER,
+};
+
+/**
+ * @brief Texture targets whose binding is tracked.
+ */
+enum gl_state_texture_target {
+    GL_STATE_TEXTURE_2D,
+    GL_STATE_TEXTURE_CUBE_MAP,
+    GL_STATE_TEXTURE_2D_ARRAY,
+
+    GL_STATE_TEXTURE_TARGETS_NUMBER,
+};
+
+/**
+ * @brief Capabilities whose state is tracked.
+ */
+enum gl_state_capability {
+    GL_STATE_CAPABILITY_CULL_FACE,
+    GL_STATE_CAPABILITY_DEPTH_TEST,
+    GL_STATE_CAPABILITY_BLEND,
+
+    GL_STATE_CAPABILITIES_NUMBER,
+};
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+static bool gl_state_changes(GLuint *shadow, GLuint value);
+
+static size_t gl_state_buffer_target_of(GLenum target);
+static size_t gl_state_texture_target_of(GLenum target);
+static size_t gl_state_capability_of(GLenum capability);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Last known state of the OpenGL context. Every field starts as
+ * unknown, so the first call setting it is always issued.
+ */
+static struct {
+    GLuint program;
+    GLuint vao;
+    GLuint buffers[GL_STATE_BUFFER_TARGETS_NUMBER];
+    GLuint uniform_bindings[GL_STATE_UNIFORM_BINDINGS];
+
+    GLuint active_unit;
+    GLuint textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS_NUMBER];
+
+    GLuint capabilities[GL_STATE_CAPABILITIES_NUMBER];
+    GLuint cull_face;
+    GLuint depth_mask;
+
+    struct gl_state_stats stats;
+} gl_state;
+
+/**
+ * @brief Wether the shadow state was initialized.
+ */
+static bool gl_state_initialized = false;
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Forgets everything about the OpenGL context state : the next calls
+ * will all be issued. Call this when the context is created, or after some
+ * code outside of 3dful changed its state.
+ *
+ */
+void gl_state_invalidate(void)
+{
+    gl_state.program = GL_STATE_UNKNOWN;
+    gl_state.vao = GL_STATE_UNKNOWN;
+    for (size_t i = 0 ; i < GL_STATE_BUFFER_TARGETS_NUMBER ; i++) {
+        gl_state.buffers[i] = GL_STATE_UNKNOWN;
+    }
+    for (size_t i = 0 ; i < GL_STATE_UNIFORM_BINDINGS ; i++) {
+        gl_state.uniform_bindings[i] = GL_STATE_UNKNOWN;
+    }
+
+    gl_state.active_unit = GL_STATE_UNKNOWN;
+    for (size_t i = 0 ; i < GL_STATE_TEXTURE_UNITS ; i++) {
+        for (size_t j = 0 ; j < GL_STATE_TEXTURE_TARGETS_NUMBER ; j++) {
+            gl_state.textures[i][j] = GL_STATE_UNKNOWN;
+        }
+    }
+
+    for (size_t i = 0 ; i < GL_STATE_CAPABILITIES_NUMBER ; i++) {
+        gl_state.capabilities[i] = GL_STATE_UNKNOWN;
+    }
+    gl_state.cull_face = GL_STATE_UNKNOWN;
+    gl_state.depth_mask = GL_STATE_UNKNOWN;
+
+    gl_state_initialized = true;
+}
+
+/**
+ * @brief Returns how many state changes were forwarded to OpenGL, and how many
+ * were skipped because they would not change anything, since the last reset.
+ *
+ * @return struct gl_state_stats
+ */
+struct gl_state_stats gl_state_get_stats(void)
+{
+    return gl_state.stats;
+}
+
+/**
+ * @brief Sets the issued and elided counters back to zero.
+ *
+ */
+void gl_state_reset_stats(void)
+{
+    gl_state.stats = (struct gl_state_stats) { 0 };
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Makes a program part of the current rendering state, if it is not
+ * already.
+ *
+ * @param[in] program Name of a linked program.
+ */
+void gl_state_use_program(GLuint program)
+{
+    if (gl_state_changes(&gl_state.program, program)) {
+        glUseProgram(program);
+    }
+}
+
+/**
+ * @brief Binds a vertex array object, if it is not already. The element array
+ * buffer binding being part of the vertex array, it becomes unknown.
+ *
+ * @param[in] vao Name of a vertex array object.
+ */
+void gl_state_bind_vertex_array(GLuint vao)
+{
+    if (gl_state_changes(&gl_state.vao, vao)) {
+        glBindVertexArray(vao);
+        gl_state.buffers[GL_STATE_BUFFER_ELEMENT_ARRAY] = GL_STATE_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Binds a buffer object to a target, if it is not already.
+ *
+ * @param[in] target Buffer target.
+ * @param[in] buffer Name of a buffer object.
+ */
+void gl_state_bind_buffer(GLenum target, GLuint buffer)
+{
+    size_t slot = gl_state_buffer_target_of(target);
+
+    if (slot >= GL_STATE_BUFFER_TARGETS_NUMBER) {
+        gl_state_changes(nullptr, buffer);
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (gl_state_changes(&gl_state.buffers[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+/**
+ * @brief Binds a buffer object to an indexed binding point, if it is not
+ * already. The buffer also becomes bound to the generic target.
+ *
+ * @param[in] target Buffer target.
+ * @param[in] index Binding point.
+ * @param[in] buffer Name of a buffer object.
+ */
+void gl_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+    size_t slot = gl_state_buffer_target_of(target);
+
+    if ((target != GL_UNIFORM_BUFFER) || (index >= GL_STATE_UNIFORM_BINDINGS)) {
+        gl_state_changes(nullptr, buffer);
+        glBindBufferBase(target, index, buffer);
+        if (slot < GL_STATE_BUFFER_TARGETS_NUMBER) {
+            gl_state.buffers[slot] = buffer;
+        }
+        return;
+    }
+
+    if (gl_state_changes(&gl_state.uniform_bindings[index], buffer)) {
+        glBindBufferBase(target, index, buffer);
+        gl_state.buffers[GL_STATE_BUFFER_UNIFORM] = buffer;
+    }
+}
+
+/**
+ * @brief Binds a texture to a target of some texture unit, if it is not
+ * already. The active texture unit is only changed when needed.
+ *
+ * @param[in] unit Texture unit, starting from 0.
+ * @param[in] target Texture target.
+ * @param[in] texture Name of a texture.
+ */
+void gl_state_bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+    size_t slot = gl_state_texture_target_of(target);
+    GLuint *shadow = nullptr;
+
+    if ((slot < GL_STATE_TEXTURE_TARGETS_NUMBER)
+            && (unit < GL_STATE_TEXTURE_UNITS)) {
+        shadow = &gl_state.textures[unit][slot];
+    }
+
+    if (shadow && !gl_state_changes(shadow, texture)) {
+        return;
+    } else if (!shadow) {
+        gl_state_changes(nullptr, texture);
+    }
+
+    if (gl_state_changes(&gl_state.active_unit, unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    glBindTexture(target, texture);
+}
+
+/**
+ * @brief Enables or disables a server-side capability, if it is not already.
+ *
+ * @param[in] capability OpenGL capability.
+ * @param[in] enabled Wether the capability is enabled.
+ */
+void gl_state_capability(GLenum capability, bool enabled)
+{
+    size_t slot = gl_state_capability_of(capability);
+    bool changes = true;
+
+    if (slot < GL_STATE_CAPABILITIES_NUMBER) {
+        changes = gl_state_changes(&gl_state.capabilities[slot], enabled);
+    } else {
+        gl_state_changes(nullptr, enabled);
+    }
+
+    if (!changes) {
+        return;
+    }
+
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+/**
+ * @brief Chooses the faces culled when face culling is enabled, if they are not
+ * already.
+ *
+ * @param[in] mode GL_FRONT, GL_BACK or GL_FRONT_AND_BACK.
+ */
+void gl_state_cull_face(GLenum mode)
+{
+    if (gl_state_changes(&gl_state.cull_face, mode)) {
+        glCullFace(mode);
+    }
+}
+
+/**
+ * @brief Enables or disables writing to the depth buffer, if it is not
+ * already.
+ *
+ * @param[in] flag GL_TRUE to enable writing.
+ */
+void gl_state_depth_mask(GLboolean flag)
+{
+    if (gl_state_changes(&gl_state.depth_mask, flag)) {
+        glDepthMask(flag);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Notifies that a program is about to be deleted. Deleting the program
+ * in use keeps it in use, but its name might be given out again.
+ *
+ * @param[in] program Deleted program.
+ */
+void gl_state_forget_program(GLuint program)
+{
+    if (gl_state.program == program) {
+        gl_state.program = GL_STATE_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Notifies that a vertex array object is about to be deleted. Deleting
+ * the bound vertex array binds 0 instead.
+ *
+ * @param[in] vao Deleted vertex array.
+ */
+void gl_state_forget_vertex_array(GLuint vao)
+{
+    if (gl_state.vao == vao) {
+        gl_state.vao = 0;
+        gl_state.buffers[GL_STATE_BUFFER_ELEMENT_ARRAY] = GL_STATE_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Notifies that a buffer object is about to be deleted. Deleting a bound
+ * buffer binds 0 instead wherever it was bound.
+ *
+ * @param[in] buffer Deleted buffer.
+ */
+void gl_state_forget_buffer(GLuint buffer)
+{
+    for (size_t i = 0 ; i < GL_STATE_BUFFER_TARGETS_NUMBER ; i++) {
+        if (gl_state.buffers[i] == buffer) {
+            gl_state.buffers[i] = 0;
+        }
+    }
+
+    for (size_t i = 0 ; i < GL_STATE_UNIFORM_BINDINGS ; i++) {
+        if (gl_state.uniform_bindings[i] == buffer) {
+            gl_state.uniform_bindings[i] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Notifies that a texture is about to be deleted. Deleting a bound
+ * texture binds 0 instead wherever it was bound.
+ *
+ * @param[in] texture Deleted texture.
+ */
+void gl_state_forget_texture(GLuint texture)
+{
+    for (size_t i = 0 ; i < GL_STATE_TEXTURE_UNITS ; i++) {
+        for (size_t j = 0 ; j < GL_STATE_TEXTURE_TARGETS_NUMBER ; j++) {
+            if (gl_state.textures[i][j] == texture) {
+                gl_state.textures[i][j] = 0;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Compares a value to its shadow, updates the shadow and counts the
+ * call as issued or elided. A null shadow is for untracked state, always
+ * issued.
+ *
+ * @param[inout] shadow Tracked value, or nullptr.
+ * @param[in] value New value.
+ * @return true if the call needs to be issued.
+ */
+static bool gl_state_changes(GLuint *shadow, GLuint value)
+{
+    if (!gl_state_initialized) {
+        gl_state_invalidate();
+    }
+
+    if (shadow && (*shadow == value)) {
+        gl_state.stats.elided += 1;
+        return false;
+    }
+
+    if (shadow) {
+        *shadow = value;
+    }
+    gl_state.stats.issued += 1;
+
+    return true;
+}
+
+/**
+ * @brief Maps a buffer target to its slot in the shadow state, or to
+ * GL_STATE_BUFFER_TARGETS_NUMBER if it is not tracked.
+ *
+ * @param[in] target
+ * @return size_t
+ */
+static size_t gl_state_buffer_target_of(GLenum target)
+{
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return GL_STATE_BUFFER_ARRAY;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return GL_STATE_BUFFER_ELEMENT_ARRAY;
+        case GL_UNIFORM_BUFFER:
+            return GL_STATE_BUFFER_UNIFORM;
+        default:
+            return GL_STATE_BUFFER_TARGETS_NUMBER;
+    }
+}
+
+/**
+ * @brief Maps a texture target to its slot in the shadow state, or to
+ * GL_STATE_TEXTURE_TARGETS_NUMBER if it is not tracked.
+ *
+ * @param[in] target
+ * @return size_t
+ */
+static size_t gl_state_texture_target_of(GLenum target)
+{
+    switch (target) {
+        case GL_TEXTURE_2D:
+            return GL_STATE_TEXTURE_2D;
+        case GL_TEXTURE_CUBE_MAP:
+            return GL_STATE_TEXTURE_CUBE_MAP;
+        case GL_TEXTURE_2D_ARRAY:
+            return GL_STATE_TEXTURE_2D_ARRAY;
+        default:
+            return GL_STATE_TEXTURE_TARGETS_NUMBER;
+    }
+}
+
+/**
+ * @brief Maps a capability to its slot in the shadow state, or to
+ * GL_STATE_CAPABILITIES_NUMBER if it is not tracked.
+ *
+ * @param[in] capability
+ * @return size_t
+ */
+static size_t gl_state_capability_of(GLenum capability)
+{
+    switch (capability) {
+        case GL_CULL_FACE:
+            return GL_STATE_CAPABILITY_CULL_FACE;
+        case GL_DEPTH_TEST:
+            return GL_STATE_CAPABILITY_DEPTH_TEST;
+        case GL_BLEND:
+            return GL_STATE_CAPABILITY_BLEND;
+        default:
+            return GL_STATE_CAPABILITIES_NUMBER;
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * @file 3dful_gl_state.h
+ * @author Gabriel Bédat
+ * @brief Interface to a shadow of the OpenGL context state, used to skip
+ * calls that would not change anything.
+ *
+ * All binds and capability changes made by 3dful go through these functions,
+ * so the shadow stays true to the context. Deleting an object bound somewhere
+ * MUST be reported with the matching forget function.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef GL_STATE_3DFUL_H__
+#define GL_STATE_3DFUL_H__
+
+#include <SDL2/SDL.h>
+#include <GLES3/gl3.h>
+
+#include <ustd/common.h>
+
+#include <3dful.h>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// Makes a program part of the current rendering state.
+void gl_state_use_program(GLuint program);
+// Binds a vertex array object.
+void gl_state_bind_vertex_array(GLuint vao);
+// Binds a buffer object to a target.
+void gl_state_bind_buffer(GLenum target, GLuint buffer);
+// Binds a buffer object to an indexed binding point of a target.
+void gl_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+// Binds a texture to a target of some texture unit.
+void gl_state_bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+// Enables or disables a server-side capability.
+void gl_state_capability(GLenum capability, bool enabled);
+// Chooses the culled faces.
+void gl_state_cull_face(GLenum mode);
+// Enables or disables writing to the depth buffer.
+void gl_state_depth_mask(GLboolean flag);
+
+// -----------------------------------------------------------------------------
+
+// A program is about to be deleted.
+void gl_state_forget_program(GLuint program);
+// A vertex array object is about to be deleted.
+void gl_state_forget_vertex_array(GLuint vao);
+// A buffer object is about to be deleted.
+void gl_state_forget_buffer(GLuint buffer);
+// A texture is about to be deleted.
+void gl_state_forget_texture(GLuint texture);
+
+#endif
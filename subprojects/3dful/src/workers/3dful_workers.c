@@ -0,0 +1,307 @@
+/**
+ * @file 3dful_workers.c
+ * @author Gabriel Bédat
+ * @brief Implementation of the pool of threads running long tasks (parsing,
+ * decoding...) away from the rendering thread.
+ *
+ * The pool is started on the first task pushed, with one thread per
+ * additional CPU core. Without any additional core, tasks are run as soon as
+ * they are pushed.
+ *
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <3dful.h>
+
+#include <ustd/array.h>
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/** Most threads started by the pool. */
+#define WORKERS_MAX (16u)
+
+/**
+ * @brief Task waiting in the queue of the pool.
+ */
+struct worker_task {
+    worker_task_f task;
+    void *data;
+    struct worker_group *group;
+};
+
+static i32 workers_loop(void *data);
+static bool workers_pop(struct worker_task *out_task);
+static void workers_run(struct worker_task task);
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief State of the pool, shared by all threads and guarded by its lock.
+ */
+static struct workers_state {
+    bool started;
+    bool running;
+
+    SDL_mutex *lock;
+    SDL_cond *task_pushed;
+    SDL_cond *task_done;
+
+    ARRAY(struct worker_task) queue;
+    size_t queue_head;
+
+    SDL_Thread *threads[WORKERS_MAX];
+    size_t threads_nb;
+} workers = { 0 };
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Starts the pool with some number of threads. Does nothing if the
+ * pool was already started. Should be called from the main thread.
+ *
+ * @param[in] threads_nb Number of threads, 0 for one per additional CPU core.
+ */
+void workers_start(size_t threads_nb)
+{
+    if (workers.started) {
+        return;
+    }
+
+    if (threads_nb == 0) {
+        i32 cores = SDL_GetCPUCount();
+        threads_nb = (cores > 1) ? (size_t) (cores - 1) : 0;
+    }
+    threads_nb = (threads_nb < WORKERS_MAX) ? threads_nb : WORKERS_MAX;
+
+    workers.lock = SDL_CreateMutex();
+    workers.task_pushed = SDL_CreateCond();
+    workers.task_done = SDL_CreateCond();
+    workers.queue = array_create(make_system_allocator(),
+            sizeof(*workers.queue), 64);
+    workers.queue_head = 0;
+    workers.running = true;
+    workers.started = true;
+
+    workers.threads_nb = 0;
+    for (size_t i = 0 ; i < threads_nb ; i++) {
+        workers.threads[workers.threads_nb] = SDL_CreateThread(&workers_loop,
+                "3dful worker", nullptr);
+        if (!workers.threads[workers.threads_nb]) {
+            fprintf(stderr, "could not start worker thread : %s\n",
+                    SDL_GetError());
+            break;
+        }
+        workers.threads_nb += 1;
+    }
+}
+
+/**
+ * @brief Waits for the threads of the pool to finish their current task, and
+ * stops them. Tasks left in the queue are run on the calling thread first.
+ * Should be called from the main thread.
+ */
+void workers_stop(void)
+{
+    struct worker_task task = { 0 };
+
+    if (!workers.started) {
+        return;
+    }
+
+    while (workers_pop(&task)) {
+        workers_run(task);
+    }
+
+    SDL_LockMutex(workers.lock);
+    workers.running = false;
+    SDL_CondBroadcast(workers.task_pushed);
+    SDL_UnlockMutex(workers.lock);
+
+    for (size_t i = 0 ; i < workers.threads_nb ; i++) {
+        SDL_WaitThread(workers.threads[i], nullptr);
+    }
+
+    array_destroy(make_system_allocator(), (ARRAY_ANY *) &workers.queue);
+    SDL_DestroyCond(workers.task_done);
+    SDL_DestroyCond(workers.task_pushed);
+    SDL_DestroyMutex(workers.lock);
+
+    workers = (struct workers_state) { 0 };
+}
+
+/**
+ * @brief Tells how many threads run tasks pushed to the pool, besides the
+ * threads waiting on them.
+ *
+ * @return size_t
+ */
+size_t workers_count(void)
+{
+    workers_start(0);
+
+    return workers.threads_nb;
+}
+
+/**
+ * @brief Pushes a task to be run by the pool. The task is counted in some
+ * group until it is done.
+ *
+ * @param[inout] group Group the task is counted in.
+ * @param[in] task Function run by some thread of the pool.
+ * @param[in] data Data passed to the function.
+ */
+void workers_push(struct worker_group *group, worker_task_f task, void *data)
+{
+    workers_start(0);
+
+    SDL_LockMutex(workers.lock);
+    group->pending += 1;
+    SDL_UnlockMutex(workers.lock);
+
+    if (workers.threads_nb == 0) {
+        workers_run((struct worker_task) { task, data, group });
+        return;
+    }
+
+    SDL_LockMutex(workers.lock);
+    array_ensure_capacity(make_system_allocator(),
+            (ARRAY_ANY *) &workers.queue, 1);
+    array_push(workers.queue, &(struct worker_task) { task, data, group });
+    SDL_CondSignal(workers.task_pushed);
+    SDL_UnlockMutex(workers.lock);
+}
+
+/**
+ * @brief Tells if all tasks of a group are done, without waiting.
+ *
+ * @param[in] group Polled group.
+ * @return bool
+ */
+bool workers_done(struct worker_group *group)
+{
+    bool done = false;
+
+    if (!workers.started) {
+        return (group->pending == 0);
+    }
+
+    SDL_LockMutex(workers.lock);
+    done = (group->pending == 0);
+    SDL_UnlockMutex(workers.lock);
+
+    return done;
+}
+
+/**
+ * @brief Waits for all tasks of a group to be done. The calling thread runs
+ * queued tasks while it waits.
+ *
+ * @param[inout] group Awaited group.
+ */
+void workers_wait(struct worker_group *group)
+{
+    struct worker_task task = { 0 };
+
+    if (!workers.started) {
+        return;
+    }
+
+    while (!workers_done(group)) {
+        if (workers_pop(&task)) {
+            workers_run(task);
+            continue;
+        }
+
+        SDL_LockMutex(workers.lock);
+        if (group->pending > 0) {
+            SDL_CondWait(workers.task_done, workers.lock);
+        }
+        SDL_UnlockMutex(workers.lock);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Body of the threads of the pool : runs tasks as they come.
+ *
+ * @param[in] data Unused.
+ * @return i32
+ */
+static i32 workers_loop(void *data)
+{
+    struct worker_task task = { 0 };
+    bool has_task = false;
+
+    (void) data;
+
+    while (true) {
+        SDL_LockMutex(workers.lock);
+        while (workers.running
+                && (workers.queue_head == array_length(workers.queue))) {
+            SDL_CondWait(workers.task_pushed, workers.lock);
+        }
+        if (!workers.running) {
+            SDL_UnlockMutex(workers.lock);
+            return 0;
+        }
+        has_task = workers_pop(&task);
+        SDL_UnlockMutex(workers.lock);
+
+        if (has_task) {
+            workers_run(task);
+        }
+    }
+}
+
+/**
+ * @brief Takes the oldest task of the queue, if any. The lock is taken by the
+ * function and can already be held (it is recursive).
+ *
+ * @param[out] out_task Task taken.
+ * @return bool
+ */
+static bool workers_pop(struct worker_task *out_task)
+{
+    bool found = false;
+
+    SDL_LockMutex(workers.lock);
+    if (workers.queue_head < array_length(workers.queue)) {
+        *out_task = workers.queue[workers.queue_head];
+        workers.queue_head += 1;
+        found = true;
+
+        if (workers.queue_head == array_length(workers.queue)) {
+            array_clear(workers.queue);
+            workers.queue_head = 0;
+        }
+    }
+    SDL_UnlockMutex(workers.lock);
+
+    return found;
+}
+
+/**
+ * @brief Runs a task, and counts it out of its group.
+ *
+ * @param[in] task
+ */
+static void workers_run(struct worker_task task)
+{
+    task.task(task.data);
+
+    SDL_LockMutex(workers.lock);
+    task.group->pending -= 1;
+    if (workers.started) {
+        SDL_CondBroadcast(workers.task_done);
+    }
+    SDL_UnlockMutex(workers.lock);
+}